@@ -0,0 +1,108 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * BENCH - just enough infrastructure for timing loops.
+ *
+ * Like minctest, all functions and macros start with the same letter ('b').
+ */
+
+#ifndef FMC_BENCH_H_INCLUDED
+#define FMC_BENCH_H_INCLUDED
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+/* Wall clock time in seconds, good to a few nanoseconds. */
+static double bnow() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Print nanoseconds per operation for `n` operations in `secs` seconds. */
+#define breport(name, n, secs) do {\
+    printf("\t%-44s %10.1f ns/op\n", (name), (secs) * 1e9 / (double)(n));\
+} while (0)
+
+/* Print bytes per item for `n` items taking `bytes` bytes. */
+#define bbytes(name, n, bytes) do {\
+    printf("\t%-44s %10.1f bytes/item\n", (name), (double)(bytes) / (double)(n));\
+} while (0)
+
+/* Bytes currently allocated by malloc(), if we can tell; else 0. */
+static size_t bheap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 mi = mallinfo2();
+
+    // Big blocks come from mmap() and are counted apart
+    return mi.uordblks + mi.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+/* Peak resident set size in kilobytes, from getrusage(), if we can tell; else 0. */
+static size_t bmaxrss() {
+#if defined(__unix__) || defined(__APPLE__)
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#if defined(__APPLE__)
+    return (size_t)ru.ru_maxrss / 1024;
+#else
+    return (size_t)ru.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+/* Number of operations from the command line, or `dflt`. */
+static size_t bsize(int argc, char* argv[], size_t dflt) {
+    return (argc > 1) ? (size_t)strtoull(argv[1], NULL, 10) : dflt;
+}
+
+/* A small, fast, deterministic pseudo-random number generator. */
+static uint64_t bstate = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t brand() {
+    bstate ^= bstate << 13;
+    bstate ^= bstate >> 7;
+    bstate ^= bstate << 17;
+    return bstate;
+}
+
+/* Defeat the optimizer without costing anything measurable. */
+static volatile uintptr_t bsink;
+
+#endif /* FMC_BENCH_H_INCLUDED */
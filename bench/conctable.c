@@ -0,0 +1,141 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "conctable.h"
+#include "table.h"
+
+#define MAXTHREADS  64
+#define NKEYS       100000
+
+/*
+ * Each thread does `nops` operations on random keys, one in `putrate`
+ * of them a put, the rest gets; against either a C_Concurrent_Table or
+ * a C_Table behind one mutex.
+ */
+typedef struct {
+    uint64_t seed;
+    size_t   nops;
+    int      putrate;
+} job;
+
+static C_Concurrent_Table* ct = NULL;
+static C_Table* t = NULL;
+static pthread_mutex_t tlock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t next_rand(uint64_t* state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void* conc_main(void* arg) {
+    job* j = (job*)arg;
+    uint64_t state = j->seed;
+    C_Userdata key, value;
+    uintptr_t sum = 0;
+
+    for (size_t i = 0; i < j->nops; i++) {
+        uint64_t r = next_rand(&state);
+
+        C_Userdata_set_pointer(&key, (void*)(uintptr_t)((r % NKEYS + 1) << 4));
+        if ((r >> 32) % j->putrate == 0) {
+            C_Userdata_set_pointer(&value, (void*)(uintptr_t)i);
+            C_Concurrent_Table_put(ct, &key, &value);
+        } else if (C_Concurrent_Table_get(ct, &key, &value)) {
+            sum += (uintptr_t)value.ptr;
+        }
+    }
+    bsink += sum;
+    return NULL;
+}
+
+static void* locked_main(void* arg) {
+    job* j = (job*)arg;
+    uint64_t state = j->seed;
+    C_Userdata key, value;
+    uintptr_t sum = 0;
+
+    for (size_t i = 0; i < j->nops; i++) {
+        uint64_t r = next_rand(&state);
+
+        C_Userdata_set_pointer(&key, (void*)(uintptr_t)((r % NKEYS + 1) << 4));
+        pthread_mutex_lock(&tlock);
+        if ((r >> 32) % j->putrate == 0) {
+            C_Userdata_set_pointer(&value, (void*)(uintptr_t)i);
+            C_Table_put(t, &key, &value);
+        } else if (C_Table_get(t, &key, &value)) {
+            sum += (uintptr_t)value.ptr;
+        }
+        pthread_mutex_unlock(&tlock);
+    }
+    bsink += sum;
+    return NULL;
+}
+
+static void bench_threads(const char* what, void* (*f)(void*), int nthreads, size_t nops, int putrate) {
+    pthread_t threads[MAXTHREADS];
+    job jobs[MAXTHREADS];
+    char name[80];
+    double start;
+
+    start = bnow();
+    for (int i = 0; i < nthreads; i++) {
+        jobs[i].seed    = 0x9E3779B97F4A7C15ULL * (i + 1);
+        jobs[i].nops    = nops;
+        jobs[i].putrate = putrate;
+        pthread_create(&threads[i], NULL, f, &jobs[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    snprintf(name, sizeof(name), "%s, %d threads", what, nthreads);
+    breport(name, nops * nthreads, bnow() - start);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = bsize(argc, argv, 200000);
+    C_Userdata key, value;
+
+    C_Concurrent_Table_new(&ct, NKEYS);
+    C_Table_new(&t, NKEYS);
+    for (size_t k = 1; k <= NKEYS; k++) {
+        C_Userdata_set_pointer(&key, (void*)(uintptr_t)(k << 4));
+        C_Userdata_set_pointer(&value, (void*)(uintptr_t)k);
+        C_Concurrent_Table_add(ct, &key, &value);
+        C_Table_add(t, &key, &value);
+    }
+
+    printf("C_Concurrent_Table vs. locked C_Table, %zu ops/thread, 10%% puts (aggregate):\n", n);
+    for (int nthreads = 1; nthreads <= MAXTHREADS; nthreads *= 2) {
+        bench_threads("concurrent", conc_main, nthreads, n, 10);
+        bench_threads("mutex", locked_main, nthreads, n, 10);
+    }
+
+    C_Concurrent_Table_free(&ct);
+    C_Table_free(&t);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "hash.h"
+
+static void bench_length(size_t len, size_t total) {
+    uint8_t* buf = malloc(len);
+    size_t reps = total / len;
+    char name[80];
+    double start, secs;
+
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)brand();
+    }
+
+    start = bnow();
+    for (size_t i = 0; i < reps; i++) {
+        bsink += C_Hash_bytes(buf, len);
+    }
+    secs = bnow() - start;
+
+    snprintf(name, sizeof(name), "C_Hash_bytes, %zu bytes", len);
+    breport(name, reps, secs);
+    printf("\t%-44s %10.2f GB/s\n", "", (double)(reps * len) / secs / 1e9);
+
+    free(buf);
+}
+
+int main(int argc, char* argv[]) {
+    size_t total = bsize(argc, argv, 1000000000);
+
+    printf("C_Hash_bytes, %zu bytes hashed per length:\n", total);
+    bench_length(8, total / 8);
+    bench_length(24, total / 4);
+    bench_length(100, total);
+    bench_length(1024, total);
+    bench_length(65536, total);
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "refset.h"
+
+static void shuffle(void* *keys, size_t n) {
+    for (size_t i = n - 1; i > 0; i--) {
+        size_t j = brand() % (i + 1);
+        void* tmp = keys[i];
+        keys[i] = keys[j];
+        keys[j] = tmp;
+    }
+}
+
+/*
+ * Pointers from malloc(), as the symbol registry and reference counts
+ * would see them.  `nmiss` may be less than `n` where misses are slow.
+ */
+static void bench_set(size_t n, size_t nmiss) {
+    C_Ref_Set* s = NULL;
+    C_Hash_Stats stats;
+    void* *keys = malloc(n * sizeof(void*));
+    void* *misses = malloc(nmiss * sizeof(void*));
+    double start;
+
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = malloc(16);
+    }
+    for (size_t i = 0; i < nmiss; i++) {
+        misses[i] = malloc(16);
+    }
+
+    // Hits and misses in no particular order
+    shuffle(keys, n);
+    shuffle(misses, nmiss);
+
+    C_Ref_Set_new(&s, 0);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        C_Ref_Set_add(s, keys[i]);
+    }
+    breport("add", n, bnow() - start);
+
+    C_Ref_Set_stats(s, &stats);
+    printf("\t%-44s %10.2f mean, %zu max, %zu resizes\n", "probe length",
+            (double)stats.total_probe / (double)stats.entries, stats.max_probe, stats.resizes);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += C_Ref_Set_has(s, keys[i]);
+    }
+    breport("has (hit)", n, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < nmiss; i++) {
+        bsink += C_Ref_Set_has(s, misses[i]);
+    }
+    breport("has (miss)", nmiss, bnow() - start);
+
+    // Churn: remove and re-add a tenth of the keys, ten times
+    start = bnow();
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = round; i < n; i += 10) {
+            C_Ref_Set_remove(s, keys[i]);
+        }
+        for (size_t i = round; i < n; i += 10) {
+            C_Ref_Set_add(s, keys[i]);
+        }
+    }
+    breport("remove + add (churn)", 2 * n, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < nmiss; i++) {
+        bsink += C_Ref_Set_has(s, misses[i]);
+    }
+    breport("has (miss) after churn", nmiss, bnow() - start);
+
+    C_Ref_Set_free(&s);
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+    }
+    for (size_t i = 0; i < nmiss; i++) {
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+}
+
+/*
+ * Misses with and without a filter, and how often the filter lets a
+ * miss through to the slots anyway.
+ */
+static void bench_filter(size_t n, size_t nmiss) {
+    C_Ref_Set* s = NULL;
+    C_Hash_Stats stats;
+    void* *keys = malloc(n * sizeof(void*));
+    void* *misses = malloc(nmiss * sizeof(void*));
+    size_t maybes = 0;
+    size_t bytes;
+    double start;
+
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = malloc(16);
+    }
+    for (size_t i = 0; i < nmiss; i++) {
+        misses[i] = malloc(16);
+    }
+    shuffle(misses, nmiss);
+
+    C_Ref_Set_new(&s, 0);
+    for (size_t i = 0; i < n; i++) {
+        C_Ref_Set_add(s, keys[i]);
+    }
+    C_Ref_Set_stats(s, &stats);
+    bytes = stats.bytes;
+
+    start = bnow();
+    for (size_t i = 0; i < nmiss; i++) {
+        bsink += C_Ref_Set_has(s, misses[i]);
+    }
+    breport("has (miss), no filter", nmiss, bnow() - start);
+
+    C_Ref_Set_set_filter(s, true);
+    C_Ref_Set_stats(s, &stats);
+
+    start = bnow();
+    for (size_t i = 0; i < nmiss; i++) {
+        bsink += C_Ref_Set_has(s, misses[i]);
+    }
+    breport("has (miss), filter", nmiss, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += C_Ref_Set_has(s, keys[i]);
+    }
+    breport("has (hit), filter", n, bnow() - start);
+
+    for (size_t i = 0; i < nmiss; i++) {
+        maybes += C_Ref_Set_may_have(s, misses[i]);
+    }
+    printf("\t%-44s %10.2f%%\n", "false positives",
+            100.0 * (double)maybes / (double)nmiss);
+    printf("\t%-44s %10.2f%% at %.2f load\n", "filter memory over the set's",
+            100.0 * (double)(stats.bytes - bytes) / (double)bytes,
+            (double)stats.entries / (double)stats.buckets);
+
+    C_Ref_Set_free(&s);
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+    }
+    for (size_t i = 0; i < nmiss; i++) {
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = bsize(argc, argv, 1000000);
+    size_t nmiss = (argc > 2) ? (size_t)strtoull(argv[2], NULL, 10) : n;
+
+    printf("C_Ref_Set, %zu entries, %zu misses:\n", n, nmiss);
+    bench_set(n, nmiss);
+
+    printf("C_Ref_Set filter, %zu entries, %zu misses:\n", n, nmiss);
+    bench_filter(n, nmiss);
+    printf("C_Ref_Set filter, %zu entries, %zu misses:\n", n / 100, nmiss);
+    bench_filter(n / 100, nmiss);
+
+    return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "reftable.h"
+
+/*
+ * Fill a table to `load` of its slots with pointers from malloc(),
+ * then time hits and misses and report probe lengths.
+ */
+static void bench_load(size_t n, double load) {
+    char name[80];
+    C_Ref_Table* t = NULL;
+    C_Hash_Stats stats;
+    void* *keys;
+    void* *misses;
+    size_t nkeys;
+    double start;
+
+    C_Ref_Table_new(&t, n);
+    C_Ref_Table_stats(t, &stats);
+    nkeys = (size_t)(stats.buckets * load);
+
+    keys = malloc(nkeys * sizeof(void*));
+    misses = malloc(nkeys * sizeof(void*));
+    for (size_t i = 0; i < nkeys; i++) {
+        keys[i] = malloc(16);
+        misses[i] = malloc(16);
+    }
+
+    start = bnow();
+    for (size_t i = 0; i < nkeys; i++) {
+        C_Ref_Table_put(t, keys[i], keys[i], NULL);
+    }
+    snprintf(name, sizeof(name), "put to %.2f load", load);
+    breport(name, nkeys, bnow() - start);
+
+    C_Ref_Table_stats(t, &stats);
+    printf("\t%-44s %10.2f mean, %zu max, %zu resizes\n", "probe length",
+            (double)stats.total_probe / (double)stats.entries, stats.max_probe, stats.resizes);
+
+    start = bnow();
+    for (size_t i = 0; i < nkeys; i++) {
+        bsink += (uintptr_t)C_Ref_Table_get(t, keys[i]);
+    }
+    breport("get (hit)", nkeys, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < nkeys; i++) {
+        bsink += C_Ref_Table_has(t, misses[i]);
+    }
+    breport("has (miss)", nkeys, bnow() - start);
+
+    // Churn: remove and re-add a tenth of the keys, ten times
+    start = bnow();
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = round; i < nkeys; i += 10) {
+            C_Ref_Table_remove(t, keys[i], NULL);
+        }
+        for (size_t i = round; i < nkeys; i += 10) {
+            C_Ref_Table_put(t, keys[i], keys[i], NULL);
+        }
+    }
+    breport("remove + put (churn)", 2 * nkeys, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < nkeys; i++) {
+        bsink += C_Ref_Table_has(t, misses[i]);
+    }
+    breport("has (miss) after churn", nkeys, bnow() - start);
+
+    for (size_t i = 0; i < nkeys; i++) {
+        free(keys[i]);
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+    C_Ref_Table_free(&t);
+}
+
+/*
+ * Load `n` pointers into an empty table one at a time, then all at once.
+ */
+static void bench_bulk(size_t n) {
+    C_Ref_Table* t = NULL;
+    const void* *keys = malloc(n * sizeof(void*));
+    double start;
+
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = malloc(16);
+    }
+
+    C_Ref_Table_new(&t, 0);
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        C_Ref_Table_put(t, keys[i], keys[i], NULL);
+    }
+    breport("put one at a time", n, bnow() - start);
+
+    C_Ref_Table_clear(t);
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        C_Ref_Table_put(t, keys[i], keys[i], NULL);
+    }
+    breport("put after clear", n, bnow() - start);
+    C_Ref_Table_free(&t);
+
+    C_Ref_Table_new(&t, 0);
+    start = bnow();
+    C_Ref_Table_put_many(t, n, keys, keys);
+    breport("put_many", n, bnow() - start);
+    C_Ref_Table_free(&t);
+
+    for (size_t i = 0; i < n; i++) {
+        free((void*)keys[i]);
+    }
+    free(keys);
+}
+
+/*
+ * Look up mostly untracked pointers, as C_Ref_Count_refcount() does for
+ * objects it never saw: nine misses for every hit.
+ */
+static void bench_misses(size_t n, C_Ref_Table_Layout layout) {
+    C_Ref_Table* t = NULL;
+    void* *keys = malloc(n * sizeof(void*));
+    void* *misses = malloc(n * sizeof(void*));
+    double start;
+
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = malloc(16);
+        misses[i] = malloc(16);
+    }
+
+    C_Ref_Table_new_with_layout(&t, 0, layout);
+    for (size_t i = 0; i < n; i++) {
+        C_Ref_Table_put(t, keys[i], keys[i], NULL);
+    }
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += (uintptr_t)C_Ref_Table_get(t, misses[i]);
+    }
+    breport("get (all miss)", n, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        void* k = (i % 10 == 0) ? keys[i] : misses[i];
+        bsink += (uintptr_t)C_Ref_Table_get(t, k);
+    }
+    breport("get (90% miss)", n, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += (uintptr_t)C_Ref_Table_get(t, keys[i]);
+    }
+    breport("get (all hit)", n, bnow() - start);
+
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+    C_Ref_Table_free(&t);
+}
+
+/*
+ * A burst of `n` tracked objects, all but a thousandth of which die off,
+ * with and without shrinking; then misses and a walk over the survivors.
+ */
+static void bench_burst(size_t n, double shrink_load) {
+    C_Ref_Table* t = NULL;
+    C_Ref_Table_Iterator it;
+    C_Hash_Stats stats;
+    void* *keys = malloc(n * sizeof(void*));
+    size_t keep = n / 1000;
+    size_t heap;
+    double start;
+
+    for (size_t i = 0; i < n; i++) {
+        keys[i] = malloc(16);
+    }
+
+    C_Ref_Table_new(&t, 0);
+    C_Ref_Table_set_shrink_load(t, shrink_load);
+    for (size_t i = 0; i < n; i++) {
+        C_Ref_Table_put(t, keys[i], keys[i], NULL);
+    }
+    C_Ref_Table_stats(t, &stats);
+    heap = bheap();
+    printf("\t%-44s %10zu KB\n", "table at peak", stats.bytes / 1024);
+
+    start = bnow();
+    for (size_t i = keep; i < n; i++) {
+        C_Ref_Table_remove(t, keys[i], NULL);
+    }
+    breport("remove", n - keep, bnow() - start);
+
+    C_Ref_Table_stats(t, &stats);
+    printf("\t%-44s %10zu KB\n", "table after die-off", stats.bytes / 1024);
+    if (heap > 0) {
+        printf("\t%-44s %10zd KB\n", "table memory freed by die-off",
+                ((ssize_t)heap - (ssize_t)bheap()) / 1024);
+    }
+
+    start = bnow();
+    for (size_t i = keep; i < n; i++) {
+        bsink += (uintptr_t)C_Ref_Table_get(t, keys[i]);
+    }
+    breport("get (miss) after die-off", n - keep, bnow() - start);
+
+    start = bnow();
+    for (int round = 0; round < 100; round++) {
+        C_Ref_Table_Iterator_init(t, &it);
+        while (C_Ref_Table_Iterator_has_next(&it)) {
+            C_Ref_Table_Iterator_next(&it);
+            bsink += (uintptr_t)C_Ref_Table_Iterator_current_key(&it);
+        }
+    }
+    breport("iterate survivors", 100 * keep, bnow() - start);
+
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+    C_Ref_Table_free(&t);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = bsize(argc, argv, 1000000);
+
+    printf("C_Ref_Table, room for %zu entries:\n", n);
+    bench_load(n, 0.5);
+    bench_load(n, 0.75);
+    bench_load(n, 0.9);
+
+    printf("C_Ref_Table bulk loading, %zu entries:\n", n);
+    bench_bulk(n);
+
+    printf("C_Ref_Table miss-heavy lookups, %zu entries, pairs layout:\n", n);
+    bench_misses(n, C_REF_TABLE_PAIRS);
+    printf("C_Ref_Table miss-heavy lookups, %zu entries, split layout:\n", n);
+    bench_misses(n, C_REF_TABLE_SPLIT);
+
+    printf("C_Ref_Table burst of %zu entries dying off, never shrinking:\n", n);
+    bench_burst(n, 0);
+    printf("C_Ref_Table burst of %zu entries dying off, shrinking:\n", n);
+    bench_burst(n, 0.1125);
+
+    printf("Peak resident set size (getrusage): %zu KB\n", bmaxrss());
+
+    return 0;
+}
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "strtable.h"
+
+/*
+ * Keys like "user:12345:profile", about as long as typical dictionary
+ * words and identifiers, numbered so every one is distinct.
+ */
+static char* *make_keys(size_t n, const char* prefix) {
+    char* *keys = malloc(n * sizeof(char*));
+    char buf[64];
+
+    for (size_t i = 0; i < n; i++) {
+        snprintf(buf, sizeof(buf), "%s:%zu:%u", prefix, i, (unsigned)(brand() % 1000));
+        keys[i] = strdup(buf);
+    }
+    return keys;
+}
+
+static void free_keys(char* *keys, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        free(keys[i]);
+    }
+    free(keys);
+}
+
+static void bench_table(size_t n, C_String_Table_Layout layout) {
+    C_String_Table* t = NULL;
+    C_Hash_Stats stats;
+    char* *keys = make_keys(n, "user");
+    char* *misses = make_keys(n, "none");
+    size_t heap;
+    double start;
+
+    heap = bheap();
+    C_String_Table_new_with_layout(&t, 0, layout);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        C_String_Table_add(t, strlen(keys[i]), (const uint8_t*)keys[i], keys[i]);
+    }
+    breport("add", n, bnow() - start);
+
+    C_String_Table_stats(t, &stats);
+    bbytes("memory (stats)", n, stats.bytes);
+    if (heap > 0) {
+        bbytes("memory (heap)", n, bheap() - heap);
+    }
+    printf("\t%-44s %10.2f mean, %zu max, %zu resizes\n", "probe length",
+            (double)stats.total_probe / (double)stats.entries, stats.max_probe, stats.resizes);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += (uintptr_t)C_String_Table_get(t, strlen(keys[i]), (const uint8_t*)keys[i]);
+    }
+    breport("get (hit)", n, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += C_String_Table_has(t, strlen(misses[i]), (const uint8_t*)misses[i]);
+    }
+    breport("has (miss)", n, bnow() - start);
+
+    // Churn: remove and re-add a tenth of the keys, ten times
+    start = bnow();
+    for (int round = 0; round < 10; round++) {
+        for (size_t i = round; i < n; i += 10) {
+            C_String_Table_remove(t, strlen(keys[i]), (const uint8_t*)keys[i], NULL);
+        }
+        for (size_t i = round; i < n; i += 10) {
+            C_String_Table_add(t, strlen(keys[i]), (const uint8_t*)keys[i], keys[i]);
+        }
+    }
+    breport("remove + add (churn)", 2 * n, bnow() - start);
+
+    C_String_Table_stats(t, &stats);
+    bbytes("memory after churn (stats)", n, stats.bytes);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        C_String_Table_remove(t, strlen(keys[i]), (const uint8_t*)keys[i], NULL);
+    }
+    breport("remove", n, bnow() - start);
+
+    C_String_Table_free(&t);
+    free_keys(keys, n);
+    free_keys(misses, n);
+}
+
+/*
+ * A table built once and then only read, before and after freezing.
+ */
+static void bench_frozen(size_t n) {
+    C_String_Table* t = NULL;
+    C_Hash_Stats stats;
+    char* *keys = make_keys(n, "word");
+    char* *misses = make_keys(n, "none");
+    double start;
+
+    C_String_Table_new(&t, 0);
+    for (size_t i = 0; i < n; i++) {
+        C_String_Table_add(t, strlen(keys[i]), (const uint8_t*)keys[i], keys[i]);
+    }
+
+    for (int frozen = 0; frozen < 2; frozen++) {
+        const char* how = frozen ? "frozen" : "open";
+        char name[80];
+
+        if (frozen) {
+            start = bnow();
+            C_String_Table_freeze(t);
+            breport("freeze", n, bnow() - start);
+        }
+        C_String_Table_stats(t, &stats);
+        snprintf(name, sizeof(name), "memory, %s", how);
+        bbytes(name, n, stats.bytes);
+
+        start = bnow();
+        for (size_t i = 0; i < n; i++) {
+            bsink += (uintptr_t)C_String_Table_get(t, strlen(keys[i]), (const uint8_t*)keys[i]);
+        }
+        snprintf(name, sizeof(name), "get (hit), %s", how);
+        breport(name, n, bnow() - start);
+
+        start = bnow();
+        for (size_t i = 0; i < n; i++) {
+            bsink += C_String_Table_has(t, strlen(misses[i]), (const uint8_t*)misses[i]);
+        }
+        snprintf(name, sizeof(name), "has (miss), %s", how);
+        breport(name, n, bnow() - start);
+    }
+
+    C_String_Table_free(&t);
+    free_keys(keys, n);
+    free_keys(misses, n);
+}
+
+static bool count_key(size_t keylen, const uint8_t* key, const void* value, void* data) {
+    (*(size_t*)data)++;
+    return true;
+}
+
+/*
+ * Enumerating every key under a prefix, and every key in the table.
+ */
+static void bench_prefix(size_t n, C_String_Table_Layout layout) {
+    C_String_Table* t = NULL;
+    char* *keys = make_keys(n, "user");
+    const int nscans = 100;
+    size_t found = 0;
+    double start;
+
+    C_String_Table_new_with_layout(&t, 0, layout);
+    for (size_t i = 0; i < n; i++) {
+        C_String_Table_add(t, strlen(keys[i]), (const uint8_t*)keys[i], keys[i]);
+    }
+
+    start = bnow();
+    for (int i = 0; i < nscans; i++) {
+        char prefix[32];
+
+        snprintf(prefix, sizeof(prefix), "user:%d", 1000 + i);
+        C_String_Table_prefix_scan(t, strlen(prefix), (const uint8_t*)prefix, count_key, &found);
+    }
+    breport("prefix_scan (\"user:1xyz\")", nscans, bnow() - start);
+    printf("\t%-44s %10.1f\n", "keys per prefix", (double)found / nscans);
+
+    start = bnow();
+    found = 0;
+    C_String_Table_for_each(t, count_key, &found);
+    breport("for_each", found, bnow() - start);
+
+    C_String_Table_free(&t);
+    free_keys(keys, n);
+}
+
+/*
+ * Starting up from a snapshot instead of rebuilding the table.
+ * The file is fresh in the page cache, so this measures mapping and
+ * faulting pages in, not the disk.
+ */
+static void bench_snapshot(size_t n) {
+    C_String_Table* t = NULL;
+    C_String_Table* m = NULL;
+    char* *keys = make_keys(n, "user");
+    const char* path = "strtable-bench.snapshot";
+    FILE* f;
+    double start;
+
+    start = bnow();
+    C_String_Table_new(&t, 0);
+    for (size_t i = 0; i < n; i++) {
+        C_String_Table_add(t, strlen(keys[i]), (const uint8_t*)keys[i], (void*)(uintptr_t)(i + 1));
+    }
+    breport("build from keys", n, bnow() - start);
+
+    start = bnow();
+    C_String_Table_freeze(t);
+    C_String_Table_save(t, path, NULL, NULL);
+    breport("freeze + save", n, bnow() - start);
+
+    f = fopen(path, "rb");
+    if (f != NULL) {
+        fseek(f, 0, SEEK_END);
+        bbytes("file size", n, (size_t)ftell(f));
+        fclose(f);
+    }
+
+    start = bnow();
+    C_String_Table_map(&m, path);
+    breport("map", 1, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += (uintptr_t)C_String_Table_get(m, strlen(keys[i]), (const uint8_t*)keys[i]);
+    }
+    breport("get (hit), first touch", n, bnow() - start);
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += (uintptr_t)C_String_Table_get(m, strlen(keys[i]), (const uint8_t*)keys[i]);
+    }
+    breport("get (hit), mapped", n, bnow() - start);
+
+    C_String_Table_free(&m);
+    C_String_Table_free(&t);
+    remove(path);
+    free_keys(keys, n);
+}
+
+/*
+ * Loading keys one at a time, after reserve(), and with add_many(),
+ * then walking them with an iterator.
+ */
+static void bench_bulk(size_t n, C_String_Table_Layout layout) {
+    C_String_Table* t = NULL;
+    C_String_Table_Iterator it;
+    C_Hash_Stats stats;
+    char* *keys = make_keys(n, "user");
+    size_t* lens = malloc(n * sizeof(size_t));
+    double start;
+
+    for (size_t i = 0; i < n; i++) {
+        lens[i] = strlen(keys[i]);
+    }
+
+    for (int how = 0; how < 3; how++) {
+        const char* names[] = { "add", "reserve + add", "add_many" };
+
+        C_String_Table_new_with_layout(&t, 0, layout);
+        start = bnow();
+        if (how == 2) {
+            C_String_Table_add_many(t, n, lens, (const uint8_t**)keys, (const void**)keys);
+        } else {
+            if (how == 1) {
+                C_String_Table_reserve(t, n);
+            }
+            for (size_t i = 0; i < n; i++) {
+                C_String_Table_add(t, lens[i], (const uint8_t*)keys[i], keys[i]);
+            }
+        }
+        breport(names[how], n, bnow() - start);
+        C_String_Table_stats(t, &stats);
+        printf("\t%-44s %10zu\n", "resizes", stats.resizes);
+        if (how < 2) {
+            C_String_Table_free(&t);
+        }
+    }
+
+    start = bnow();
+    C_String_Table_Iterator_init(t, &it);
+    while (C_String_Table_Iterator_has_next(&it)) {
+        C_String_Table_Iterator_next(&it);
+        bsink += (uintptr_t)C_String_Table_Iterator_current_value(&it);
+    }
+    breport("iterate", n, bnow() - start);
+
+    C_String_Table_free(&t);
+    free(lens);
+    free_keys(keys, n);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = bsize(argc, argv, 1000000);
+
+    printf("C_String_Table, %zu keys:\n", n);
+    bench_table(n, C_STRING_TABLE_HASHED);
+    printf("C_String_Table ordered, %zu keys:\n", n);
+    bench_table(n, C_STRING_TABLE_ORDERED);
+
+    printf("C_String_Table bulk loading, %zu keys:\n", n);
+    bench_bulk(n, C_STRING_TABLE_HASHED);
+    printf("C_String_Table ordered bulk loading, %zu keys:\n", n);
+    bench_bulk(n, C_STRING_TABLE_ORDERED);
+
+    printf("C_String_Table prefixes, %zu keys:\n", n);
+    bench_prefix(n, C_STRING_TABLE_HASHED);
+    printf("C_String_Table ordered prefixes, %zu keys:\n", n);
+    bench_prefix(n, C_STRING_TABLE_ORDERED);
+
+    printf("C_String_Table read-only, %zu keys:\n", n);
+    bench_frozen(n);
+    printf("C_String_Table read-only, %zu keys:\n", n / 100);
+    bench_frozen(n / 100);
+
+    printf("C_String_Table snapshot, %zu keys:\n", n);
+    bench_snapshot(n);
+
+    return 0;
+}
@@ -0,0 +1,401 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "table.h"
+
+#define KEYSIZ  24
+
+static const char* layout_name(C_Table_Layout layout) {
+    return (layout == C_TABLE_OPEN) ? "open" : "chained";
+}
+
+/*
+ * Keys are either bare pointers or KEYSIZ-byte strings.
+ */
+static void make_key(C_Userdata* key, char* buf, uint64_t k, bool isstr) {
+    if (isstr) {
+        snprintf(buf, KEYSIZ, "k%021llu", (unsigned long long)k);
+        C_Userdata_set_value(key, buf, KEYSIZ - 1);
+    } else {
+        C_Userdata_set_pointer(key, (void*)(uintptr_t)(k << 4));
+    }
+}
+
+static void bench_layout(C_Table_Layout layout, size_t n, bool isstr) {
+    char name[80];
+    char buf[KEYSIZ];
+    C_Table* t = NULL;
+    C_Userdata key, value;
+    double start;
+
+    C_Table_new_with_layout(&t, 0, layout);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        make_key(&key, buf, brand(), isstr);
+        C_Userdata_set_pointer(&value, (void*)(uintptr_t)i);
+        C_Table_add(t, &key, &value);
+    }
+    snprintf(name, sizeof(name), "%s %s add", layout_name(layout), isstr ? "string" : "pointer");
+    breport(name, n, bnow() - start);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        make_key(&key, buf, brand(), isstr);
+        C_Table_get(t, &key, &value);
+        bsink += (uintptr_t)value.ptr;
+    }
+    snprintf(name, sizeof(name), "%s %s get (hit)", layout_name(layout), isstr ? "string" : "pointer");
+    breport(name, n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        make_key(&key, buf, brand(), isstr);
+        bsink += C_Table_has(t, &key);
+    }
+    snprintf(name, sizeof(name), "%s %s has (miss)", layout_name(layout), isstr ? "string" : "pointer");
+    breport(name, n, bnow() - start);
+
+    start = bnow();
+    C_Table_free(&t);
+    snprintf(name, sizeof(name), "%s %s free (per entry)", layout_name(layout), isstr ? "string" : "pointer");
+    breport(name, n, bnow() - start);
+}
+
+/*
+ * A copy function no different from the default, except that the table
+ * can't tell; so it must malloc() every key and value.
+ */
+static bool malloc_copy(C_Userdata* to, const C_Userdata* from) {
+    char* ptr = calloc(from->len + 1, 1);
+
+    if (ptr == NULL) return false;
+    memcpy(ptr, from->ptr, from->len);
+    C_Userdata_set(to, from->tag, from->len, ptr);
+    return true;
+}
+
+static void malloc_free(C_Userdata* ud) {
+    free(ud->ptr);
+}
+
+/*
+ * Short string keys and values, stored by the table (inline in entries)
+ * or by malloc_copy().
+ */
+static void bench_storage(C_Table_Layout layout, size_t n, bool builtin) {
+    const char* how = builtin ? "inline" : "malloc";
+    char name[80];
+    char* keys = malloc(n * KEYSIZ);
+    C_Table* t = NULL;
+    C_Userdata key, value;
+    size_t heap;
+    double start;
+
+    if (keys == NULL) return;
+
+    // Build the keys first so we time only the table
+    bstate = 12345;
+    for (size_t i = 0; i < n; i++) {
+        make_key(&key, keys + i * KEYSIZ, brand(), true);
+    }
+
+    heap = bheap();
+    C_Table_new_with_layout(&t, 0, layout);
+    if (!builtin) {
+        C_Table_define_data_copy(t, malloc_copy);
+        C_Table_define_data_free(t, malloc_free);
+    }
+
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        char* k = keys + i * KEYSIZ;
+
+        C_Userdata_set_value(&key, k, KEYSIZ - 1);
+        C_Userdata_set_value(&value, k + KEYSIZ - 9, 8);
+        C_Table_add(t, &key, &value);
+    }
+    snprintf(name, sizeof(name), "%s %s add", layout_name(layout), how);
+    breport(name, n, bnow() - start);
+
+    if (bheap() > heap) {
+        snprintf(name, sizeof(name), "%s %s memory", layout_name(layout), how);
+        bbytes(name, n, bheap() - heap);
+    }
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        C_Userdata_set_value(&key, keys + (brand() % n) * KEYSIZ, KEYSIZ - 1);
+        C_Table_get(t, &key, &value);
+        bsink += *(char*)value.ptr;
+    }
+    snprintf(name, sizeof(name), "%s %s get (hit)", layout_name(layout), how);
+    breport(name, n, bnow() - start);
+
+    start = bnow();
+    C_Table_free(&t);
+    snprintf(name, sizeof(name), "%s %s free (per entry)", layout_name(layout), how);
+    breport(name, n, bnow() - start);
+
+    free(keys);
+}
+
+static bool sum_visitor(const C_Userdata* key, const C_Userdata* value, void* data) {
+    *(uintptr_t*)data += (uintptr_t)value->ptr;
+    return true;
+}
+
+static void bench_iterate(C_Table_Layout layout, size_t n) {
+    char name[80];
+    C_Table* t = NULL;
+    C_Table_Iterator i;
+    C_Userdata key, value;
+    uintptr_t sum = 0;
+    double start;
+
+    C_Table_new_with_layout(&t, 0, layout);
+
+    bstate = 12345;
+    for (size_t k = 0; k < n; k++) {
+        make_key(&key, NULL, brand(), false);
+        C_Userdata_set_pointer(&value, (void*)(uintptr_t)k);
+        C_Table_add(t, &key, &value);
+    }
+
+    start = bnow();
+    C_Table_Iterator_init(t, &i);
+    while (C_Table_Iterator_has_next(&i)) {
+        C_Table_Iterator_next(&i);
+        C_Table_Iterator_current_pair(&i, &key, &value);
+        sum += (uintptr_t)value.ptr;
+    }
+    snprintf(name, sizeof(name), "%s iterator", layout_name(layout));
+    breport(name, n, bnow() - start);
+
+    start = bnow();
+    C_Table_for_each(t, sum_visitor, &sum);
+    snprintf(name, sizeof(name), "%s for_each", layout_name(layout));
+    breport(name, n, bnow() - start);
+
+    bsink += sum;
+    C_Table_free(&t);
+}
+
+/*
+ * Look up and update random existing keys one at a time, then in batches.
+ */
+static void bench_batches(C_Table_Layout layout, size_t n) {
+    const size_t batch = 256;
+    char name[80];
+    C_Table* t = NULL;
+    C_Userdata keys[256], values[256];
+    uint64_t* ks = calloc(n, sizeof(uint64_t));
+    double start;
+
+    if (ks == NULL) return;
+
+    C_Table_new_with_layout(&t, n, layout);
+
+    bstate = 12345;
+    for (size_t k = 0; k < n; k++) {
+        ks[k] = brand();
+        make_key(&(keys[0]), NULL, ks[k], false);
+        C_Userdata_set_pointer(&(values[0]), (void*)(uintptr_t)k);
+        C_Table_add(t, &(keys[0]), &(values[0]));
+    }
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        make_key(&(keys[0]), NULL, ks[brand() % n], false);
+        C_Table_get(t, &(keys[0]), &(values[0]));
+        bsink += (uintptr_t)values[0].ptr;
+    }
+    snprintf(name, sizeof(name), "%s get", layout_name(layout));
+    breport(name, n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i += batch) {
+        for (size_t j = 0; j < batch; j++) {
+            make_key(&(keys[j]), NULL, ks[brand() % n], false);
+        }
+        C_Table_get_many(t, batch, keys, values, NULL);
+        bsink += (uintptr_t)values[0].ptr;
+    }
+    snprintf(name, sizeof(name), "%s get_many", layout_name(layout));
+    breport(name, n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        make_key(&(keys[0]), NULL, ks[brand() % n], false);
+        C_Userdata_set_pointer(&(values[0]), (void*)(uintptr_t)i);
+        C_Table_put(t, &(keys[0]), &(values[0]));
+    }
+    snprintf(name, sizeof(name), "%s put (update)", layout_name(layout));
+    breport(name, n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i += batch) {
+        for (size_t j = 0; j < batch; j++) {
+            make_key(&(keys[j]), NULL, ks[brand() % n], false);
+            C_Userdata_set_pointer(&(values[j]), (void*)(uintptr_t)(i + j));
+        }
+        C_Table_put_many(t, batch, keys, values);
+    }
+    snprintf(name, sizeof(name), "%s put_many (update)", layout_name(layout));
+    breport(name, n, bnow() - start);
+
+    C_Table_free(&t);
+    free(ks);
+}
+
+/*
+ * Count occurrences of `n` string keys out of `nwords` distinct ones,
+ * with C_Table_get() then C_Table_put(), or through a slot.
+ */
+static void bench_counter(C_Table_Layout layout, size_t n, size_t nwords, bool slots) {
+    char name[80];
+    char* words = malloc(nwords * KEYSIZ);
+    C_Table* t = NULL;
+    C_Table_Slot slot;
+    C_Userdata key, value;
+    double start;
+
+    if (words == NULL) return;
+
+    for (size_t i = 0; i < nwords; i++) {
+        make_key(&key, words + i * KEYSIZ, i, true);
+    }
+
+    C_Table_new_with_layout(&t, 0, layout);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        intptr_t count = 0;
+
+        C_Userdata_set_value(&key, words + (brand() % nwords) * KEYSIZ, KEYSIZ - 1);
+
+        if (slots) {
+            if (C_Table_find_slot(t, &key, &slot) && C_Table_Slot_get(&slot, &value)) {
+                count = (intptr_t)value.ptr;
+            }
+            C_Userdata_set_pointer(&value, (void*)(count + 1));
+            C_Table_Slot_set(&slot, &value);
+        } else {
+            if (C_Table_get(t, &key, &value)) {
+                count = (intptr_t)value.ptr;
+            }
+            C_Userdata_set_pointer(&value, (void*)(count + 1));
+            C_Table_put(t, &key, &value);
+        }
+    }
+    snprintf(name, sizeof(name), "%s count with %s", layout_name(layout), slots ? "slot" : "get+put");
+    breport(name, n, bnow() - start);
+
+    C_Table_free(&t);
+    free(words);
+}
+
+static void bench_resize_step(C_Table_Layout layout, size_t n, size_t step) {
+    char name[80];
+    C_Table* t = NULL;
+    C_Userdata key, value;
+    double start, worst = 0.0, total;
+
+    C_Table_new_with_layout(&t, 0, layout);
+    C_Table_set_resize_step(t, step);
+
+    bstate = 12345;
+    total = bnow();
+    for (size_t i = 0; i < n; i++) {
+        double elapsed;
+
+        C_Userdata_set_pointer(&key, (void*)(uintptr_t)(brand() << 4));
+        C_Userdata_set_pointer(&value, (void*)(uintptr_t)i);
+
+        start = bnow();
+        C_Table_put(t, &key, &value);
+        elapsed = bnow() - start;
+        if (elapsed > worst) {
+            worst = elapsed;
+        }
+    }
+    total = bnow() - total;
+
+    snprintf(name, sizeof(name), "%s put, step %zu (mean)", layout_name(layout), step);
+    breport(name, n, total);
+    snprintf(name, sizeof(name), "%s put, step %zu (worst)", layout_name(layout), step);
+    breport(name, 1, worst);
+
+    C_Table_free(&t);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = bsize(argc, argv, 1000000);
+
+    printf("C_Table, %zu entries:\n", n);
+    bench_layout(C_TABLE_CHAINED, n, false);
+    bench_layout(C_TABLE_OPEN,    n, false);
+    bench_layout(C_TABLE_CHAINED, n, true);
+    bench_layout(C_TABLE_OPEN,    n, true);
+
+    printf("C_Table storage of %d-byte keys, %zu entries:\n", KEYSIZ - 1, n);
+    bench_storage(C_TABLE_CHAINED, n, false);
+    bench_storage(C_TABLE_CHAINED, n, true);
+    bench_storage(C_TABLE_OPEN,    n, false);
+    bench_storage(C_TABLE_OPEN,    n, true);
+
+    printf("C_Table iteration, %zu entries:\n", n);
+    bench_iterate(C_TABLE_CHAINED, n);
+    bench_iterate(C_TABLE_OPEN,    n);
+
+    printf("C_Table counting %zu keys, 10000 distinct:\n", n);
+    bench_counter(C_TABLE_CHAINED, n, 10000, false);
+    bench_counter(C_TABLE_CHAINED, n, 10000, true);
+    bench_counter(C_TABLE_OPEN,    n, 10000, false);
+    bench_counter(C_TABLE_OPEN,    n, 10000, true);
+
+    printf("C_Table batches, %zu entries:\n", 4 * n);
+    bench_batches(C_TABLE_CHAINED, 4 * n);
+    bench_batches(C_TABLE_OPEN,    4 * n);
+
+    printf("C_Table resize latency, %zu entries:\n", n);
+    bench_resize_step(C_TABLE_CHAINED, n, 0);
+    bench_resize_step(C_TABLE_CHAINED, n, 1);
+    bench_resize_step(C_TABLE_CHAINED, n, 16);
+    bench_resize_step(C_TABLE_OPEN,    n, 0);
+    bench_resize_step(C_TABLE_OPEN,    n, 1);
+    bench_resize_step(C_TABLE_OPEN,    n, 16);
+    return 0;
+}
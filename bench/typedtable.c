@@ -0,0 +1,173 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "table.h"
+#include "typedtable.h"
+
+/*
+ * A 16-byte struct key, as for a map from (object, field) pairs.
+ */
+typedef struct _pair_key {
+    uint64_t a;
+    uint64_t b;
+} pair_key;
+
+#define pair_hash(k)        C_Hash_u64((k).a ^ C_Hash_u64((k).b))
+#define pair_equals(x, y)   ((x).a == (y).a && (x).b == (y).b)
+
+C_TABLE_DEFINE(U64_Table, uint64_t, uintptr_t, C_Hash_u64, C_TABLE_EQ_SCALAR)
+
+C_TABLE_DEFINE(Pair_Table, pair_key, uintptr_t, pair_hash, pair_equals)
+
+static void bench_generic(size_t n, size_t keysize, const char* what) {
+    char name[80];
+    uint64_t buf[2];
+    C_Table* t = NULL;
+    C_Userdata key, value;
+    double start;
+
+    C_Table_new_with_layout(&t, 0, C_TABLE_OPEN);
+    C_Userdata_set_value(&key, buf, keysize);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        buf[0] = brand();
+        buf[1] = buf[0] >> 3;
+        C_Userdata_set_pointer(&value, (void*)(uintptr_t)i);
+        C_Table_put(t, &key, &value);
+    }
+    snprintf(name, sizeof(name), "C_Table %s put", what);
+    breport(name, n, bnow() - start);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        buf[0] = brand();
+        buf[1] = buf[0] >> 3;
+        C_Table_get(t, &key, &value);
+        bsink += (uintptr_t)value.ptr;
+    }
+    snprintf(name, sizeof(name), "C_Table %s get (hit)", what);
+    breport(name, n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        buf[0] = brand();
+        buf[1] = buf[0] >> 3;
+        bsink += C_Table_has(t, &key);
+    }
+    snprintf(name, sizeof(name), "C_Table %s has (miss)", what);
+    breport(name, n, bnow() - start);
+
+    C_Table_free(&t);
+}
+
+static void bench_typed_u64(size_t n) {
+    U64_Table* t = NULL;
+    uintptr_t value = 0;
+    double start;
+
+    U64_Table_new(&t, 0);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        U64_Table_put(t, brand(), (uintptr_t)i);
+    }
+    breport("typed uint64 put", n, bnow() - start);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        U64_Table_get(t, brand(), &value);
+        bsink += value;
+    }
+    breport("typed uint64 get (hit)", n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        bsink += U64_Table_has(t, brand());
+    }
+    breport("typed uint64 has (miss)", n, bnow() - start);
+
+    U64_Table_free(&t);
+}
+
+static void bench_typed_pair(size_t n) {
+    Pair_Table* t = NULL;
+    pair_key key;
+    uintptr_t value = 0;
+    double start;
+
+    Pair_Table_new(&t, 0);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        key.a = brand();
+        key.b = key.a >> 3;
+        Pair_Table_put(t, key, (uintptr_t)i);
+    }
+    breport("typed 16-byte struct put", n, bnow() - start);
+
+    bstate = 12345;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        key.a = brand();
+        key.b = key.a >> 3;
+        Pair_Table_get(t, key, &value);
+        bsink += value;
+    }
+    breport("typed 16-byte struct get (hit)", n, bnow() - start);
+
+    bstate = 54321;
+    start = bnow();
+    for (size_t i = 0; i < n; i++) {
+        key.a = brand();
+        key.b = key.a >> 3;
+        bsink += Pair_Table_has(t, key);
+    }
+    breport("typed 16-byte struct has (miss)", n, bnow() - start);
+
+    Pair_Table_free(&t);
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = bsize(argc, argv, 1000000);
+
+    printf("uint64 keys to pointers, %zu entries:\n", n);
+    bench_generic(n, sizeof(uint64_t), "uint64");
+    bench_typed_u64(n);
+
+    printf("16-byte struct keys to pointers, %zu entries:\n", n);
+    bench_generic(n, sizeof(pair_key), "16-byte struct");
+    bench_typed_pair(n);
+
+    return 0;
+}
@@ -0,0 +1,573 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "cthread.h"
+#include "hash.h"
+#include "conctable.h"
+
+#define MIN_BUCKETS     16
+#define LOAD_NUM        3
+#define LOAD_DEN        4
+
+/* Writer locks; bucket `b` belongs to stripe `b % NSTRIPES` */
+#define NSTRIPES        64
+
+/* Reader counters; threads share them round-robin */
+#define NREADERS        64
+
+/* Replaced entries to hold before waiting out readers to free them */
+#define LIMBO_MAX       256
+
+#define CACHE_LINE      64
+
+typedef struct _CT_Node CT_Node;
+
+/*
+ * An entry, never changed once visible to readers except for `next`.
+ * Key and value data follow in the same block.
+ */
+struct _CT_Node {
+    _Atomic(CT_Node*) next;
+    uint64_t          hash;
+    C_Userdata        key;
+    C_Userdata        value;
+    uint8_t           data[];
+};
+
+typedef struct _CT_Index {
+    size_t            mask;
+    _Atomic(CT_Node*) heads[];
+} CT_Index;
+
+typedef struct _CT_Stripe {
+    _Alignas(CACHE_LINE) LOCK_TYPE(lock);
+} CT_Stripe;
+
+/*
+ * Readers in each of the two most recent epochs, by parity.
+ */
+typedef struct _CT_Readers {
+    _Alignas(CACHE_LINE) atomic_size_t count[2];
+} CT_Readers;
+
+struct C_Concurrent_Table {
+    _Atomic(CT_Index*) index;
+    atomic_size_t      nentries;
+    atomic_size_t      epoch;
+
+    /* blocks unlinked but perhaps still seen by readers */
+    LOCK_TYPE(gclock);
+    void**             limbo;
+    size_t             nlimbo;
+    size_t             limbocap;
+
+    CT_Stripe          stripes[NSTRIPES];
+    CT_Readers         readers[NREADERS];
+};
+
+static atomic_uint _next_reader = 1;
+
+static _Thread_local unsigned _reader = 0;
+
+/* ------------------------- Epochs and Reclamation -------------------- */
+
+/*
+ * Enter a read-side critical section; returns the parity to pass to
+ * `read_exit()`.  Nothing unlinked after this may be freed until then.
+ */
+static unsigned read_enter(C_Concurrent_Table* t) {
+    CT_Readers* r;
+
+    if (_reader == 0) {
+        _reader = atomic_fetch_add(&_next_reader, 1);
+    }
+    r = &(t->readers[_reader % NREADERS]);
+
+    for (;;) {
+        size_t e = atomic_load(&(t->epoch));
+        unsigned parity = (unsigned)(e & 1);
+
+        atomic_fetch_add(&(r->count[parity]), 1);
+        if (atomic_load(&(t->epoch)) == e) {
+            return parity;
+        }
+        // A writer flipped the epoch and may not have seen us; try again
+        atomic_fetch_sub(&(r->count[parity]), 1);
+    }
+}
+
+static void read_exit(C_Concurrent_Table* t, unsigned parity) {
+    atomic_fetch_sub_explicit(&(t->readers[_reader % NREADERS].count[parity]), 1,
+                              memory_order_release);
+}
+
+/*
+ * Wait until every reader that might have seen a block unlinked before
+ * now has left its critical section.  Caller holds `gclock`.
+ */
+static void synchronize(C_Concurrent_Table* t) {
+    size_t e = atomic_fetch_add(&(t->epoch), 1);
+    unsigned parity = (unsigned)(e & 1);
+
+    for (int i = 0; i < NREADERS; i++) {
+        while (atomic_load(&(t->readers[i].count[parity])) != 0) {
+            sched_yield();
+        }
+    }
+}
+
+static void free_limbo(C_Concurrent_Table* t) {
+    for (size_t i = 0; i < t->nlimbo; i++) {
+        free(t->limbo[i]);
+    }
+    t->nlimbo = 0;
+}
+
+/*
+ * Free `ptr`, already unlinked, once no reader can see it.
+ */
+static void retire(C_Concurrent_Table* t, void* ptr) {
+    LOCK_ACQUIRE(t->gclock);
+    if (t->nlimbo == t->limbocap) {
+        size_t newcap = (t->limbocap == 0) ? LIMBO_MAX : t->limbocap * 2;
+        void** newlimbo = realloc(t->limbo, newcap * sizeof(void*));
+
+        if (newlimbo == NULL) {
+            // Free what we have the slow way, then this
+            synchronize(t);
+            free_limbo(t);
+            free(ptr);
+            LOCK_RELEASE(t->gclock);
+            return;
+        }
+        t->limbo = newlimbo;
+        t->limbocap = newcap;
+    }
+    t->limbo[t->nlimbo++] = ptr;
+
+    if (t->nlimbo >= LIMBO_MAX) {
+        synchronize(t);
+        free_limbo(t);
+    }
+    LOCK_RELEASE(t->gclock);
+}
+
+/* ------------------------------ Entries ------------------------------ */
+
+static uint64_t hashcode(const C_Userdata* key) {
+    if (C_Userdata_is_reference(key)) {
+        return C_Hash_bytes(&(key->ptr), sizeof(void*));
+    }
+    return C_Hash_bytes(key->ptr, key->len);
+}
+
+static bool keys_equal(const C_Userdata* a, const C_Userdata* b) {
+    if (a->len != b->len) return false;
+
+    if (a->len == 0) return a->ptr == b->ptr;
+
+    return memcmp(a->ptr, b->ptr, a->len) == 0;
+}
+
+/*
+ * Copy `from` into `to`, putting any data at `*dest` and advancing it.
+ */
+static void copy_into(C_Userdata* to, const C_Userdata* from, uint8_t* *dest) {
+    to->tag = from->tag;
+    to->len = from->len;
+    if (from->len == 0) {
+        to->ptr = from->ptr;
+    } else {
+        memcpy(*dest, from->ptr, from->len);
+        (*dest)[from->len] = '\0';
+        to->ptr = *dest;
+        *dest += from->len + 1;
+    }
+}
+
+static CT_Node* node_new(uint64_t h, const C_Userdata* key, const C_Userdata* value, CT_Node* next) {
+    size_t size = sizeof(CT_Node);
+    CT_Node* n;
+    uint8_t* dest;
+
+    if (key->len > 0) size += key->len + 1;
+    if (value->len > 0) size += value->len + 1;
+
+    n = malloc(size);
+    if (n == NULL) return NULL;
+
+    dest = n->data;
+    n->hash = h;
+    copy_into(&(n->key), key, &dest);
+    copy_into(&(n->value), value, &dest);
+    atomic_init(&(n->next), next);
+    return n;
+}
+
+/* ------------------------------ Index -------------------------------- */
+
+static CT_Index* index_new(size_t nbuckets) {
+    CT_Index* idx = malloc(sizeof(CT_Index) + nbuckets * sizeof(CT_Node*));
+
+    if (idx == NULL) return NULL;
+
+    idx->mask = nbuckets - 1;
+    for (size_t i = 0; i < nbuckets; i++) {
+        atomic_init(&(idx->heads[i]), NULL);
+    }
+    return idx;
+}
+
+static void index_free(CT_Index* idx) {
+    for (size_t i = 0; i <= idx->mask; i++) {
+        CT_Node* n = atomic_load_explicit(&(idx->heads[i]), memory_order_relaxed);
+
+        while (n != NULL) {
+            CT_Node* next = atomic_load_explicit(&(n->next), memory_order_relaxed);
+            free(n);
+            n = next;
+        }
+    }
+    free(idx);
+}
+
+static inline size_t stripe_of(CT_Index* idx, uint64_t h) {
+    return (size_t)(h & idx->mask) % NSTRIPES;
+}
+
+/*
+ * Lock the stripe that holds `h` in the current index, and return the
+ * index, which can't change until we unlock.  Caller must be in a
+ * read-side critical section lest the index be freed as we look at it.
+ */
+static CT_Index* lock_bucket(C_Concurrent_Table* t, uint64_t h, size_t* sp) {
+    for (;;) {
+        CT_Index* idx = atomic_load(&(t->index));
+        size_t s = stripe_of(idx, h);
+
+        LOCK_ACQUIRE(t->stripes[s].lock);
+        idx = atomic_load(&(t->index));
+        if (stripe_of(idx, h) == s) {
+            *sp = s;
+            return idx;
+        }
+        // Resized under us
+        LOCK_RELEASE(t->stripes[s].lock);
+    }
+}
+
+/*
+ * Find the link to the node for `key`, or NULL.  Caller holds the lock.
+ */
+static _Atomic(CT_Node*)* find_link(CT_Index* idx, const C_Userdata* key, uint64_t h) {
+    _Atomic(CT_Node*)* link = &(idx->heads[h & idx->mask]);
+    CT_Node* n;
+
+    while ((n = atomic_load_explicit(link, memory_order_relaxed)) != NULL) {
+        if (n->hash == h && keys_equal(&(n->key), key)) {
+            return link;
+        }
+        link = &(n->next);
+    }
+    return NULL;
+}
+
+/*
+ * Double the number of buckets if the table is too full.
+ * Readers may still be walking the old index, so its nodes stay as they
+ * are and the new index gets copies.
+ */
+static void maybe_grow(C_Concurrent_Table* t) {
+    CT_Index* old;
+    CT_Index* idx;
+    size_t nbuckets;
+    unsigned parity;
+    bool full;
+
+    parity = read_enter(t);
+    old = atomic_load(&(t->index));
+    full = atomic_load(&(t->nentries)) * LOAD_DEN > (old->mask + 1) * LOAD_NUM;
+    read_exit(t, parity);
+
+    if (!full) return;
+
+    for (int s = 0; s < NSTRIPES; s++) {
+        LOCK_ACQUIRE(t->stripes[s].lock);
+    }
+
+    old = atomic_load(&(t->index));
+    nbuckets = (old->mask + 1) * 2;
+    idx = NULL;
+    if (atomic_load(&(t->nentries)) * LOAD_DEN > (old->mask + 1) * LOAD_NUM) {
+        idx = index_new(nbuckets);
+    }
+
+    for (size_t i = 0; idx != NULL && i <= old->mask; i++) {
+        CT_Node* n = atomic_load_explicit(&(old->heads[i]), memory_order_relaxed);
+
+        while (n != NULL) {
+            _Atomic(CT_Node*)* head = &(idx->heads[n->hash & idx->mask]);
+            CT_Node* copy = node_new(n->hash, &(n->key), &(n->value),
+                                     atomic_load_explicit(head, memory_order_relaxed));
+            if (copy == NULL) {
+                // Stay at the old size
+                index_free(idx);
+                idx = NULL;
+                break;
+            }
+            atomic_store_explicit(head, copy, memory_order_relaxed);
+            n = atomic_load_explicit(&(n->next), memory_order_relaxed);
+        }
+    }
+
+    if (idx != NULL) {
+        atomic_store_explicit(&(t->index), idx, memory_order_release);
+    }
+
+    for (int s = NSTRIPES - 1; s >= 0; s--) {
+        LOCK_RELEASE(t->stripes[s].lock);
+    }
+
+    if (idx != NULL) {
+        LOCK_ACQUIRE(t->gclock);
+        synchronize(t);
+        LOCK_RELEASE(t->gclock);
+        index_free(old);
+    }
+}
+
+/* ---------------------------- Public API ----------------------------- */
+
+FMC_API void C_Concurrent_Table_new(C_Concurrent_Table* *tptr, size_t minsz) {
+    C_Concurrent_Table* t;
+    size_t nbuckets = MIN_BUCKETS;
+
+    if (!tptr) return;
+    (*tptr) = NULL;
+
+    while (nbuckets * LOAD_NUM < minsz * LOAD_DEN) {
+        nbuckets *= 2;
+    }
+
+    t = aligned_alloc(CACHE_LINE, sizeof(C_Concurrent_Table));
+    if (!t) return;
+
+    memset(t, 0, sizeof(C_Concurrent_Table));
+    atomic_init(&(t->index), index_new(nbuckets));
+    if (atomic_load(&(t->index)) == NULL) {
+        free(t);
+        return;
+    }
+    atomic_init(&(t->nentries), 0);
+    atomic_init(&(t->epoch), 0);
+    LOCK_INIT(t->gclock);
+    for (int s = 0; s < NSTRIPES; s++) {
+        LOCK_INIT(t->stripes[s].lock);
+    }
+    for (int i = 0; i < NREADERS; i++) {
+        atomic_init(&(t->readers[i].count[0]), 0);
+        atomic_init(&(t->readers[i].count[1]), 0);
+    }
+
+    (*tptr) = t;
+}
+
+FMC_API size_t C_Concurrent_Table_size(C_Concurrent_Table* t) {
+    return atomic_load_explicit(&(t->nentries), memory_order_relaxed);
+}
+
+FMC_API bool C_Concurrent_Table_get(C_Concurrent_Table* t, const C_Userdata* key, C_Userdata* value) {
+    uint64_t h;
+    unsigned parity;
+    CT_Index* idx;
+    CT_Node* n;
+    bool result = false;
+
+    if (!t || !key || !value) return false;
+
+    h = hashcode(key);
+    parity = read_enter(t);
+
+    idx = atomic_load_explicit(&(t->index), memory_order_acquire);
+    n = atomic_load_explicit(&(idx->heads[h & idx->mask]), memory_order_acquire);
+    while (n != NULL && !(n->hash == h && keys_equal(&(n->key), key))) {
+        n = atomic_load_explicit(&(n->next), memory_order_acquire);
+    }
+
+    if (n == NULL) {
+        // not found
+    } else if (n->value.len == 0) {
+        (*value) = n->value;
+        result = true;
+    } else {
+        void* ptr = malloc(n->value.len + 1);
+
+        if (ptr != NULL) {
+            memcpy(ptr, n->value.ptr, n->value.len + 1);
+            C_Userdata_set(value, n->value.tag, n->value.len, ptr);
+            result = true;
+        }
+    }
+
+    read_exit(t, parity);
+    return result;
+}
+
+FMC_API bool C_Concurrent_Table_has(C_Concurrent_Table* t, const C_Userdata* key) {
+    uint64_t h;
+    unsigned parity;
+    CT_Index* idx;
+    CT_Node* n;
+
+    if (!t || !key) return false;
+
+    h = hashcode(key);
+    parity = read_enter(t);
+
+    idx = atomic_load_explicit(&(t->index), memory_order_acquire);
+    n = atomic_load_explicit(&(idx->heads[h & idx->mask]), memory_order_acquire);
+    while (n != NULL && !(n->hash == h && keys_equal(&(n->key), key))) {
+        n = atomic_load_explicit(&(n->next), memory_order_acquire);
+    }
+
+    read_exit(t, parity);
+    return n != NULL;
+}
+
+/*
+ * Add or replace the entry for `key`, per `replace`.
+ */
+static bool store(C_Concurrent_Table* t, const C_Userdata* key, const C_Userdata* value, bool replace) {
+    uint64_t h;
+    size_t s;
+    CT_Index* idx;
+    _Atomic(CT_Node*)* link;
+    CT_Node* old = NULL;
+    CT_Node* n;
+    unsigned parity;
+
+    if (!t || !key || !value) return false;
+
+    h = hashcode(key);
+    parity = read_enter(t);
+    idx = lock_bucket(t, h, &s);
+
+    link = find_link(idx, key, h);
+    if (link != NULL && !replace) {
+        LOCK_RELEASE(t->stripes[s].lock);
+        read_exit(t, parity);
+        return false;
+    }
+
+    if (link != NULL) {
+        old = atomic_load_explicit(link, memory_order_relaxed);
+        n = node_new(h, key, value, atomic_load_explicit(&(old->next), memory_order_relaxed));
+    } else {
+        link = &(idx->heads[h & idx->mask]);
+        n = node_new(h, key, value, atomic_load_explicit(link, memory_order_relaxed));
+    }
+    if (n == NULL) {
+        LOCK_RELEASE(t->stripes[s].lock);
+        read_exit(t, parity);
+        return false;
+    }
+
+    // Publish the finished node
+    atomic_store_explicit(link, n, memory_order_release);
+    if (old == NULL) {
+        atomic_fetch_add(&(t->nentries), 1);
+    }
+    LOCK_RELEASE(t->stripes[s].lock);
+    read_exit(t, parity);
+
+    // Both may wait for readers, so we mustn't be one
+
+    if (old != NULL) {
+        retire(t, old);
+    } else {
+        maybe_grow(t);
+    }
+    return true;
+}
+
+FMC_API bool C_Concurrent_Table_add(C_Concurrent_Table* t, const C_Userdata* key, const C_Userdata* value) {
+    return store(t, key, value, false);
+}
+
+FMC_API bool C_Concurrent_Table_put(C_Concurrent_Table* t, const C_Userdata* key, const C_Userdata* value) {
+    return store(t, key, value, true);
+}
+
+FMC_API bool C_Concurrent_Table_remove(C_Concurrent_Table* t, const C_Userdata* key) {
+    uint64_t h;
+    size_t s;
+    CT_Index* idx;
+    _Atomic(CT_Node*)* link;
+    CT_Node* old;
+    unsigned parity;
+
+    if (!t || !key) return false;
+
+    h = hashcode(key);
+    parity = read_enter(t);
+    idx = lock_bucket(t, h, &s);
+
+    link = find_link(idx, key, h);
+    if (link == NULL) {
+        LOCK_RELEASE(t->stripes[s].lock);
+        read_exit(t, parity);
+        return false;
+    }
+
+    // Readers already at `old` still find the rest of the chain
+    old = atomic_load_explicit(link, memory_order_relaxed);
+    atomic_store_explicit(link, atomic_load_explicit(&(old->next), memory_order_relaxed),
+                          memory_order_release);
+    atomic_fetch_sub(&(t->nentries), 1);
+    LOCK_RELEASE(t->stripes[s].lock);
+    read_exit(t, parity);
+
+    retire(t, old);
+    return true;
+}
+
+FMC_API void C_Concurrent_Table_free(C_Concurrent_Table* *tptr) {
+    C_Concurrent_Table* t;
+
+    if (!tptr || !(*tptr)) return;
+    t = *tptr;
+
+    index_free(atomic_load(&(t->index)));
+    free_limbo(t);
+    free(t->limbo);
+
+    LOCK_FREE(t->gclock);
+    for (int s = 0; s < NSTRIPES; s++) {
+        LOCK_FREE(t->stripes[s].lock);
+    }
+    free(t);
+    *tptr = NULL;
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FMC_CONCTABLE_H_INCLUDED
+#define FMC_CONCTABLE_H_INCLUDED
+
+#include "common.h"
+#include "table.h"
+
+/** @file */
+
+/**
+ * An opaque type for a hash table many threads may use at once.
+ * Keys and values are `C_Userdata` compared, hashed, and copied as by a
+ * `C_Table` with default functions: data by value, references by
+ * pointer.
+ *
+ * Writers lock only a stripe of the table's buckets, so writers to
+ * different stripes proceed in parallel.  Readers take no locks at all;
+ * entries are never changed in place, only replaced, and a replaced
+ * entry is freed only once no reader can still be looking at it.
+ */
+typedef struct C_Concurrent_Table C_Concurrent_Table;
+
+/**
+ * Creates a new table with room for at least `minsz` entries.
+ */
+FMC_API void C_Concurrent_Table_new(C_Concurrent_Table* *tptr, size_t minsz);
+
+/**
+ * The number of entries in `t`, which may already be out of date.
+ */
+FMC_API size_t C_Concurrent_Table_size(C_Concurrent_Table* t);
+
+/**
+ * Adds a deep copy of `value` into a new entry for `key` if none exists.
+ * Returns false and does nothing if an entry for `key` already exists.
+ */
+FMC_API bool C_Concurrent_Table_add(C_Concurrent_Table* t, const C_Userdata* key, const C_Userdata* value);
+
+/**
+ * Get a deep copy of the value for `key` into `value`, since another
+ * thread may replace the table's own copy at any time.
+ * Free it with `C_Userdata_clear(value, true)`.
+ * Returns false if the key was not found.
+ */
+FMC_API bool C_Concurrent_Table_get(C_Concurrent_Table* t, const C_Userdata* key, C_Userdata* value);
+
+/**
+ * Whether `t` contains an entry for `key`.
+ */
+FMC_API bool C_Concurrent_Table_has(C_Concurrent_Table* t, const C_Userdata* key);
+
+/**
+ * Puts a deep copy of `value` into an entry for `key`.
+ * Returns false only if the operation could not be completed for some reason.
+ */
+FMC_API bool C_Concurrent_Table_put(C_Concurrent_Table* t, const C_Userdata* key, const C_Userdata* value);
+
+/**
+ * Remove the entry for `key`.
+ * Returns false if there was no such entry.
+ */
+FMC_API bool C_Concurrent_Table_remove(C_Concurrent_Table* t, const C_Userdata* key);
+
+/**
+ * Deletes the table and all memory it allocated.
+ * No other thread may be using the table.
+ */
+FMC_API void C_Concurrent_Table_free(C_Concurrent_Table* *tptr);
+
+#endif // FMC_CONCTABLE_H_INCLUDED
@@ -52,5 +52,8 @@
 #define RWLOCK_RELEASE(x)   pthread_rwlock_unlock(&(x))
 #define RWLOCK_FREE(x)      pthread_rwlock_destroy(&(x))
 
+#define ONCE_DECL(x)        pthread_once_t (x) = PTHREAD_ONCE_INIT
+#define ONCE_CALL(x, f)     pthread_once(&(x), (f))
+
 #endif // FMC_THREAD_H_INCLUDED
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "cthread.h"
+#include "hash.h"
+
+/*
+ * After Wang Yi's public domain wyhash (https://github.com/wangyi-fudan/wyhash):
+ * read the key eight bytes at a time into three independent lanes, and
+ * fold each pair of words with a 64x64->128 bit multiply.  Keys of 16
+ * bytes or fewer take two overlapping reads and no loop at all.
+ */
+
+static const uint64_t SECRET[4] = {
+    0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+    0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL
+};
+
+static ONCE_DECL(_seed_once);
+
+static uint64_t _seed = 0;
+
+static uint64_t _scrambled_seed = 0;
+
+/*
+ * Replace `*a` and `*b` with the low and high halves of their product.
+ */
+static inline void mul128(uint64_t *a, uint64_t *b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)(*a) * (*b);
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t)(*a), lb = (uint32_t)(*b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+    mul128(&a, &b);
+    return a ^ b;
+}
+
+static inline uint64_t read8(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read4(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t read3(const uint8_t* p, size_t len) {
+    return (((uint64_t)p[0]) << 16) | (((uint64_t)p[len >> 1]) << 8) | p[len - 1];
+}
+
+static inline uint64_t scramble(uint64_t seed) {
+    return seed ^ mum(seed ^ SECRET[0], SECRET[1]);
+}
+
+/*
+ * The hash proper, given an already scrambled seed.
+ */
+static inline uint64_t hash(const uint8_t* p, size_t len, uint64_t seed) {
+    uint64_t a, b;
+
+    if (len <= 16) {
+        if (len >= 4) {
+            size_t off = (len >> 3) << 2;
+            a = (read4(p) << 32) | read4(p + off);
+            b = (read4(p + len - 4) << 32) | read4(p + len - 4 - off);
+        } else if (len > 0) {
+            a = read3(p, len);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = mum(read8(p)      ^ SECRET[1], read8(p + 8)  ^ seed);
+                see1 = mum(read8(p + 16) ^ SECRET[2], read8(p + 24) ^ see1);
+                see2 = mum(read8(p + 32) ^ SECRET[3], read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = mum(read8(p) ^ SECRET[1], read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+
+    a ^= SECRET[1];
+    b ^= seed;
+    mul128(&a, &b);
+    return mum(a ^ SECRET[0] ^ len, b ^ SECRET[1]);
+}
+
+FMC_API uint64_t C_Hash_bytes_seeded(const void* ptr, size_t len, uint64_t seed) {
+    return hash((const uint8_t*)ptr, len, scramble(seed));
+}
+
+static void init_seed() {
+    // Nothing here is secret, but together they differ for every process.
+    uint64_t entropy[4];
+
+    entropy[0] = (uint64_t)time(NULL);
+    entropy[1] = (uint64_t)clock();
+    entropy[2] = (uint64_t)(uintptr_t)&entropy;
+    entropy[3] = (uint64_t)getpid();
+
+    _seed = C_Hash_bytes_seeded(entropy, sizeof(entropy), (uint64_t)(uintptr_t)&init_seed);
+    _scrambled_seed = scramble(_seed);
+}
+
+FMC_API uint64_t C_Hash_seed() {
+    ONCE_CALL(_seed_once, init_seed);
+    return _seed;
+}
+
+FMC_API uint64_t C_Hash_bytes(const void* ptr, size_t len) {
+    ONCE_CALL(_seed_once, init_seed);
+    return hash((const uint8_t*)ptr, len, _scrambled_seed);
+}
+
+/* ------------------------ Statistics Functions -------------------------*/
+
+FMC_API void C_Hash_Stats_clear(C_Hash_Stats* stats) {
+    if (stats == NULL) return;
+    memset(stats, 0, sizeof(C_Hash_Stats));
+}
+
+FMC_API void C_Hash_Stats_add_probe(C_Hash_Stats* stats, size_t probe) {
+    if (stats == NULL) return;
+
+    stats->entries++;
+    stats->total_probe += probe;
+    if (probe > stats->max_probe) {
+        stats->max_probe = probe;
+    }
+    stats->histogram[(probe < C_HASH_STATS_BINS) ? probe : C_HASH_STATS_BINS - 1]++;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FMC_HASH_H_INCLUDED
+#define FMC_HASH_H_INCLUDED
+
+#include "common.h"
+
+/** @file
+ * Hash functions shared by the tables in this library.
+ */
+
+/**
+ * A fast 64-bit hash of the `len` bytes at `ptr`.
+ * The result depends on a seed chosen randomly once per process,
+ * so it differs from run to run; an attacker who can choose keys
+ * can't easily force collisions.  Never store or transmit the result.
+ * The signature matches `C_Table_Hash`, and `C_Table` uses it by default.
+ */
+FMC_API uint64_t C_Hash_bytes(const void* ptr, size_t len);
+
+/**
+ * Like `C_Hash_bytes()`, but with an explicit `seed` instead of the
+ * per-process one, for hashes that must be reproducible or for
+ * trying a different hash of the same keys.
+ */
+FMC_API uint64_t C_Hash_bytes_seeded(const void* ptr, size_t len, uint64_t seed);
+
+/**
+ * The per-process seed `C_Hash_bytes()` uses.
+ */
+FMC_API uint64_t C_Hash_seed();
+
+/**
+ * How many probe lengths `C_Hash_Stats.histogram` counts separately.
+ * Longer probes all land in the last bin.
+ */
+#define C_HASH_STATS_BINS   16
+
+/**
+ * How evenly a hash container has spread its keys, as filled in by
+ * `C_Table_stats()`, `C_Ref_Set_stats()`, `C_Ref_Table_stats()`, and
+ * `C_String_Table_stats()`.
+ *
+ * A key's *probe length* is how many places a lookup passes before
+ * reaching it: its depth in a bucket's chain, or its distance from its
+ * home slot (or home group of slots) in an open table.  With a good hash
+ * nearly every key has a probe length of 0 or 1; a long tail in
+ * `histogram` or a high `max_probe` means the hash is degenerating.
+ */
+typedef struct C_Hash_Stats {
+    /** keys in the container */
+    size_t entries;
+
+    /** buckets or slots in the container's index */
+    size_t buckets;
+
+    /** buckets or slots holding at least one key */
+    size_t occupied;
+
+    /** sum of every key's probe length; divide by `entries` for the mean */
+    size_t total_probe;
+
+    /** longest probe length of any key */
+    size_t max_probe;
+
+    /** `histogram[i]` keys have probe length `i` (or more, for the last) */
+    size_t histogram[C_HASH_STATS_BINS];
+
+    /** times the container has rebuilt its index, to grow or otherwise */
+    size_t resizes;
+
+    /** bytes the container holds from the allocator, near enough */
+    size_t bytes;
+} C_Hash_Stats;
+
+/**
+ * Zero every field of `*stats`.
+ */
+FMC_API void C_Hash_Stats_clear(C_Hash_Stats* stats);
+
+/**
+ * Count one key with probe length `probe` in `*stats`.
+ */
+FMC_API void C_Hash_Stats_add_probe(C_Hash_Stats* stats, size_t probe);
+
+#endif // FMC_HASH_H_INCLUDED
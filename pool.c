@@ -0,0 +1,163 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+#define POOL_ALIGN      16
+#define SLAB_MINOBJS    16
+#define SLAB_MAXSIZ     (8 * 1024 * 1024)
+
+typedef struct _C_Pool_Slab C_Pool_Slab;
+
+/*
+ * Slabs form a linked list so the pool can free them all at the end.
+ * Blocks start SLAB_HEADSIZ bytes in, past the header, to stay aligned.
+ */
+struct _C_Pool_Slab {
+    C_Pool_Slab* next;
+    size_t       size;
+};
+
+#define SLAB_HEADSIZ \
+    ((sizeof(C_Pool_Slab) + POOL_ALIGN - 1) & ~((size_t)POOL_ALIGN - 1))
+
+/*
+ * A released block holds the link to the next released block.
+ */
+typedef struct _C_Pool_Block {
+    struct _C_Pool_Block* next;
+} C_Pool_Block;
+
+struct C_Pool {
+    size_t        objsize;
+    size_t        nbytes;
+    size_t        nslabs;
+    C_Pool_Slab*  slabs;
+    C_Pool_Block* freelist;
+
+    /* unused tail of the newest slab */
+    uint8_t*      cursor;
+    uint8_t*      limit;
+};
+
+FMC_API void C_Pool_new(C_Pool* *pptr, size_t objsize) {
+    C_Pool* p;
+
+    if (!pptr) return;
+    (*pptr) = NULL;
+
+    p = malloc(sizeof(C_Pool));
+    if (!p) return;
+
+    memset(p, 0, sizeof(C_Pool));
+    if (objsize < sizeof(C_Pool_Block)) {
+        objsize = sizeof(C_Pool_Block);
+    }
+    p->objsize = (objsize + POOL_ALIGN - 1) & ~((size_t)POOL_ALIGN - 1);
+
+    (*pptr) = p;
+}
+
+FMC_API size_t C_Pool_object_size(C_Pool* p) {
+    return p->objsize;
+}
+
+FMC_API size_t C_Pool_bytes(C_Pool* p) {
+    return p->nbytes;
+}
+
+FMC_API size_t C_Pool_slabs(C_Pool* p) {
+    return p->nslabs;
+}
+
+static bool add_slab(C_Pool* p) {
+    // Each slab doubles the pool, up to a few MiB, so that small pools
+    // stay small and large pools need few slabs: a gigabyte of blocks
+    // takes about 140.
+    size_t size = p->nbytes;
+    C_Pool_Slab* slab;
+
+    if (size < SLAB_MINOBJS * p->objsize) {
+        size = SLAB_MINOBJS * p->objsize;
+    }
+    if (size > SLAB_MAXSIZ && SLAB_MAXSIZ >= SLAB_MINOBJS * p->objsize) {
+        size = SLAB_MAXSIZ;
+    }
+
+    slab = malloc(SLAB_HEADSIZ + size);
+    if (!slab) return false;
+
+    slab->next = p->slabs;
+    slab->size = size;
+    p->slabs   = slab;
+    p->nbytes += size;
+    p->nslabs++;
+    p->cursor  = (uint8_t*)slab + SLAB_HEADSIZ;
+    p->limit   = p->cursor + size;
+    return true;
+}
+
+FMC_API void* C_Pool_alloc(C_Pool* p) {
+    void* result;
+
+    if (p->freelist != NULL) {
+        result = p->freelist;
+        p->freelist = p->freelist->next;
+        return result;
+    }
+
+    if (p->cursor + p->objsize > p->limit) {
+        if (!add_slab(p)) return NULL;
+    }
+
+    result = p->cursor;
+    p->cursor += p->objsize;
+    return result;
+}
+
+FMC_API void C_Pool_recycle(C_Pool* p, void* obj) {
+    C_Pool_Block* block = (C_Pool_Block*)obj;
+
+    if (!obj) return;
+
+    block->next = p->freelist;
+    p->freelist = block;
+}
+
+FMC_API void C_Pool_free(C_Pool* *pptr) {
+    C_Pool* p;
+    C_Pool_Slab* slab;
+
+    if (!pptr || !(*pptr)) return;
+    p = *pptr;
+
+    slab = p->slabs;
+    while (slab != NULL) {
+        C_Pool_Slab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    free(p);
+    *pptr = NULL;
+}
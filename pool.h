@@ -0,0 +1,76 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FMC_POOL_H_INCLUDED
+#define FMC_POOL_H_INCLUDED
+
+#include "common.h"
+
+/** @file */
+
+/**
+ * An opaque type for a pool of fixed-size memory blocks.
+ * The pool carves blocks out of large slabs and keeps released blocks
+ * on a free list for reuse, so a steady state of allocations and
+ * releases never calls `malloc()` or `free()`.  Freeing the pool
+ * releases every block at once.  A pool is not thread-safe.
+ */
+typedef struct C_Pool C_Pool;
+
+/**
+ * Creates a new pool of blocks at least `objsize` bytes long.
+ * Blocks are aligned as strictly as `malloc()` aligns its blocks.
+ */
+FMC_API void C_Pool_new(C_Pool* *pptr, size_t objsize);
+
+/**
+ * The actual size of each block in `p`.
+ */
+FMC_API size_t C_Pool_object_size(C_Pool* p);
+
+/**
+ * The total size of all slabs `p` has allocated.
+ */
+FMC_API size_t C_Pool_bytes(C_Pool* p);
+
+/**
+ * The number of slabs `p` has allocated.
+ */
+FMC_API size_t C_Pool_slabs(C_Pool* p);
+
+/**
+ * Returns an unused block, or NULL if memory is exhausted.
+ * The block's contents are undefined.
+ */
+FMC_API void* C_Pool_alloc(C_Pool* p);
+
+/**
+ * Returns `obj`, allocated by `C_Pool_alloc(p)`, to `p` for reuse.
+ */
+FMC_API void C_Pool_recycle(C_Pool* p, void* obj);
+
+/**
+ * Deletes the pool and every block in it.
+ */
+FMC_API void C_Pool_free(C_Pool* *pptr);
+
+#endif // FMC_POOL_H_INCLUDED
@@ -53,9 +53,14 @@ static C_Ref_Table* reftable() {
     return _reftable;
 }
 
+/*
+ * Most objects asked about are in neither set, so both keep a filter
+ * to turn them away quickly.
+ */
 static C_Ref_Set* reflist() {
     if (!_reflist) {
         C_Ref_Set_new(&_reflist, 11);
+        C_Ref_Set_set_filter(_reflist, true);
     }
     return _reflist;
 }
@@ -63,6 +68,7 @@ static C_Ref_Set* reflist() {
 static C_Ref_Set* zeroset() {
     if (!_zeroset) {
         C_Ref_Set_new(&_zeroset, 11);
+        C_Ref_Set_set_filter(_zeroset, true);
     }
     return _zeroset;
 }
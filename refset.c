@@ -19,25 +19,192 @@
  * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
  * DEALINGS IN THE SOFTWARE.
  */
-
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include "refset.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define TABLE_MINSIZ    5
 #define TABLE_LOAD      0.75
 
+/*
+ * Shrink once removals leave fewer entries than this share of the slots.
+ * Shrinking leaves the set under half full, so it must fill up again
+ * well past this mark before it grows, or empty well past it before it
+ * shrinks again.
+ */
+#define TABLE_SHRINK    (TABLE_LOAD / 8)
+#define TABLE_SHRINKMAX (TABLE_LOAD / 4)
+
+/*
+ * Slots come in groups of eight, one cache line of pointers, and a probe
+ * looks at a whole group at once, moving to the next group only if this
+ * one is full.  A removed pointer becomes DELETED unless its group
+ * already has an empty slot, and so already ends every probe.
+ */
+#define GROUP_WIDTH     8
+#define GROUP_BYTES     (GROUP_WIDTH * sizeof(void*))
+
+static const char deleted_mark = 0;
+
+#define DELETED         ((const void*)&deleted_mark)
+
 struct C_Ref_Set {
     const void*  *array;
     size_t       arraylen;
+    size_t       ngroups;
     size_t       nentries;
+
+    /* slots not empty: entries and DELETED markers */
+    size_t       nused;
+    size_t       resizes;
+
+    /* never shrink below the size asked for at creation */
+    size_t       minngroups;
+    double       shrink_load;
+
+    /* optional Bloom filter, one word per group, or NULL */
+    uint64_t*    filter;
+
+    /* removals since the filter was last rebuilt */
+    size_t       nstale;
 };
 
+/* ---------------------- Group Functions --------------------------------*/
+
+/*
+ * Returns a bitmask with bit `i` set if slot `i` of `group` holds `p`.
+ * AVX2 compares four pointers at once.  SSE2 has no 64-bit compare, so
+ * it compares the low halves of four pointers at once and checks any
+ * match in full.
+ */
+
+#if defined(__AVX2__) && UINTPTR_MAX == UINT64_MAX
+
+static inline uint32_t group_match(const void* const* group, const void* p) {
+    __m256i target = _mm256_set1_epi64x((long long)(uintptr_t)p);
+    __m256i lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)group), target);
+    __m256i hi = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(group + 4)), target);
+
+    return (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(lo))
+        | ((uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+}
+
+#elif defined(__SSE2__) && UINTPTR_MAX == UINT64_MAX
+
+static inline uint32_t low_match(const void* const* quad, __m128i target) {
+    __m128 a = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)quad));
+    __m128 b = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)(quad + 2)));
+    __m128i lows = _mm_castps_si128(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+
+    return (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lows, target)));
+}
+
+static inline uint32_t group_match(const void* const* group, const void* p) {
+    __m128i target = _mm_set1_epi32((int)(uint32_t)(uintptr_t)p);
+    uint32_t bits = low_match(group, target) | (low_match(group + 4, target) << 4);
+    uint32_t result = bits;
+
+    // Rule out the rare slot whose low half alone matches
+    while (bits != 0) {
+        int i = __builtin_ctz(bits);
+        if (group[i] != p) result &= ~(1u << i);
+        bits &= bits - 1;
+    }
+    return result;
+}
+
+static inline bool group_has_empty(const void* const* group) {
+    // Every empty slot's low half matches, so it's quicker to just look
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        if (group[i] == NULL) return true;
+    }
+    return false;
+}
+
+#define HAVE_GROUP_HAS_EMPTY
+
+#else
+
+static inline uint32_t group_match(const void* const* group, const void* p) {
+    uint32_t result = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        if (group[i] == p) result |= (1u << i);
+    }
+    return result;
+}
+
+#endif
+
+#if !defined(HAVE_GROUP_HAS_EMPTY)
+static inline bool group_has_empty(const void* const* group) {
+    return group_match(group, NULL) != 0;
+}
+#endif
+
+static inline uint32_t group_match_free(const void* const* group) {
+    uint32_t result = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        if (group[i] == NULL || group[i] == DELETED) result |= (1u << i);
+    }
+    return result;
+}
+
+static inline int lowest_bit(uint32_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctz(bits);
+#else
+    int i = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+static inline bool live(const void* p) {
+    return p != NULL && p != DELETED;
+}
+
+/* ---------------------- Table Functions --------------------------------*/
+
+static bool array_init(C_Ref_Set* rs, size_t ngroups) {
+    const void** array = aligned_alloc(GROUP_BYTES, ngroups * GROUP_BYTES);
+
+    if (array == NULL) return false;
+
+    memset(array, 0, ngroups * GROUP_BYTES);
+    rs->array    = array;
+    rs->ngroups  = ngroups;
+    rs->arraylen = ngroups * GROUP_WIDTH;
+    rs->nused    = 0;
+    return true;
+}
+
+/*
+ * The fewest groups, a power of two and at least 2, with room for `n` entries.
+ */
+static size_t groups_for(size_t n) {
+    size_t ngroups = 2;
+
+    while (ngroups * GROUP_WIDTH * TABLE_LOAD < n) {
+        ngroups *= 2;
+    }
+    return ngroups;
+}
 
 FMC_API void C_Ref_Set_new(C_Ref_Set* *rsptr, size_t minsz) {
     C_Ref_Set* rs;
+    size_t ngroups;
+
     if (!rsptr) return;
     (*rsptr) = NULL;
 
@@ -45,9 +212,13 @@ FMC_API void C_Ref_Set_new(C_Ref_Set* *rsptr, size_t minsz) {
     if (!rs) return;
 
     memset(rs, 0, sizeof(C_Ref_Set));
-    rs->arraylen = (minsz > TABLE_MINSIZ) ? minsz : TABLE_MINSIZ;
-    rs->array    = calloc(rs->arraylen, sizeof(void*));
-    rs->nentries = 0;
+    ngroups = groups_for((minsz > TABLE_MINSIZ) ? minsz : TABLE_MINSIZ);
+    if (!array_init(rs, ngroups)) {
+        free(rs);
+        return;
+    }
+    rs->minngroups  = ngroups;
+    rs->shrink_load = TABLE_SHRINK;
 
     (*rsptr) = rs;
 }
@@ -55,12 +226,13 @@ FMC_API void C_Ref_Set_new(C_Ref_Set* *rsptr, size_t minsz) {
 FMC_API void C_Ref_Set_free(C_Ref_Set* *rsptr) {
     C_Ref_Set* rs;
 
-    if (!rsptr) return;
+    if (!rsptr || !(*rsptr)) return;
     rs = *rsptr;
 
     free(rs->array);
+    free(rs->filter);
     free(rs);
-    rsptr = NULL;
+    (*rsptr) = NULL;
 }
 
 FMC_API size_t C_Ref_Set_size(C_Ref_Set* rs) {
@@ -69,120 +241,276 @@ FMC_API size_t C_Ref_Set_size(C_Ref_Set* rs) {
 
 /* ---------------------- Table Entry Functions --------------------------*/
 
-static uint64_t hashcode(const void* p) {
-    // The lowest two bits are 0 on >= 4 byte architectures.
-    return ((uintptr_t)p) >> 2;
+/*
+ * Fibonacci hashing: multiply by 2^64 / phi and keep the top log2(len)
+ * bits, which depend on every bit of the pointer, not just the low ones
+ * that malloc() alignment keeps constant.  `len` is a power of two, 2 or more.
+ */
+static inline size_t home_slot(const void* p, size_t len) {
+#if defined(__GNUC__)
+    int bits = __builtin_ctzll(len);
+#else
+    int bits = 0;
+    while ((len >> bits) > 1) bits++;
+#endif
+    return (size_t)(((uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
 }
 
-static int search(const void* *array, size_t len, const void* target, int start) {
-    // Another pointer in its place; check the next most likely places
-    // TODO: Implement better open address algorithm
-    int index = (start + 1) % len;
-    while (index != start && array[index] != target) {
-        index = (index + 1) % len;
-    }
-    if (index == start) {
-        // Searched the whole array back to where we started, 
-        // found nothing.
-        return -1;
-    } else {
-        // Found it!
-        return index;
-    }
-}
+/* ---------------------- Filter Functions -------------------------------*/
 
-static int find_entry(C_Ref_Set* rs, const void* p) {
-    const void** array = rs->array;
-    size_t len = rs->arraylen;
-    int result = hashcode(p) % len;
+/*
+ * The filter is a Bloom filter blocked by group: each group has one
+ * 64-bit word, in which each pointer homed there sets four bits chosen by
+ * a second multiplicative hash.  A lookup whose bits aren't all set in
+ * its home group's word can't be in the set, and that costs one load
+ * from an array an eighth the size of the slots.  Removals can't clear
+ * bits, so the filter is rebuilt whenever the set rehashes, or once
+ * removals since the last rebuild outnumber the entries.
+ */
+static inline uint64_t filter_bits(const void* p) {
+    uint64_t h = (uint64_t)(uintptr_t)p * 0xC2B2AE3D27D4EB4FULL;
 
-    if (array[result] == p) {
-        return result;
-    } else if (array[result] == NULL) {
-        return -1;
-    } else {
-        return search(array, len, p, result);
-    }
+    return (1ULL << (h >> 58))
+        | (1ULL << ((h >> 52) & 63))
+        | (1ULL << ((h >> 46) & 63))
+        | (1ULL << ((h >> 40) & 63));
 }
 
-static const void** rehash(const void* *oldarray, size_t oldlen, size_t newlen) {
-    const void** newarray = calloc(newlen, sizeof(void*));
+static inline bool filter_may_have(const uint64_t* filter, size_t g, const void* p) {
+    uint64_t bits = filter_bits(p);
+    return (filter[g] & bits) == bits;
+}
 
-    for (size_t i = 0; i < oldlen; i++) {
-        const void* p = oldarray[i];
-        int index = hashcode(p) % newlen;
+/*
+ * Set the filter's bits for every entry, from scratch.
+ */
+static void filter_fill(C_Ref_Set* rs) {
+    memset(rs->filter, 0, rs->ngroups * sizeof(uint64_t));
+    for (size_t i = 0; i < rs->arraylen; i++) {
+        const void* p = rs->array[i];
 
-        if (newarray[index] != NULL) {
-            index = search(newarray, newlen, NULL, index);
+        if (live(p)) {
+            rs->filter[home_slot(p, rs->ngroups)] |= filter_bits(p);
         }
-        newarray[index] = p;
     }
-    return newarray;
+    rs->nstale = 0;
 }
 
-static bool insert_entry(C_Ref_Set* rs, const void* p) {
-    int index;
+/*
+ * The slot holding `p`, or -1.  A probe ends at the first group with
+ * an empty slot, and DELETED markers never outnumber empty slots by
+ * much, so a miss costs about as much as a hit.
+ */
+static ssize_t find_entry(C_Ref_Set* rs, const void* p) {
+    size_t g = home_slot(p, rs->ngroups);
 
-    // Make the array bigger if warranted
-    if (rs->nentries >= TABLE_LOAD * rs->arraylen) {
-        size_t oldlen = rs->arraylen;
-        size_t newlen = oldlen * 2 + 1;
-        const void** newarray = rehash(rs->array, oldlen, newlen);
+    if (rs->filter != NULL && !filter_may_have(rs->filter, g, p)) {
+        return -1;
+    }
+    for (size_t n = 0; n < rs->ngroups; n++) {
+        const void** group = rs->array + g * GROUP_WIDTH;
+        uint32_t bits = group_match(group, p);
 
-        if (newarray != NULL) {
-            rs->array = newarray;
-            rs->arraylen = newlen;
+        if (bits != 0) {
+            return g * GROUP_WIDTH + lowest_bit(bits);
         }
+        if (group_has_empty(group)) {
+            break;
+        }
+        g = (g + 1) & (rs->ngroups - 1);
     }
+    return -1;
+}
 
-    index = hashcode(p) % rs->arraylen;
+/*
+ * Put `p`, which isn't in `rs`, in the first free slot along its probe.
+ */
+static void insert_entry(C_Ref_Set* rs, const void* p) {
+    size_t g = home_slot(p, rs->ngroups);
 
-    if (rs->array[index] != NULL) {
-        index = search(rs->array, rs->arraylen, NULL, index); 
-        if (index < 0) {
+    if (rs->filter != NULL) {
+        rs->filter[g] |= filter_bits(p);
+    }
+    for (;;) {
+        const void** group = rs->array + g * GROUP_WIDTH;
+        uint32_t bits = group_match_free(group);
+
+        if (bits != 0) {
+            int i = lowest_bit(bits);
+
+            if (group[i] == NULL) {
+                rs->nused++;
+            }
+            group[i] = p;
+            rs->nentries++;
+            return;
+        }
+        g = (g + 1) & (rs->ngroups - 1);
+    }
+}
+
+/*
+ * Move every entry to a fresh array of `ngroups` groups, dropping
+ * DELETED markers, and rebuild the filter if there is one.
+ */
+static bool rehash(C_Ref_Set* rs, size_t ngroups) {
+    const void** oldarray = rs->array;
+    uint64_t*    oldfilter = rs->filter;
+    uint64_t*    filter = NULL;
+    size_t oldlen = rs->arraylen;
+
+    if (oldfilter != NULL) {
+        filter = calloc(ngroups, sizeof(uint64_t));
+        if (filter == NULL) {
             return false;
         }
     }
+    if (!array_init(rs, ngroups)) {
+        free(filter);
+        return false;
+    }
+    rs->filter = filter;
+    rs->nstale = 0;
+    rs->nentries = 0;
+    for (size_t i = 0; i < oldlen; i++) {
+        if (live(oldarray[i])) {
+            insert_entry(rs, oldarray[i]);
+        }
+    }
+    free(oldarray);
+    free(oldfilter);
+    rs->resizes++;
+    return true;
+}
+
+FMC_API bool C_Ref_Set_add(C_Ref_Set* rs, const void* p) {
+    if (!live(p)) return false;
 
-    if (rs->array[index] == NULL) {
-        rs->nentries++;
+    if (find_entry(rs, p) >= 0) {
+        return false;
     }
-    rs->array[index] = p;
 
+    // Grow, or just sweep out DELETED markers if that leaves room
+    if (rs->nused + 1 > TABLE_LOAD * rs->arraylen) {
+        size_t ngroups = (rs->nentries + 1 > TABLE_LOAD * rs->arraylen / 2)
+            ? rs->ngroups * 2 : rs->ngroups;
+
+        if (!rehash(rs, ngroups)) {
+            return false;
+        }
+    }
+    insert_entry(rs, p);
     return true;
 }
 
-FMC_API bool C_Ref_Set_add(C_Ref_Set* rs, const void* p) {
-    int index = -1;
+FMC_API void C_Ref_Set_set_shrink_load(C_Ref_Set* rs, double load) {
+    if (rs == NULL) return;
 
-    if (!p) return false;
+    if (!(load > 0)) {
+        load = 0;
+    } else if (load > TABLE_SHRINKMAX) {
+        load = TABLE_SHRINKMAX;
+    }
+    rs->shrink_load = load;
+}
 
-    index = find_entry(rs, p);
-    if (index < 0) {
-        bool result = insert_entry(rs, p);
-        return result;
+FMC_API bool C_Ref_Set_compact(C_Ref_Set* rs) {
+    size_t ngroups;
+
+    if (rs == NULL) return false;
+
+    ngroups = groups_for(rs->nentries);
+    if (ngroups < rs->minngroups) {
+        ngroups = rs->minngroups;
     }
-    return false;
+    if (ngroups > rs->ngroups) {
+        return true;
+    }
+    // Same size or smaller; either way it sweeps out DELETED markers
+    return rehash(rs, ngroups);
+}
+
+FMC_API bool C_Ref_Set_set_filter(C_Ref_Set* rs, bool on) {
+    if (rs == NULL) return false;
+
+    if (!on) {
+        free(rs->filter);
+        rs->filter = NULL;
+    } else if (rs->filter == NULL) {
+        rs->filter = malloc(rs->ngroups * sizeof(uint64_t));
+        if (rs->filter == NULL) {
+            return false;
+        }
+        filter_fill(rs);
+    }
+    return true;
+}
+
+FMC_API bool C_Ref_Set_may_have(C_Ref_Set* rs, const void* p) {
+    if (!live(p)) return false;
+
+    return rs->filter == NULL
+        || filter_may_have(rs->filter, home_slot(p, rs->ngroups), p);
 }
 
 FMC_API bool C_Ref_Set_has(C_Ref_Set* rs, const void* p) {
-    if (!p) return false;
+    if (!live(p)) return false;
 
     return find_entry(rs, p) >= 0;
 }
 
 FMC_API bool C_Ref_Set_remove(C_Ref_Set* rs, const void* p) {
-    int index = -1;
+    ssize_t index;
+    const void** group;
 
-    if (!p) return false;
+    if (!live(p)) return false;
 
     index = find_entry(rs, p);
-    if (index >= 0) {
+    if (index < 0) {
+        return false;
+    }
+
+    group = rs->array + (index - index % GROUP_WIDTH);
+    if (group_has_empty(group)) {
         rs->array[index] = NULL;
-        rs->nentries--;
-        return true;
+        rs->nused--;
+    } else {
+        rs->array[index] = DELETED;
+    }
+    rs->nentries--;
+
+    // Shrink to room for twice as many; if that fails, no harm done
+    if (rs->nentries < rs->arraylen * rs->shrink_load
+            && rs->ngroups > rs->minngroups) {
+        size_t ngroups = groups_for(2 * rs->nentries);
+        rehash(rs, (ngroups > rs->minngroups) ? ngroups : rs->minngroups);
+    } else if (rs->filter != NULL && ++rs->nstale > rs->nentries) {
+        filter_fill(rs);
+    }
+    return true;
+}
+
+FMC_API void C_Ref_Set_stats(C_Ref_Set* rs, C_Hash_Stats* stats) {
+    C_Hash_Stats_clear(stats);
+    if (rs == NULL || stats == NULL) return;
+
+    for (size_t i = 0; i < rs->arraylen; i++) {
+        const void* p = rs->array[i];
+
+        if (live(p)) {
+            size_t home = home_slot(p, rs->ngroups);
+            size_t g = i / GROUP_WIDTH;
+
+            stats->occupied++;
+            C_Hash_Stats_add_probe(stats, (g - home) & (rs->ngroups - 1));
+        }
+    }
+    stats->buckets = rs->arraylen;
+    stats->resizes = rs->resizes;
+    stats->bytes   = sizeof(C_Ref_Set) + rs->arraylen * sizeof(void*);
+    if (rs->filter != NULL) {
+        stats->bytes += rs->ngroups * sizeof(uint64_t);
     }
-    return false;
 }
 
 /* -------------------- Iterator Functions ------------------------- */
@@ -203,7 +531,7 @@ FMC_API void C_Ref_Set_new_iterator(C_Ref_Set* rs, C_Ref_Set_Iterator* *iptr) {
     result->next = -1;
 
     for (size_t j = 0; j < rs->arraylen; j++) {
-        if (rs->array[j] != NULL) {
+        if (live(rs->array[j])) {
             result->next = j;
             break;
         }
@@ -223,7 +551,7 @@ FMC_API void C_Ref_Set_Iterator_next(C_Ref_Set_Iterator* i) {
     i->curr = i->next;
 
     for (int j = i->next+1; j < len; j++) {
-        if (arr[j] != NULL) {
+        if (live(arr[j])) {
             i->next = j;
             break;
         }
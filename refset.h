@@ -24,6 +24,7 @@
 #define FMC_REFSET_H_INCLUDED
 
 #include "common.h"
+#include "hash.h"
 
 /** @file */
 
@@ -61,10 +62,54 @@ FMC_API bool C_Ref_Set_has(C_Ref_Set* t, const void* key);
 
 /**
  * Remove the entry for `key`.
+ * If that leaves too few entries for the set's size (see
+ * `C_Ref_Set_set_shrink_load()`), the set shrinks, which moves every
+ * entry; don't remove entries while iterating.
  * Returns false if the operation could not be completed for some reason.
  */
 FMC_API bool C_Ref_Set_remove(C_Ref_Set* t, const void* key);
 
+/**
+ * Shrink `t` whenever a removal leaves fewer than `load` times its
+ * slots holding entries, by default 0.09375 (an eighth of the 0.75 it
+ * fills to before growing).  A shrunken set is under half full,
+ * so it doesn't flip back and forth between sizes.  A `load` of 0
+ * turns shrinking off; values over 0.1875 count as 0.1875.
+ * A set never shrinks below the size it was created with.
+ */
+FMC_API void C_Ref_Set_set_shrink_load(C_Ref_Set* t, double load);
+
+/**
+ * Shrink `t` as far as it will go for the entries it has now, but
+ * no smaller than it was created, and clear out the markers removed
+ * entries leave behind.  Returns false if it couldn't.
+ */
+FMC_API bool C_Ref_Set_compact(C_Ref_Set* t);
+
+/**
+ * Attach (if `on`) or drop a Bloom filter that lets most lookups of
+ * pointers *not* in `t` finish after reading a single 64-bit word, one
+ * per group of eight slots.  It suits sets asked far more often about
+ * pointers they lack than about pointers they hold.  The filter is
+ * kept up to date as entries come and go, and rebuilt when the set
+ * resizes or compacts.  Returns false if there wasn't memory for it.
+ */
+FMC_API bool C_Ref_Set_set_filter(C_Ref_Set* t, bool on);
+
+/**
+ * Whether `key` might be in `t`.  False means it definitely isn't;
+ * true means it may be, as far as the filter can tell (see
+ * `C_Ref_Set_set_filter()`).  Without a filter this is always true
+ * for a valid `key`.
+ */
+FMC_API bool C_Ref_Set_may_have(C_Ref_Set* t, const void* key);
+
+/**
+ * Fills in `*stats` with how well `t` spreads its keys, where a key's
+ * probe length is its distance from its home group of eight slots.
+ */
+FMC_API void C_Ref_Set_stats(C_Ref_Set* t, C_Hash_Stats* stats);
+
 /**
  * Deletes the table and all memory it allocated.
  */
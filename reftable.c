@@ -21,70 +21,225 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "reftable.h"
 
-#define TBLMINSIZ   5
+#define TBLMINSIZ   8
+#define TBLLOAD     0.9
 
-typedef struct ref_pair {
-    const void *key;
-    const void *value;
-} C_Ref_Pair;
+/*
+ * Shrink once removals leave fewer keys than this share of the slots.
+ * Shrinking leaves the table under half full, so it must fill up again
+ * well past this mark before it grows, or empty well past it before it
+ * shrinks again.
+ */
+#define TBLSHRINK    (TBLLOAD / 8)
+#define TBLSHRINKMAX (TBLLOAD / 4)
+
+/* How many keys ahead C_Ref_Table_put_many() prefetches home slots */
+#define PREFETCH_AHEAD  8
+
+#if defined(__GNUC__)
+#define prefetch(ptr)   __builtin_prefetch(ptr)
+#else
+#define prefetch(ptr)   ((void)(ptr))
+#endif
+
+/*
+ * Where the keys and values of a table's slots live.  Both layouts use
+ * one block of 2 * `len` pointers starting at `keys`: C_REF_TABLE_PAIRS
+ * interleaves keys and values (`stride` 2), while C_REF_TABLE_SPLIT
+ * puts all the keys first and all the values after (`stride` 1).
+ */
+typedef struct ref_slots {
+    const void* *keys;
+    const void* *values;
+    size_t       stride;
+    size_t       len;
+} C_Ref_Slots;
+
+#define KEY(s, i)    ((s)->keys[(i) * (s)->stride])
+#define VALUE(s, i)  ((s)->values[(i) * (s)->stride])
 
 struct C_Ref_Table {
-    C_Ref_Pair* data;
-    size_t      len;
-    size_t      npairs;
+    C_Ref_Slots        slots;
+    size_t             npairs;
+    size_t             resizes;
+    C_Ref_Table_Layout layout;
+
+    /* never shrink below the size asked for at creation */
+    size_t             minlen;
+    double             shrink_load;
+
+    /* bumped whenever keys come or go, to fail iterators */
+    size_t             modcount;
 };
 
+/*
+ * The smallest table size with room for `n` keys and an empty slot.
+ */
+static size_t capacity_for(size_t n) {
+    size_t len = TBLMINSIZ;
+
+    while (len * TBLLOAD < n + 1) {
+        len *= 2;
+    }
+    return len;
+}
+
+/*
+ * Allocate `len` empty slots laid out as `layout` says.
+ */
+static bool slots_alloc(C_Ref_Slots* s, size_t len, C_Ref_Table_Layout layout) {
+    const void* *block = calloc(2 * len, sizeof(const void*));
+
+    if (block == NULL) {
+        return false;
+    }
+    s->keys = block;
+    s->len  = len;
+    if (layout == C_REF_TABLE_SPLIT) {
+        s->values = block + len;
+        s->stride = 1;
+    } else {
+        s->values = block + 1;
+        s->stride = 2;
+    }
+    return true;
+}
+
 FMC_API void C_Ref_Table_new(C_Ref_Table* *tptr, size_t minsz) {
+    C_Ref_Table_new_with_layout(tptr, minsz, C_REF_TABLE_PAIRS);
+}
+
+FMC_API void C_Ref_Table_new_with_layout(C_Ref_Table* *tptr, size_t minsz, C_Ref_Table_Layout layout) {
     C_Ref_Table* self;
-    C_Ref_Pair*  data;
-    size_t       len;
 
     if (!tptr) {
         return;
     }
     *tptr = NULL;
 
+    if (layout != C_REF_TABLE_SPLIT) {
+        layout = C_REF_TABLE_PAIRS;
+    }
+
     self = malloc(sizeof(C_Ref_Table));
     if (!self) {
         return;
     }
 
-    len  = (minsz > TBLMINSIZ) ? minsz : TBLMINSIZ;
-    data = calloc(len, sizeof(C_Ref_Pair));
-    if (data == NULL) {
+    if (!slots_alloc(&self->slots, capacity_for(minsz), layout)) {
         free(self);
         return;
     }
-    self->data   = data;
-    self->len    = len;
-    self->npairs = 0;
+    self->npairs   = 0;
+    self->resizes  = 0;
+    self->layout   = layout;
+    self->minlen   = self->slots.len;
+    self->shrink_load = TBLSHRINK;
+    self->modcount = 0;
 
     *tptr = self;
 }
 
-static uint64_t hashcode(const void* k) {
-    return ((uintptr_t)k) >> 2;
+FMC_API C_Ref_Table_Layout C_Ref_Table_layout(C_Ref_Table* self) {
+    return (self != NULL) ? self->layout : C_REF_TABLE_PAIRS;
+}
+
+/*
+ * Fibonacci hashing: multiply by 2^64 / phi and keep the top log2(len)
+ * bits, which depend on every bit of the pointer, not just the low ones
+ * that malloc() alignment keeps constant.  `len` is a power of two, 2 or more.
+ */
+static inline size_t home_slot(const void* p, size_t len) {
+#if defined(__GNUC__)
+    int bits = __builtin_ctzll(len);
+#else
+    int bits = 0;
+    while ((len >> bits) > 1) bits++;
+#endif
+    return (size_t)(((uint64_t)(uintptr_t)p * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+/*
+ * How far the key in slot `i` lies from its home slot.
+ */
+static inline size_t probe_distance(const void* k, size_t i, size_t len) {
+    return (i - home_slot(k, len)) & (len - 1);
 }
 
-static ssize_t find_key(C_Ref_Pair data[], size_t len, const void* k, bool search) {
-    ssize_t result = hashcode(k) % len;
+/*
+ * Robin Hood hashing keeps keys ordered by distance from home along each
+ * run of slots, so a search may stop at the first key closer to home
+ * than the one it wants, and misses cost no more than hits.  Only keys
+ * are read here; a value is read only once its key is found.
+ */
+static ssize_t find_key(const C_Ref_Slots* s, const void* k) {
+    size_t len = s->len;
+    size_t i = home_slot(k, len);
 
-    if (data[result].key == k) {
-        return result;
-    } else if (data[result].key == NULL) {
-        return search ? -1 : result;
-    } else {
-        const void* target = search ? k : NULL;
+    if (k == NULL) {
+        return -1;
+    }
+    for (size_t dist = 0; dist < len; dist++) {
+        const void* key = KEY(s, i);
 
-        for (ssize_t i = (result+1) % len; i != result; i = (i+1) % len) {
-            if (data[i].key == target) {
-                return i;
-            }
+        if (key == k) {
+            return i;
+        } else if (key == NULL || probe_distance(key, i, len) < dist) {
+            return -1;
         }
-        return -1;
+        i = (i + 1) & (len - 1);
+    }
+    return -1;
+}
+
+/*
+ * Insert `k`, which mustn't be in `s` already; there must be
+ * at least one empty slot.  A key further from home than the one in
+ * a slot takes the slot, and the one displaced moves on.
+ */
+static void insert_key(C_Ref_Slots* s, const void* k, const void* v) {
+    size_t len = s->len;
+    size_t i = home_slot(k, len);
+    size_t dist = 0;
+
+    while (KEY(s, i) != NULL) {
+        size_t d = probe_distance(KEY(s, i), i, len);
+
+        if (d < dist) {
+            const void* tk = KEY(s, i);
+            const void* tv = VALUE(s, i);
+            KEY(s, i) = k;
+            VALUE(s, i) = v;
+            k = tk;
+            v = tv;
+            dist = d;
+        }
+        i = (i + 1) & (len - 1);
+        dist++;
     }
+    KEY(s, i) = k;
+    VALUE(s, i) = v;
+}
+
+/*
+ * Empty slot `i` and shift the keys after it back toward home,
+ * so no tombstones are needed.
+ */
+static void remove_at(C_Ref_Slots* s, size_t i) {
+    size_t len = s->len;
+    size_t next = (i + 1) & (len - 1);
+
+    while (KEY(s, next) != NULL && probe_distance(KEY(s, next), next, len) > 0) {
+        KEY(s, i) = KEY(s, next);
+        VALUE(s, i) = VALUE(s, next);
+        i = next;
+        next = (next + 1) & (len - 1);
+    }
+    KEY(s, i) = NULL;
+    VALUE(s, i) = NULL;
 }
 
 FMC_API size_t C_Ref_Table_size(C_Ref_Table* self) {
@@ -92,96 +247,267 @@ FMC_API size_t C_Ref_Table_size(C_Ref_Table* self) {
 }
 
 FMC_API const void* C_Ref_Table_get(C_Ref_Table* self, const void* k) {
-    ssize_t index = find_key(self->data, self->len, k, true);
+    ssize_t index = find_key(&self->slots, k);
     if (index < 0) {
         return NULL;
     }
-    return self->data[index].value;
+    return VALUE(&self->slots, index);
 }
 
 FMC_API bool C_Ref_Table_has(C_Ref_Table* self, const void* k) {
-    return find_key(self->data, self->len, k, true) >= 0;
+    return find_key(&self->slots, k) >= 0;
 }
 
-static bool rehash(C_Ref_Table* self) {
-    size_t      oldlen = self->len;
-    C_Ref_Pair* olddata = self->data;
-    size_t      newlen = oldlen * 2 + 1;
-    C_Ref_Pair* newdata = calloc(newlen, sizeof(C_Ref_Pair));
+static bool rehash(C_Ref_Table* self, size_t newlen) {
+    C_Ref_Slots* old = &self->slots;
+    C_Ref_Slots  newslots;
 
-    if (newdata == NULL) {
+    if (!slots_alloc(&newslots, newlen, self->layout)) {
         return false;
     }
-    for (size_t i = 0; i < oldlen; i++) {
-        C_Ref_Pair* curr = olddata + i;
-        if (curr->key != NULL) {
-            ssize_t j = find_key(newdata, newlen, curr->key, false);
-            if (j >= 0) {
-                newdata[j].key = curr->key;
-                newdata[j].value = curr->value;
-            } else {
-                // shouldn't happen ... what do we do?
-                free(newdata);
-                return false;
-            }
+    for (size_t i = 0; i < old->len; i++) {
+        if (KEY(old, i) != NULL) {
+            insert_key(&newslots, KEY(old, i), VALUE(old, i));
         }
     }
-    free(olddata);
-    self->data = newdata;
-    self->len  = newlen;
+    free(old->keys);
+    self->slots = newslots;
+    self->resizes++;
+    self->modcount++;
     return true;
 }
 
+FMC_API bool C_Ref_Table_reserve(C_Ref_Table* self, size_t n) {
+    size_t newlen;
+
+    if (self == NULL) return false;
+
+    newlen = capacity_for(n);
+    return newlen <= self->slots.len || rehash(self, newlen);
+}
+
+/*
+ * The size to shrink to: room for twice the keys there are now, but
+ * no smaller than the table started.
+ */
+static size_t shrunk_len(C_Ref_Table* self) {
+    size_t len = capacity_for(2 * self->npairs);
+    return (len > self->minlen) ? len : self->minlen;
+}
+
+FMC_API void C_Ref_Table_set_shrink_load(C_Ref_Table* self, double load) {
+    if (self == NULL) return;
+
+    if (!(load > 0)) {
+        load = 0;
+    } else if (load > TBLSHRINKMAX) {
+        load = TBLSHRINKMAX;
+    }
+    self->shrink_load = load;
+}
+
+FMC_API bool C_Ref_Table_compact(C_Ref_Table* self) {
+    size_t newlen;
+
+    if (self == NULL) return false;
+
+    newlen = capacity_for(self->npairs);
+    if (newlen < self->minlen) {
+        newlen = self->minlen;
+    }
+    return newlen >= self->slots.len || rehash(self, newlen);
+}
+
+FMC_API void C_Ref_Table_clear(C_Ref_Table* self) {
+    if (self == NULL) return;
+
+    memset(self->slots.keys, 0, 2 * self->slots.len * sizeof(const void*));
+    self->npairs = 0;
+    self->modcount++;
+}
+
 FMC_API bool C_Ref_Table_put(C_Ref_Table* self, const void* k, const void* v, const void* *oldvalp) {
     ssize_t index;
 
-    if (self->npairs > self->len * 0.75) {
-        if (!rehash(self)) {
-            return false;
-        }
+    if (k == NULL) {
+        return false;
     }
 
-    index = find_key(self->data, self->len, k, false);
+    index = find_key(&self->slots, k);
+    if (index >= 0) {
+        if (oldvalp) {
+            (*oldvalp) = VALUE(&self->slots, index);
+        }
+        VALUE(&self->slots, index) = v;
+        return true;
+    }
 
-    if (index < 0) {
-        return false;
+    // Always leave an empty slot to end probes
+    if (self->npairs + 1 > self->slots.len * TBLLOAD) {
+        if (!rehash(self, self->slots.len * 2)) {
+            return false;
+        }
     }
 
     if (oldvalp) {
-        (*oldvalp) = self->data[index].value;
+        (*oldvalp) = NULL;
     }
+    insert_key(&self->slots, k, v);
+    self->npairs++;
+    self->modcount++;
+    return true;
+}
+
+FMC_API size_t C_Ref_Table_put_many(C_Ref_Table* self, size_t n, const void* keys[], const void* values[]) {
+    size_t count = 0;
+
+    if (self == NULL || n == 0) return 0;
 
-    if (self->data[index].key == NULL) {
-        self->npairs++;
+    // Resize once up front rather than doubling every so often.  Some
+    // keys may already be here, so leave at most one doubling to put().
+    C_Ref_Table_reserve(self, (n > self->npairs) ? n : self->npairs);
+
+    for (size_t i = 0; i < n; i++) {
+        if (i + PREFETCH_AHEAD < n && keys[i + PREFETCH_AHEAD] != NULL) {
+            C_Ref_Slots* s = &self->slots;
+            prefetch(&KEY(s, home_slot(keys[i + PREFETCH_AHEAD], s->len)));
+        }
+        if (C_Ref_Table_put(self, keys[i], values[i], NULL)) {
+            count++;
+        }
     }
-    self->data[index].key = k;
-    self->data[index].value = v;
-    return true;
+    return count;
 }
 
 FMC_API bool C_Ref_Table_remove(C_Ref_Table* self, const void* k, const void* *oldvalp) {
-    ssize_t index = find_key(self->data, self->len, k, true);
+    ssize_t index = find_key(&self->slots, k);
     if (index < 0) {
         return false;
     }
 
     if (oldvalp) {
-        (*oldvalp) = self->data[index].value;
+        (*oldvalp) = VALUE(&self->slots, index);
     }
 
+    remove_at(&self->slots, index);
     self->npairs--;
-    self->data[index].key = NULL;
-    self->data[index].value = NULL;
+    self->modcount++;
+
+    // If this fails the table is merely bigger than it needs to be
+    if (self->npairs < self->slots.len * self->shrink_load
+            && self->slots.len > self->minlen) {
+        rehash(self, shrunk_len(self));
+    }
     return true;
 }
 
+FMC_API void C_Ref_Table_stats(C_Ref_Table* self, C_Hash_Stats* stats) {
+    C_Ref_Slots* s;
+
+    C_Hash_Stats_clear(stats);
+    if (self == NULL || stats == NULL) return;
+
+    s = &self->slots;
+    for (size_t i = 0; i < s->len; i++) {
+        const void* k = KEY(s, i);
+
+        if (k != NULL) {
+            stats->occupied++;
+            C_Hash_Stats_add_probe(stats, probe_distance(k, i, s->len));
+        }
+    }
+    stats->buckets = s->len;
+    stats->resizes = self->resizes;
+    stats->bytes   = sizeof(C_Ref_Table) + 2 * s->len * sizeof(const void*);
+}
+
 FMC_API void C_Ref_Table_free(C_Ref_Table* *selfptr) {
     C_Ref_Table* self = selfptr ? *selfptr : NULL;
     if (!self) {
         return;
     }
-    free(self->data);
+    free(self->slots.keys);
     free(self);
     *selfptr = NULL;
 }
 
+
+/* -------------------- Iterator Functions ------------------------- */
+
+/*
+ * The first occupied slot at or after `i`, or `t->len` if none.
+ */
+static size_t scan_pairs(C_Ref_Table* t, size_t i) {
+    while (i < t->slots.len && KEY(&t->slots, i) == NULL) {
+        i++;
+    }
+    return i;
+}
+
+FMC_API void C_Ref_Table_Iterator_init(C_Ref_Table* t, C_Ref_Table_Iterator* i) {
+    if (i == NULL) return;
+
+    memset(i, 0, sizeof(C_Ref_Table_Iterator));
+    if (t == NULL) return;
+
+    i->table    = t;
+    i->modcount = t->modcount;
+    i->curr     = t->slots.len;
+    i->next     = scan_pairs(t, 0);
+}
+
+FMC_API void C_Ref_Table_new_iterator(C_Ref_Table* t, C_Ref_Table_Iterator* *iptr) {
+    C_Ref_Table_Iterator* result;
+
+    if (t == NULL || iptr == NULL) return;
+
+    result = (C_Ref_Table_Iterator*)malloc(sizeof(C_Ref_Table_Iterator));
+    if (result == NULL) return;
+
+    C_Ref_Table_Iterator_init(t, result);
+
+    *iptr = result;
+}
+
+FMC_API bool C_Ref_Table_Iterator_has_failed(C_Ref_Table_Iterator* i) {
+    return i->table != NULL && i->table->modcount != i->modcount;
+}
+
+FMC_API bool C_Ref_Table_Iterator_has_next(C_Ref_Table_Iterator* i) {
+    return i->table != NULL && i->next < i->table->slots.len
+        && !C_Ref_Table_Iterator_has_failed(i);
+}
+
+FMC_API void C_Ref_Table_Iterator_next(C_Ref_Table_Iterator* i) {
+    if (!C_Ref_Table_Iterator_has_next(i)) {
+        i->curr = SIZE_MAX;
+        i->next = SIZE_MAX;
+        return;
+    }
+    i->curr = i->next;
+    i->next = scan_pairs(i->table, i->curr + 1);
+}
+
+/*
+ * Whether `i` is on a live entry of an unchanged table.
+ */
+static bool on_entry(C_Ref_Table_Iterator* i) {
+    return i->table != NULL && i->curr < i->table->slots.len
+        && !C_Ref_Table_Iterator_has_failed(i);
+}
+
+FMC_API const void* C_Ref_Table_Iterator_current_key(C_Ref_Table_Iterator* i) {
+    return on_entry(i) ? KEY(&i->table->slots, i->curr) : NULL;
+}
+
+FMC_API const void* C_Ref_Table_Iterator_current_value(C_Ref_Table_Iterator* i) {
+    return on_entry(i) ? VALUE(&i->table->slots, i->curr) : NULL;
+}
+
+FMC_API bool C_Ref_Table_Iterator_free(C_Ref_Table_Iterator* *iptr) {
+    if (!iptr || !(*iptr)) return false;
+
+    free(*iptr);
+    *iptr = NULL;
+    return true;
+}
@@ -24,6 +24,7 @@
 #define FMC_REFTABLE_H_INCLUDED
 
 #include "common.h"
+#include "hash.h"
 
 /** @file */
 
@@ -36,15 +37,52 @@
 typedef struct C_Ref_Table C_Ref_Table;
 
 /**
- * An opaque type for string table iterator instances.
+ * A cursor over the entries of a table, walking its slots in place.
+ * It may live anywhere, e.g. on the stack, once set up by
+ * `C_Ref_Table_Iterator_init()`.  Its fields are private.
  */
-typedef struct C_Ref_Table_Iterator C_Ref_Table_Iterator;
+typedef struct C_Ref_Table_Iterator {
+    C_Ref_Table* table;
+    size_t       curr;
+    size_t       next;
+    size_t       modcount;
+} C_Ref_Table_Iterator;
 
 /**
- * Creates a new string table with at least `minsz` capacity.
+ * How a `C_Ref_Table` arranges its keys and values in memory.
+ */
+typedef enum C_Ref_Table_Layout {
+    /**
+     * Each key sits beside its value, so a hit finds both on one cache
+     * line.  This is the default.
+     */
+    C_REF_TABLE_PAIRS = 0,
+
+    /**
+     * Keys and values live in separate parallel arrays.  A probe reads
+     * only keys, twice as many per cache line, and a value only on a hit,
+     * so lookups that mostly miss touch half the memory.
+     */
+    C_REF_TABLE_SPLIT = 1
+} C_Ref_Table_Layout;
+
+/**
+ * Creates a new table with the default layout (`C_REF_TABLE_PAIRS`)
+ * and at least `minsz` capacity.
  */
 FMC_API void C_Ref_Table_new(C_Ref_Table* *tptr, size_t minsz);
 
+/**
+ * Creates a new table with the given `layout` and at least `minsz`
+ * capacity.  Both layouts behave identically through this API.
+ */
+FMC_API void C_Ref_Table_new_with_layout(C_Ref_Table* *tptr, size_t minsz, C_Ref_Table_Layout layout);
+
+/**
+ * The layout `t` was created with.
+ */
+FMC_API C_Ref_Table_Layout C_Ref_Table_layout(C_Ref_Table* t);
+
 /**
  * The number of entries in `t`.
  */
@@ -72,17 +110,106 @@ FMC_API bool C_Ref_Table_has(C_Ref_Table* t, const void* key);
  */
 FMC_API bool C_Ref_Table_put(C_Ref_Table* t, const void* key, const void* value, const void* *oldvalp);
 
+/**
+ * Put `n` keys and values at once, in order, as if by `C_Ref_Table_put()`
+ * on each, after growing the table once to hold at least `n` entries.
+ * Returns the number of pairs put successfully.
+ */
+FMC_API size_t C_Ref_Table_put_many(C_Ref_Table* t, size_t n, const void* keys[], const void* values[]);
+
+/**
+ * Grow `t` if need be to hold `n` entries in all without resizing.
+ * Returns false if it couldn't.
+ */
+FMC_API bool C_Ref_Table_reserve(C_Ref_Table* t, size_t n);
+
+/**
+ * Remove every entry, but keep the memory for reuse.
+ */
+FMC_API void C_Ref_Table_clear(C_Ref_Table* t);
+
 /**
  * Remove the entry for `key`.
  * The previous value if any is placed in `*oldvalp` if given.
+ * If that leaves too few entries for the table's size (see
+ * `C_Ref_Table_set_shrink_load()`), the table shrinks.
  * Returns false if the operation could not be completed for some reason.
  */
 FMC_API bool C_Ref_Table_remove(C_Ref_Table* t, const void* key, const void* *oldvalp);
 
+/**
+ * Shrink `t` whenever a removal leaves fewer than `load` times its
+ * slots holding entries, by default 0.1125 (an eighth of the 0.9 it
+ * fills to before growing).  A shrunken table is under half full,
+ * so it doesn't flip back and forth between sizes.  A `load` of 0
+ * turns shrinking off; values over 0.225 count as 0.225.
+ * A table never shrinks below the size it was created with.
+ */
+FMC_API void C_Ref_Table_set_shrink_load(C_Ref_Table* t, double load);
+
+/**
+ * Shrink `t` as far as it will go for the entries it has now, but
+ * no smaller than it was created.  Returns false if it couldn't.
+ */
+FMC_API bool C_Ref_Table_compact(C_Ref_Table* t);
+
+/**
+ * Fills in `*stats` with how well `t` spreads its keys, where a key's
+ * probe length is its distance in slots from its home slot.
+ */
+FMC_API void C_Ref_Table_stats(C_Ref_Table* t, C_Hash_Stats* stats);
+
 /**
  * Deletes the table and all memory it allocated.
  */
 FMC_API void C_Ref_Table_free(C_Ref_Table* *tptr);
 
+/* -------------------- Iterator Functions ------------------------- */
+
+/**
+ * Set up `i` to walk the entries of `t` without allocating memory.
+ * Adding or removing an entry, or anything else that moves entries,
+ * fails the iterator: afterward it returns no more entries.  Replacing
+ * the value of an existing entry does not.
+ */
+FMC_API void C_Ref_Table_Iterator_init(C_Ref_Table* t, C_Ref_Table_Iterator* i);
+
+/**
+ * Allocate an iterator like `C_Ref_Table_Iterator_init()`.
+ * Free it with `C_Ref_Table_Iterator_free()`.
+ */
+FMC_API void C_Ref_Table_new_iterator(C_Ref_Table* t, C_Ref_Table_Iterator* *iptr);
+
+/**
+ * Whether a call to `C_Ref_Table_Iterator_next()` would find another entry.
+ */
+FMC_API bool C_Ref_Table_Iterator_has_next(C_Ref_Table_Iterator* i);
+
+/**
+ * Move to the next entry.  An iterator starts before the first entry.
+ */
+FMC_API void C_Ref_Table_Iterator_next(C_Ref_Table_Iterator* i);
+
+/**
+ * Whether the table has been added to or removed from since `i` was
+ * set up.
+ */
+FMC_API bool C_Ref_Table_Iterator_has_failed(C_Ref_Table_Iterator* i);
+
+/**
+ * The key of the current entry, or NULL if there is none.
+ */
+FMC_API const void* C_Ref_Table_Iterator_current_key(C_Ref_Table_Iterator* i);
+
+/**
+ * The value of the current entry, or NULL if there is none.
+ */
+FMC_API const void* C_Ref_Table_Iterator_current_value(C_Ref_Table_Iterator* i);
+
+/**
+ * Free an iterator from `C_Ref_Table_new_iterator()`.
+ */
+FMC_API bool C_Ref_Table_Iterator_free(C_Ref_Table_Iterator* *iptr);
+
 #endif // FMC_REFTABLE_H_INCLUDED
 
@@ -20,17 +20,182 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdlib.h>
-#include "table.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "strtable.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define TBLMINSIZ   8
+#define TBLLOAD     0.9
+
+#define ARENAMINSIZ 64
+
+/* Keys' offsets are 32 bits, so the arena can't grow past this */
+#define ARENAMAXSIZ ((size_t)UINT32_MAX)
+
+/* Average keys per bucket of a frozen table's perfect hash */
+#define FROZENLOAD  4
+
+/*
+ * Pilots to try for one bucket, and seeds to try in all, before giving up.
+ * A frozen table places keys among 1% more slots than keys (see
+ * frozen_extra()), so even the last bucket finds a free slot within a
+ * hundred or so tries whatever the number of keys.
+ */
+#define MAXPILOT    (1u << 16)
+#define MAXSEEDS    16
+
+/* Prefix bytes an ordered table's node stores; the rest live in leaves */
+#define ART_MAXPREFIX   10
+
+/* Keys C_String_Table_add_many() hashes ahead of inserting them */
+#define BATCHSIZ    16
+
+#if defined(__GNUC__)
+#define prefetch(ptr)   __builtin_prefetch(ptr)
+#else
+#define prefetch(ptr)   ((void)(ptr))
+#endif
+
+/* Snapshot files: bump SNAPVERSION whenever the layout or hash changes */
+#define SNAPMAGIC   "FMCSTRT"
+#define SNAPVERSION 1
+#define SNAPORDER   0x01020304u
+#define SNAPBLOBS   0x1
+#define SNAPALIGN   8
+
+/*
+ * An entry in the index.  The key lives in the table's arena at `off`:
+ * its length as a LEB128 varint, then its bytes.  `hash` is the high
+ * half of the key's hash, enough to skip almost every other key without
+ * looking at the arena, and to rehash without rereading keys.
+ */
+typedef struct str_slot {
+    const void* value;   /* NULL if the slot is empty */
+    uint32_t    off;
+    uint32_t    hash;
+} C_String_Slot;
+
+/*
+ * A child in an ordered table's tree: a node pointer, or a leaf
+ * (see "Tree Functions" below).
+ */
+typedef uintptr_t art_ref;
+
+enum { NODE4, NODE16, NODE48, NODE256 };
+
+typedef struct art_node {
+    uint8_t  type;
+    uint16_t count;
+    uint32_t prefix_len;
+    uint8_t  partial[ART_MAXPREFIX];
+    art_ref  leaf;
+} art_node;
+
+typedef struct art_node4 {
+    art_node n;
+    uint8_t  keys[4];
+    art_ref  children[4];
+} art_node4;
+
+typedef struct art_node16 {
+    art_node n;
+    uint8_t  keys[16];
+    art_ref  children[16];
+} art_node16;
+
+typedef struct art_node48 {
+    art_node n;
+    uint8_t  index[256];    /* child's place in `children` plus one, or 0 */
+    art_ref  children[48];
+} art_node48;
+
+typedef struct art_node256 {
+    art_node n;
+    art_ref  children[256];
+} art_node256;
+
+static inline bool is_leaf(art_ref r) {
+    return (r & 1) != 0;
+}
+
+static inline art_ref leaf_ref(uint32_t off) {
+    return ((art_ref)off << 1) | 1;
+}
+
+static inline uint32_t leaf_off(art_ref r) {
+    return (uint32_t)(r >> 1);
+}
+
 struct C_String_Table {
-    C_Table* t;
+    C_String_Table_Layout layout;
+
+    /* C_STRING_TABLE_ORDERED keeps its keys in a tree... */
+    art_ref        root;
+
+    /* ... C_STRING_TABLE_HASHED in an open-addressed index */
+    C_String_Slot* slots;
+    size_t         len;
+    size_t         nentries;
+    size_t         resizes;
+
+    /* changes whenever entries move, failing iterators */
+    size_t         modcount;
+
+    /*
+     * once frozen, `slots` holds exactly `nentries` placed by a perfect
+     * hash; `remap`, stored after `pilots`, moves keys the hash places in
+     * `frozen_extra()` slots past the end into the empty slots below it
+     */
+    bool           frozen;
+    uint64_t       seed;
+    uint32_t*      pilots;
+    size_t         nbuckets;
+    uint32_t*      remap;
+
+    /* append-only store of keys */
+    uint8_t*       arena;
+    size_t         arenalen;
+    size_t         arenacap;
+
+    /* bytes in the arena belonging to removed keys */
+    size_t         dead;
+
+    /* a table opened by C_String_Table_map() reads all the above from here */
+    void*          map;
+    size_t         maplen;
+
+    /* if not NULL, values are offsets of encoded values from here */
+    const uint8_t* blobs;
 };
 
+/*
+ * The smallest index size with room for `n` keys and an empty slot.
+ */
+static size_t capacity_for(size_t n) {
+    size_t len = TBLMINSIZ;
+
+    while (len * TBLLOAD < n + 1) {
+        len *= 2;
+    }
+    return len;
+}
+
 FMC_API void C_String_Table_new(C_String_Table* *tptr, size_t minsz) {
-    C_Table* t;
+    C_String_Table_new_with_layout(tptr, minsz, C_STRING_TABLE_HASHED);
+}
+
+FMC_API void C_String_Table_new_with_layout(C_String_Table* *tptr, size_t minsz, C_String_Table_Layout layout) {
     C_String_Table* self;
+    size_t len;
 
     if (!tptr) {
         return;
@@ -41,68 +206,2150 @@ FMC_API void C_String_Table_new(C_String_Table* *tptr, size_t minsz) {
     if (!self) {
         return;
     }
-    C_Table_new(&t, minsz);
-    if (t == NULL) {
-        free(self);
-        return;
+    memset(self, 0, sizeof(C_String_Table));
+
+    if (layout == C_STRING_TABLE_ORDERED) {
+        self->layout = C_STRING_TABLE_ORDERED;
+    } else {
+        len = capacity_for(minsz);
+        self->slots = calloc(len, sizeof(C_String_Slot));
+        if (self->slots == NULL) {
+            free(self);
+            return;
+        }
+        self->len = len;
+        self->layout = C_STRING_TABLE_HASHED;
     }
-    self->t = t;
 
     *tptr = self;
 }
 
+FMC_API C_String_Table_Layout C_String_Table_layout(C_String_Table* t) {
+    return (t != NULL) ? t->layout : C_STRING_TABLE_HASHED;
+}
+
 FMC_API size_t C_String_Table_size(C_String_Table* t) {
-    return C_Table_size(t->t);
+    return t->nentries;
 }
 
-FMC_API const void* C_String_Table_get(C_String_Table* t, size_t kl, const uint8_t* kp) {
-    C_Userdata key, value;
+/* ---------------------- Arena Functions --------------------------------*/
+
+static size_t length_size(size_t n) {
+    size_t size = 1;
 
-    C_Userdata_set_value(&key, kp, kl);
-    C_Userdata_clear(&value, false);
+    while (n >= 0x80) {
+        n >>= 7;
+        size++;
+    }
+    return size;
+}
 
-    C_Table_get(t->t, &key, &value);
+static size_t put_length(uint8_t* p, size_t n) {
+    size_t i = 0;
 
-    return value.ptr;
+    while (n >= 0x80) {
+        p[i++] = (uint8_t)(n | 0x80);
+        n >>= 7;
+    }
+    p[i++] = (uint8_t)n;
+    return i;
 }
 
-FMC_API bool C_String_Table_has(C_String_Table* t, size_t kl, const uint8_t* kp) {
-    C_Userdata key;
+static size_t get_length(const uint8_t* p, size_t* np) {
+    size_t n = 0;
+    size_t i = 0;
+    int shift = 0;
 
-    C_Userdata_set_value(&key, kp, kl);
+    do {
+        n |= (size_t)(p[i] & 0x7F) << shift;
+        shift += 7;
+    } while (p[i++] & 0x80);
 
-    return C_Table_has(t->t, &key);
+    *np = n;
+    return i;
 }
 
-FMC_API bool C_String_Table_add(C_String_Table* t, size_t kl, const uint8_t* kp, const void* v) {
-    C_Userdata key, value;
+/*
+ * Bytes before the key's length in each arena record: an ordered
+ * table's leaves keep their value there.
+ */
+static inline size_t record_head(const C_String_Table* self) {
+    return (self->layout == C_STRING_TABLE_ORDERED) ? sizeof(const void*) : 0;
+}
 
-    C_Userdata_set_value(&key, kp, kl);
-    C_Userdata_set_pointer(&value, v);
-    return C_Table_add(t->t, &key, &value);
+/*
+ * Bytes the record at `off` takes in the arena, length included.
+ */
+static size_t record_size(const C_String_Table* self, uint32_t off) {
+    size_t head = record_head(self);
+    size_t kl;
+    size_t hl = get_length(self->arena + off + head, &kl);
+
+    return head + hl + kl;
 }
 
-FMC_API bool C_String_Table_remove(C_String_Table* t, size_t kl, const uint8_t* kp, const void* *oldvalp) {
-    C_Userdata key, value;
+typedef bool (*art_leaf_fcn)(C_String_Table* t, art_ref* ref, void* data);
 
-    C_Userdata_set_value(&key, kp, kl);
+static bool walk_leaves(C_String_Table* t, art_ref* ref, art_leaf_fcn f, void* data);
 
-    if (oldvalp) {
-        C_Userdata_clear(&value, false);
-        C_Table_get(t->t, &key, &value);
-        *oldvalp = value.ptr;
+typedef struct compaction {
+    uint8_t* arena;
+    size_t   pos;
+} C_Compaction;
+
+static bool compact_leaf(C_String_Table* self, art_ref* ref, void* data) {
+    C_Compaction* c = (C_Compaction*)data;
+    uint32_t off = leaf_off(*ref);
+    size_t size = record_size(self, off);
+
+    memcpy(c->arena + c->pos, self->arena + off, size);
+    *ref = leaf_ref((uint32_t)c->pos);
+    c->pos += size;
+    return true;
+}
+
+/*
+ * Copy every live key into a new arena with room for `extra` more
+ * bytes, leaving behind the keys of removed entries.
+ */
+static bool arena_compact(C_String_Table* self, size_t extra) {
+    size_t   live = self->arenalen - self->dead;
+    size_t   cap = live + extra + (live + extra) / 2;
+    size_t   pos = 0;
+    uint8_t* arena;
+
+    if (cap < ARENAMINSIZ) {
+        cap = ARENAMINSIZ;
     }
-    return C_Table_remove(t->t, &key);
+    arena = malloc(cap);
+    if (arena == NULL) {
+        return false;
+    }
+    if (self->layout == C_STRING_TABLE_ORDERED) {
+        C_Compaction c = { arena, 0 };
+
+        walk_leaves(self, &self->root, compact_leaf, &c);
+        pos = c.pos;
+    }
+    for (size_t i = 0; i < self->len; i++) {
+        C_String_Slot* slot = self->slots + i;
+
+        if (slot->value != NULL) {
+            size_t size = record_size(self, slot->off);
+
+            memcpy(arena + pos, self->arena + slot->off, size);
+            slot->off = (uint32_t)pos;
+            pos += size;
+        }
+    }
+    free(self->arena);
+    self->arena    = arena;
+    self->arenalen = pos;
+    self->arenacap = cap;
+    self->dead     = 0;
+    self->modcount++;
+    return true;
 }
 
-FMC_API void C_String_Table_free(C_String_Table* *tptr) {
-    C_Table* t;
-    if (!tptr) {
-        return;
+/*
+ * Make room for `need` more bytes of records, reclaiming removed keys'
+ * room rather than growing if there's enough of it.
+ */
+static bool arena_reserve(C_String_Table* self, size_t need) {
+    size_t   cap;
+    uint8_t* arena;
+
+    if (self->arenalen + need > ARENAMAXSIZ) {
+        return false;
     }
-    t = (*tptr)->t;
-    C_Table_free(&t);
-    free(*tptr);
-    *tptr = NULL;
+    if (self->arenalen + need <= self->arenacap) {
+        return true;
+    }
+    if (self->dead > self->arenalen / 4) {
+        return arena_compact(self, need);
+    }
+
+    cap = self->arenacap + self->arenacap / 2;
+    if (cap < self->arenalen + need) {
+        cap = self->arenalen + need;
+    }
+    if (cap < ARENAMINSIZ) {
+        cap = ARENAMINSIZ;
+    }
+    arena = realloc(self->arena, cap);
+    if (arena == NULL) {
+        return false;
+    }
+    self->arena    = arena;
+    self->arenacap = cap;
+    return true;
+}
+
+/*
+ * Append `key` to the arena and put its record's offset in `*offp`.
+ */
+static bool arena_append(C_String_Table* self, size_t kl, const uint8_t* kp, uint32_t* offp) {
+    size_t head = record_head(self);
+    size_t need = head + length_size(kl) + kl;
+
+    if (!arena_reserve(self, need)) {
+        return false;
+    }
+
+    *offp = (uint32_t)self->arenalen;
+    memset(self->arena + self->arenalen, 0, head);
+    self->arenalen += head;
+    self->arenalen += put_length(self->arena + self->arenalen, kl);
+    memcpy(self->arena + self->arenalen, kp, kl);
+    self->arenalen += kl;
+    return true;
+}
+
+/* ---------------------- Index Functions --------------------------------*/
+
+/*
+ * The home slot of a key whose hash is `hash`: its top log2(len) bits.
+ */
+static inline size_t home_slot(uint32_t hash, size_t len) {
+    return (size_t)(((uint64_t)hash * len) >> 32);
+}
+
+static inline size_t probe_distance(const C_String_Slot* slot, size_t i, size_t len) {
+    return (i - home_slot(slot->hash, len)) & (len - 1);
+}
+
+static inline uint32_t key_hash(size_t kl, const uint8_t* kp) {
+    return (uint32_t)(C_Hash_bytes(kp, kl) >> 32);
+}
+
+static inline bool key_equals(const uint8_t* arena, uint32_t off, size_t kl, const uint8_t* kp) {
+    size_t len;
+    size_t hl = get_length(arena + off, &len);
+
+    return len == kl && memcmp(arena + off + hl, kp, kl) == 0;
+}
+
+/*
+ * The slot holding `key`, or -1.  As in C_Ref_Table, Robin Hood
+ * hashing lets a search stop at the first key closer to home than
+ * the one it wants.
+ */
+static ssize_t find_slot(C_String_Table* self, uint32_t hash, size_t kl, const uint8_t* kp) {
+    size_t len = self->len;
+    size_t i = home_slot(hash, len);
+
+    for (size_t dist = 0; dist < len; dist++) {
+        const C_String_Slot* slot = self->slots + i;
+
+        if (slot->value == NULL || probe_distance(slot, i, len) < dist) {
+            return -1;
+        }
+        if (slot->hash == hash && key_equals(self->arena, slot->off, kl, kp)) {
+            return i;
+        }
+        i = (i + 1) & (len - 1);
+    }
+    return -1;
+}
+
+/*
+ * Insert `curr`, whose key mustn't be in `slots` already; there must
+ * be at least one empty slot.
+ */
+static void insert_slot(C_String_Slot slots[], size_t len, C_String_Slot curr) {
+    size_t i = home_slot(curr.hash, len);
+    size_t dist = 0;
+
+    while (slots[i].value != NULL) {
+        size_t d = probe_distance(slots + i, i, len);
+
+        if (d < dist) {
+            C_String_Slot tmp = slots[i];
+            slots[i] = curr;
+            curr = tmp;
+            dist = d;
+        }
+        i = (i + 1) & (len - 1);
+        dist++;
+    }
+    slots[i] = curr;
+}
+
+/*
+ * Empty slot `i` and shift the slots after it back toward home.
+ */
+static void remove_at(C_String_Slot slots[], size_t len, size_t i) {
+    size_t next = (i + 1) & (len - 1);
+
+    while (slots[next].value != NULL && probe_distance(slots + next, next, len) > 0) {
+        slots[i] = slots[next];
+        i = next;
+        next = (next + 1) & (len - 1);
+    }
+    memset(slots + i, 0, sizeof(C_String_Slot));
+}
+
+/*
+ * Move every slot to a new index of `newlen` slots.  Keys stay put.
+ */
+static bool rehash(C_String_Table* self, size_t newlen) {
+    C_String_Slot* slots = calloc(newlen, sizeof(C_String_Slot));
+
+    if (slots == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i < self->len; i++) {
+        if (self->slots[i].value != NULL) {
+            insert_slot(slots, newlen, self->slots[i]);
+        }
+    }
+    free(self->slots);
+    self->slots = slots;
+    self->len   = newlen;
+    self->resizes++;
+    self->modcount++;
+    return true;
+}
+
+/* ---------------------- Tree Functions ---------------------------------*/
+
+/*
+ * An ordered table is an adaptive radix tree (Leis et al., ICDE 2013):
+ * each inner node branches on one byte of the key, and comes in four
+ * sizes -- up to 4, 16, 48, or 256 children -- growing and shrinking
+ * with the number of children it actually has, so the tree stays dense
+ * in memory.  A run of bytes every key below a node shares is stored in
+ * the node (its prefix) rather than as a chain of one-child nodes; only
+ * the first ART_MAXPREFIX bytes are kept, and the rest are checked
+ * against the leaf a lookup finds.  A key ending at a node is that
+ * node's `leaf`.
+ *
+ * Leaves are arena records: the value, then the key's length and bytes.
+ * A reference to a child is either a node pointer or, with the low bit
+ * set, a leaf's arena offset shifted left one.
+ */
+
+static inline art_node* node_of(art_ref r) {
+    return (art_node*)r;
+}
+
+static const uint8_t* leaf_key(const C_String_Table* t, art_ref r, size_t* klp) {
+    const uint8_t* p = t->arena + leaf_off(r) + sizeof(const void*);
+
+    return p + get_length(p, klp);
+}
+
+static const void* leaf_value(const C_String_Table* t, art_ref r) {
+    const void* value;
+
+    memcpy(&value, t->arena + leaf_off(r), sizeof(const void*));
+    return value;
+}
+
+static void set_leaf_value(C_String_Table* t, art_ref r, const void* value) {
+    memcpy(t->arena + leaf_off(r), &value, sizeof(const void*));
+}
+
+static bool leaf_matches(const C_String_Table* t, art_ref r, size_t kl, const uint8_t* kp) {
+    size_t len;
+    const uint8_t* key = leaf_key(t, r, &len);
+
+    return len == kl && memcmp(key, kp, kl) == 0;
+}
+
+static size_t node_size(int type) {
+    switch (type) {
+        case NODE4:   return sizeof(art_node4);
+        case NODE16:  return sizeof(art_node16);
+        case NODE48:  return sizeof(art_node48);
+        default:      return sizeof(art_node256);
+    }
+}
+
+static size_t node_capacity(int type) {
+    switch (type) {
+        case NODE4:   return 4;
+        case NODE16:  return 16;
+        case NODE48:  return 48;
+        default:      return 256;
+    }
+}
+
+static art_node* node_new(int type) {
+    art_node* n = calloc(1, node_size(type));
+
+    if (n != NULL) {
+        n->type = (uint8_t)type;
+    }
+    return n;
+}
+
+/*
+ * A node of `type` with the same prefix and leaf as `n`, but no children.
+ */
+static art_node* node_like(int type, const art_node* n) {
+    art_node* result = node_new(type);
+
+    if (result != NULL) {
+        memcpy(result, n, sizeof(art_node));
+        result->type = (uint8_t)type;
+        result->count = 0;
+    }
+    return result;
+}
+
+static inline size_t min_size(size_t a, size_t b) {
+    return (a < b) ? a : b;
+}
+
+/*
+ * Where `n` keeps its child for byte `c`, or NULL if it has none.
+ */
+static art_ref* find_child(art_node* n, uint8_t c) {
+    switch (n->type) {
+        case NODE4: {
+            art_node4* n4 = (art_node4*)n;
+
+            for (int i = 0; i < n->count; i++) {
+                if (n4->keys[i] == c) return n4->children + i;
+            }
+            return NULL;
+        }
+        case NODE16: {
+            art_node16* n16 = (art_node16*)n;
+#if defined(__SSE2__)
+            __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8((char)c),
+                    _mm_loadu_si128((const __m128i*)n16->keys));
+            unsigned mask = (unsigned)_mm_movemask_epi8(cmp) & ((1u << n->count) - 1);
+
+            return (mask != 0) ? n16->children + __builtin_ctz(mask) : NULL;
+#else
+            for (int i = 0; i < n->count; i++) {
+                if (n16->keys[i] == c) return n16->children + i;
+            }
+            return NULL;
+#endif
+        }
+        case NODE48: {
+            art_node48* n48 = (art_node48*)n;
+
+            return (n48->index[c] != 0) ? n48->children + n48->index[c] - 1 : NULL;
+        }
+        default: {
+            art_node256* n256 = (art_node256*)n;
+
+            return (n256->children[c] != 0) ? n256->children + c : NULL;
+        }
+    }
+}
+
+/*
+ * Insert `child` in sorted arrays of `count` keys and children.
+ */
+static void sorted_insert(uint8_t keys[], art_ref children[], int count, uint8_t c, art_ref child) {
+    int i = 0;
+
+    while (i < count && keys[i] < c) {
+        i++;
+    }
+    memmove(keys + i + 1, keys + i, count - i);
+    memmove(children + i + 1, children + i, (count - i) * sizeof(art_ref));
+    keys[i] = c;
+    children[i] = child;
+}
+
+/*
+ * Give `n`, referenced from `*ref`, a child for byte `c`, moving it to
+ * a bigger node first if it's full.  Returns false if out of memory.
+ */
+static bool add_child(art_ref* ref, art_node* n, uint8_t c, art_ref child) {
+    art_node* big;
+
+    if (n->count == node_capacity(n->type)) {
+        big = node_like(n->type + 1, n);
+        if (big == NULL) {
+            return false;
+        }
+        switch (n->type) {
+            case NODE4: {
+                art_node4*  n4  = (art_node4*)n;
+                art_node16* n16 = (art_node16*)big;
+
+                memcpy(n16->keys, n4->keys, 4);
+                memcpy(n16->children, n4->children, 4 * sizeof(art_ref));
+                break;
+            }
+            case NODE16: {
+                art_node16* n16 = (art_node16*)n;
+                art_node48* n48 = (art_node48*)big;
+
+                for (int i = 0; i < 16; i++) {
+                    n48->index[n16->keys[i]] = (uint8_t)(i + 1);
+                    n48->children[i] = n16->children[i];
+                }
+                break;
+            }
+            default: {
+                art_node48*  n48  = (art_node48*)n;
+                art_node256* n256 = (art_node256*)big;
+
+                for (int i = 0; i < 256; i++) {
+                    if (n48->index[i] != 0) {
+                        n256->children[i] = n48->children[n48->index[i] - 1];
+                    }
+                }
+                break;
+            }
+        }
+        big->count = n->count;
+        free(n);
+        n = big;
+        *ref = (art_ref)n;
+    }
+
+    switch (n->type) {
+        case NODE4: {
+            art_node4* n4 = (art_node4*)n;
+            sorted_insert(n4->keys, n4->children, n->count, c, child);
+            break;
+        }
+        case NODE16: {
+            art_node16* n16 = (art_node16*)n;
+            sorted_insert(n16->keys, n16->children, n->count, c, child);
+            break;
+        }
+        case NODE48: {
+            art_node48* n48 = (art_node48*)n;
+            int i = 0;
+
+            while (n48->children[i] != 0) {
+                i++;
+            }
+            n48->children[i] = child;
+            n48->index[c] = (uint8_t)(i + 1);
+            break;
+        }
+        default:
+            ((art_node256*)n)->children[c] = child;
+            break;
+    }
+    n->count++;
+    return true;
+}
+
+/*
+ * Drop `n`'s child for byte `c`.
+ */
+static void remove_child(art_node* n, uint8_t c) {
+    switch (n->type) {
+        case NODE4:
+        case NODE16: {
+            uint8_t* keys = (n->type == NODE4) ? ((art_node4*)n)->keys : ((art_node16*)n)->keys;
+            art_ref* children = (n->type == NODE4) ? ((art_node4*)n)->children : ((art_node16*)n)->children;
+            int i = 0;
+
+            while (keys[i] != c) {
+                i++;
+            }
+            memmove(keys + i, keys + i + 1, n->count - i - 1);
+            memmove(children + i, children + i + 1, (n->count - i - 1) * sizeof(art_ref));
+            break;
+        }
+        case NODE48: {
+            art_node48* n48 = (art_node48*)n;
+
+            n48->children[n48->index[c] - 1] = 0;
+            n48->index[c] = 0;
+            break;
+        }
+        default:
+            ((art_node256*)n)->children[c] = 0;
+            break;
+    }
+    n->count--;
+}
+
+/*
+ * Any leaf under `r`; all of them share the prefixes above.
+ */
+static art_ref any_leaf(art_ref r) {
+    while (!is_leaf(r)) {
+        art_node* n = node_of(r);
+
+        if (n->leaf != 0) {
+            return n->leaf;
+        }
+        switch (n->type) {
+            case NODE4:  r = ((art_node4*)n)->children[0];  break;
+            case NODE16: r = ((art_node16*)n)->children[0]; break;
+            case NODE48: {
+                art_node48* n48 = (art_node48*)n;
+                int i = 0;
+
+                while (n48->children[i] == 0) i++;
+                r = n48->children[i];
+                break;
+            }
+            default: {
+                art_node256* n256 = (art_node256*)n;
+                int i = 0;
+
+                while (n256->children[i] == 0) i++;
+                r = n256->children[i];
+                break;
+            }
+        }
+    }
+    return r;
+}
+
+/*
+ * How many bytes of `n`'s prefix match `key` from `depth`, reading past
+ * the stored bytes in a leaf below if need be.
+ */
+static size_t prefix_match(const C_String_Table* t, art_node* n, size_t depth, size_t kl, const uint8_t* kp) {
+    size_t max = min_size(n->prefix_len, kl - depth);
+    size_t i;
+
+    for (i = 0; i < min_size(max, ART_MAXPREFIX); i++) {
+        if (n->partial[i] != kp[depth + i]) return i;
+    }
+    if (max > ART_MAXPREFIX) {
+        size_t len;
+        const uint8_t* lk = leaf_key(t, any_leaf((art_ref)n), &len);
+
+        for (; i < max; i++) {
+            if (lk[depth + i] != kp[depth + i]) return i;
+        }
+    }
+    return max;
+}
+
+static art_ref find_leaf(const C_String_Table* t, size_t kl, const uint8_t* kp) {
+    art_ref r = t->root;
+    size_t depth = 0;
+
+    while (r != 0 && !is_leaf(r)) {
+        art_node* n = node_of(r);
+        art_ref* child;
+
+        // Check only the stored prefix; the leaf's key settles the rest
+        if (n->prefix_len > kl - depth) {
+            return 0;
+        }
+        for (size_t i = 0; i < min_size(n->prefix_len, ART_MAXPREFIX); i++) {
+            if (n->partial[i] != kp[depth + i]) return 0;
+        }
+        depth += n->prefix_len;
+
+        if (depth == kl) {
+            r = n->leaf;
+            break;
+        }
+        child = find_child(n, kp[depth]);
+        if (child == NULL) {
+            return 0;
+        }
+        r = *child;
+        depth++;
+    }
+    return (r != 0 && leaf_matches(t, r, kl, kp)) ? r : 0;
+}
+
+/*
+ * Hang the leaf `leaf` for key `kp` off new node `n`, whose prefix ends
+ * at `depth`.
+ */
+static bool attach_leaf(art_ref* ref, art_node* n, size_t depth, size_t kl, const uint8_t* kp, art_ref leaf) {
+    if (depth == kl) {
+        n->leaf = leaf;
+        return true;
+    }
+    return add_child(ref, n, kp[depth], leaf);
+}
+
+/*
+ * Insert `leaf`, for key `kp`, which is not in the tree, below `*ref`
+ * at `depth`.  Returns false if out of memory, leaving the tree as it was.
+ */
+static bool tree_insert(C_String_Table* t, art_ref* ref, size_t depth, size_t kl, const uint8_t* kp, art_ref leaf) {
+    art_node* n;
+    art_ref*  child;
+
+    if (*ref == 0) {
+        *ref = leaf;
+        return true;
+    }
+
+    if (is_leaf(*ref)) {
+        // Split the leaf into a node over both keys
+        size_t         len;
+        const uint8_t* lk = leaf_key(t, *ref, &len);
+        size_t         lcp = depth;
+        art_ref        node;
+
+        while (lcp < len && lcp < kl && lk[lcp] == kp[lcp]) {
+            lcp++;
+        }
+        n = node_new(NODE4);
+        if (n == NULL) {
+            return false;
+        }
+        n->prefix_len = (uint32_t)(lcp - depth);
+        memcpy(n->partial, kp + depth, min_size(lcp - depth, ART_MAXPREFIX));
+        node = (art_ref)n;
+
+        // A new NODE4 has room for both, so neither can fail
+        attach_leaf(&node, n, lcp, len, lk, *ref);
+        attach_leaf(&node, n, lcp, kl, kp, leaf);
+        *ref = node;
+        return true;
+    }
+
+    n = node_of(*ref);
+    if (n->prefix_len > 0) {
+        size_t p = prefix_match(t, n, depth, kl, kp);
+
+        if (p < n->prefix_len) {
+            // Split the prefix: a new node branches where the keys differ
+            art_node* top = node_new(NODE4);
+            art_ref   node = (art_ref)top;
+            uint8_t   c;
+
+            if (top == NULL) {
+                return false;
+            }
+            top->prefix_len = (uint32_t)p;
+            memcpy(top->partial, n->partial, min_size(p, ART_MAXPREFIX));
+
+            if (n->prefix_len <= ART_MAXPREFIX) {
+                c = n->partial[p];
+                n->prefix_len -= (uint32_t)(p + 1);
+                memmove(n->partial, n->partial + p + 1, n->prefix_len);
+            } else {
+                size_t len;
+                const uint8_t* lk = leaf_key(t, any_leaf(*ref), &len);
+
+                c = lk[depth + p];
+                n->prefix_len -= (uint32_t)(p + 1);
+                memcpy(n->partial, lk + depth + p + 1, min_size(n->prefix_len, ART_MAXPREFIX));
+            }
+            add_child(&node, top, c, *ref);
+            attach_leaf(&node, top, depth + p, kl, kp, leaf);
+            *ref = node;
+            return true;
+        }
+        depth += n->prefix_len;
+    }
+
+    if (depth == kl) {
+        n->leaf = leaf;
+        return true;
+    }
+    child = find_child(n, kp[depth]);
+    if (child != NULL) {
+        return tree_insert(t, child, depth + 1, kl, kp, leaf);
+    }
+    return add_child(ref, n, kp[depth], leaf);
 }
 
+/*
+ * Move `n`, referenced from `*ref`, to a smaller node if it's sparse
+ * enough, or replace it with its one remaining child or leaf.
+ */
+static void shrink_node(art_ref* ref, art_node* n) {
+    art_node* small = NULL;
+
+    switch (n->type) {
+        case NODE4: {
+            art_node4* n4 = (art_node4*)n;
+            art_ref    only;
+            uint8_t    c;
+
+            if (n->count == 0) {
+                *ref = n->leaf;
+                free(n);
+                return;
+            }
+            if (n->count > 1 || n->leaf != 0) {
+                return;
+            }
+
+            // One child and no leaf: fold this node into the child
+            only = n4->children[0];
+            c = n4->keys[0];
+            if (!is_leaf(only)) {
+                art_node* child = node_of(only);
+                uint8_t   buf[ART_MAXPREFIX];
+                size_t    i = min_size(n->prefix_len, ART_MAXPREFIX);
+
+                memcpy(buf, n->partial, i);
+                if (i < ART_MAXPREFIX) {
+                    buf[i++] = c;
+                }
+                if (i < ART_MAXPREFIX) {
+                    size_t m = min_size(min_size(child->prefix_len, ART_MAXPREFIX), ART_MAXPREFIX - i);
+
+                    memcpy(buf + i, child->partial, m);
+                    i += m;
+                }
+                child->prefix_len += n->prefix_len + 1;
+                memcpy(child->partial, buf, i);
+            }
+            *ref = only;
+            free(n);
+            return;
+        }
+        case NODE16:
+            if (n->count <= 3) {
+                art_node16* n16 = (art_node16*)n;
+                art_node4*  n4;
+
+                small = node_like(NODE4, n);
+                if (small == NULL) return;
+                n4 = (art_node4*)small;
+                memcpy(n4->keys, n16->keys, n->count);
+                memcpy(n4->children, n16->children, n->count * sizeof(art_ref));
+            }
+            break;
+        case NODE48:
+            if (n->count <= 12) {
+                art_node48* n48 = (art_node48*)n;
+                art_node16* n16;
+                int j = 0;
+
+                small = node_like(NODE16, n);
+                if (small == NULL) return;
+                n16 = (art_node16*)small;
+                for (int c = 0; c < 256; c++) {
+                    if (n48->index[c] != 0) {
+                        n16->keys[j] = (uint8_t)c;
+                        n16->children[j++] = n48->children[n48->index[c] - 1];
+                    }
+                }
+            }
+            break;
+        default:
+            if (n->count <= 37) {
+                art_node256* n256 = (art_node256*)n;
+                art_node48*  n48;
+                int j = 0;
+
+                small = node_like(NODE48, n);
+                if (small == NULL) return;
+                n48 = (art_node48*)small;
+                for (int c = 0; c < 256; c++) {
+                    if (n256->children[c] != 0) {
+                        n48->children[j] = n256->children[c];
+                        n48->index[c] = (uint8_t)(++j);
+                    }
+                }
+            }
+            break;
+    }
+    if (small != NULL) {
+        small->count = n->count;
+        free(n);
+        *ref = (art_ref)small;
+    }
+}
+
+/*
+ * Remove the leaf for `kp` from below `*ref` at `depth`, and return it,
+ * or 0 if it isn't there.
+ */
+static art_ref tree_remove(C_String_Table* t, art_ref* ref, size_t depth, size_t kl, const uint8_t* kp) {
+    art_node* n;
+    art_ref*  child;
+    art_ref   leaf;
+
+    if (*ref == 0) {
+        return 0;
+    }
+    if (is_leaf(*ref)) {
+        leaf = *ref;
+        if (!leaf_matches(t, leaf, kl, kp)) {
+            return 0;
+        }
+        *ref = 0;
+        return leaf;
+    }
+
+    n = node_of(*ref);
+    if (prefix_match(t, n, depth, kl, kp) < n->prefix_len) {
+        return 0;
+    }
+    depth += n->prefix_len;
+
+    if (depth == kl) {
+        leaf = n->leaf;
+        if (leaf == 0 || !leaf_matches(t, leaf, kl, kp)) {
+            return 0;
+        }
+        n->leaf = 0;
+        shrink_node(ref, n);
+        return leaf;
+    }
+
+    child = find_child(n, kp[depth]);
+    if (child == NULL) {
+        return 0;
+    }
+    if (is_leaf(*child)) {
+        leaf = *child;
+        if (!leaf_matches(t, leaf, kl, kp)) {
+            return 0;
+        }
+        remove_child(n, kp[depth]);
+        shrink_node(ref, n);
+        return leaf;
+    }
+    return tree_remove(t, child, depth + 1, kl, kp);
+}
+
+/*
+ * Call `f` with where each leaf under `*ref` is referenced from, in key
+ * order: a node's own leaf, then its children by byte.  Stops, and
+ * returns false, as soon as `f` does.
+ */
+static bool walk_leaves(C_String_Table* t, art_ref* ref, art_leaf_fcn f, void* data) {
+    art_node* n;
+
+    if (*ref == 0) {
+        return true;
+    }
+    if (is_leaf(*ref)) {
+        return f(t, ref, data);
+    }
+
+    n = node_of(*ref);
+    if (n->leaf != 0 && !f(t, &n->leaf, data)) {
+        return false;
+    }
+    switch (n->type) {
+        case NODE4:
+        case NODE16: {
+            art_ref* children = (n->type == NODE4) ? ((art_node4*)n)->children : ((art_node16*)n)->children;
+
+            for (int i = 0; i < n->count; i++) {
+                if (!walk_leaves(t, children + i, f, data)) return false;
+            }
+            break;
+        }
+        case NODE48: {
+            art_node48* n48 = (art_node48*)n;
+
+            for (int c = 0; c < 256; c++) {
+                if (n48->index[c] != 0
+                        && !walk_leaves(t, n48->children + n48->index[c] - 1, f, data)) {
+                    return false;
+                }
+            }
+            break;
+        }
+        default: {
+            art_node256* n256 = (art_node256*)n;
+
+            for (int c = 0; c < 256; c++) {
+                if (!walk_leaves(t, n256->children + c, f, data)) return false;
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+/*
+ * The child of `n` on the smallest byte after `c`, or NULL if none;
+ * a `c` of -1 finds the first child.
+ */
+static art_ref* child_after(art_node* n, int c) {
+    switch (n->type) {
+        case NODE4: {
+            art_node4* n4 = (art_node4*)n;
+
+            for (int i = 0; i < n->count; i++) {
+                if (n4->keys[i] > c) return n4->children + i;
+            }
+            return NULL;
+        }
+        case NODE16: {
+            art_node16* n16 = (art_node16*)n;
+
+            for (int i = 0; i < n->count; i++) {
+                if (n16->keys[i] > c) return n16->children + i;
+            }
+            return NULL;
+        }
+        case NODE48: {
+            art_node48* n48 = (art_node48*)n;
+
+            for (int b = c + 1; b < 256; b++) {
+                if (n48->index[b] != 0) return n48->children + n48->index[b] - 1;
+            }
+            return NULL;
+        }
+        default: {
+            art_node256* n256 = (art_node256*)n;
+
+            for (int b = c + 1; b < 256; b++) {
+                if (n256->children[b] != 0) return n256->children + b;
+            }
+            return NULL;
+        }
+    }
+}
+
+/* The leaf under `r` with the smallest key */
+static art_ref first_leaf(art_ref r) {
+    while (r != 0 && !is_leaf(r)) {
+        art_node* n = node_of(r);
+
+        if (n->leaf != 0) {
+            return n->leaf;
+        }
+        r = *child_after(n, -1);
+    }
+    return r;
+}
+
+/* Whether key `a` sorts before key `b` */
+static bool key_before(size_t al, const uint8_t* ap, size_t bl, const uint8_t* bp) {
+    int cmp = memcmp(ap, bp, min_size(al, bl));
+
+    return cmp < 0 || (cmp == 0 && al < bl);
+}
+
+/*
+ * The leaf under `r` with the smallest key after `key`, or 0 if none.
+ * Every key under `r` matches `key` for its first `depth` bytes.
+ * This lets an iterator walk a tree in order with no stack but the
+ * call stack: each step is one more descent from the root.
+ */
+static art_ref tree_next(const C_String_Table* t, art_ref r, size_t depth, size_t kl, const uint8_t* kp) {
+    const uint8_t* lkp;
+    size_t lkl;
+    art_node* n;
+    art_ref* child;
+
+    if (r == 0) {
+        return 0;
+    }
+    if (is_leaf(r)) {
+        lkp = leaf_key(t, r, &lkl);
+        return key_before(kl, kp, lkl, lkp) ? r : 0;
+    }
+
+    // Compare `key` with the node's whole prefix, as a leaf below has it
+    n = node_of(r);
+    lkp = leaf_key(t, any_leaf(r), &lkl);
+    for (size_t i = 0; i < n->prefix_len; i++) {
+        if (depth + i == kl || kp[depth + i] < lkp[depth + i]) {
+            return first_leaf(r);
+        }
+        if (kp[depth + i] > lkp[depth + i]) {
+            return 0;
+        }
+    }
+    depth += n->prefix_len;
+
+    // The node's own leaf is `key` or a prefix of it, so never after it
+    if (depth == kl) {
+        child = child_after(n, -1);
+    } else {
+        child = find_child(n, kp[depth]);
+        if (child != NULL) {
+            art_ref next = tree_next(t, *child, depth + 1, kl, kp);
+
+            if (next != 0) {
+                return next;
+            }
+        }
+        child = child_after(n, kp[depth]);
+    }
+    return (child != NULL) ? first_leaf(*child) : 0;
+}
+
+static void tree_free(art_ref r) {
+    art_node* n;
+
+    if (r == 0 || is_leaf(r)) {
+        return;
+    }
+    n = node_of(r);
+    switch (n->type) {
+        case NODE4:
+            for (int i = 0; i < n->count; i++) tree_free(((art_node4*)n)->children[i]);
+            break;
+        case NODE16:
+            for (int i = 0; i < n->count; i++) tree_free(((art_node16*)n)->children[i]);
+            break;
+        case NODE48:
+            for (int i = 0; i < 48; i++) tree_free(((art_node48*)n)->children[i]);
+            break;
+        default:
+            for (int i = 0; i < 256; i++) tree_free(((art_node256*)n)->children[i]);
+            break;
+    }
+    free(n);
+}
+
+/*
+ * Add up `stats` for the nodes under `r`, `depth` nodes down.
+ */
+static void tree_stats(art_ref r, size_t depth, C_Hash_Stats* stats) {
+    art_node* n;
+
+    if (r == 0) {
+        return;
+    }
+    if (is_leaf(r)) {
+        C_Hash_Stats_add_probe(stats, depth);
+        return;
+    }
+    n = node_of(r);
+    stats->buckets  += node_capacity(n->type);
+    stats->occupied += n->count;
+    stats->bytes    += node_size(n->type);
+    if (n->leaf != 0) {
+        C_Hash_Stats_add_probe(stats, depth + 1);
+    }
+    switch (n->type) {
+        case NODE4:
+            for (int i = 0; i < n->count; i++) tree_stats(((art_node4*)n)->children[i], depth + 1, stats);
+            break;
+        case NODE16:
+            for (int i = 0; i < n->count; i++) tree_stats(((art_node16*)n)->children[i], depth + 1, stats);
+            break;
+        case NODE48:
+            for (int i = 0; i < 48; i++) tree_stats(((art_node48*)n)->children[i], depth + 1, stats);
+            break;
+        default:
+            for (int i = 0; i < 256; i++) tree_stats(((art_node256*)n)->children[i], depth + 1, stats);
+            break;
+    }
+}
+
+/* ---------------------- Frozen Functions -------------------------------*/
+
+/*
+ * A frozen table finds keys with a minimal perfect hash in the style of
+ * CHD and PTHash.  A key's 64-bit hash picks a bucket, and the bucket's
+ * pilot, chosen when freezing so that no two keys collide, scrambles the
+ * hash into the key's one slot.  A lookup reads one pilot and one slot,
+ * compares one key, and writes nothing.
+ */
+
+/* The SplitMix64 finalizer; every output bit depends on every input bit */
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Map the top 32 bits of `x` onto 0 .. `n`-1 without dividing */
+static inline size_t fast_range(uint64_t x, size_t n) {
+    return (size_t)(((x >> 32) * (uint64_t)n) >> 32);
+}
+
+static inline size_t frozen_bucket(uint64_t h, size_t nbuckets) {
+    return fast_range(h, nbuckets);
+}
+
+static inline size_t frozen_slot(uint64_t h, uint32_t pilot, size_t n) {
+    return fast_range(mix(h ^ ((uint64_t)pilot * 0x9E3779B97F4A7C15ULL)), n);
+}
+
+/*
+ * Slots past `n` a frozen table's hash places keys in.  Leaving a few
+ * spare keeps the last buckets from needing ~n tries each for the one
+ * slot left.  Keys placed past `n` are remapped below it afterwards.
+ */
+static inline size_t frozen_extra(size_t n) {
+    return n / 100 + 1;
+}
+
+/* Words in a frozen table's block of pilots followed by its remap */
+static inline size_t frozen_words(size_t n, size_t nbuckets) {
+    return nbuckets + frozen_extra(n);
+}
+
+static ssize_t find_frozen(C_String_Table* self, size_t kl, const uint8_t* kp) {
+    uint64_t h;
+    size_t i;
+    const C_String_Slot* slot;
+
+    if (self->nentries == 0) {
+        return -1;
+    }
+    h = C_Hash_bytes_seeded(kp, kl, self->seed);
+    i = frozen_slot(h, self->pilots[frozen_bucket(h, self->nbuckets)],
+            self->nentries + frozen_extra(self->nentries));
+    if (i >= self->nentries) {
+        i = self->remap[i - self->nentries];
+    }
+    slot = self->slots + i;
+
+    if (slot->hash == (uint32_t)(h >> 32) && key_equals(self->arena, slot->off, kl, kp)) {
+        return i;
+    }
+    return -1;
+}
+
+/*
+ * Try to place every key in `order` (grouped by bucket, biggest buckets
+ * first, bucket `b` starting at `start[b]`) with pilots among `m` slots,
+ * filling `pilots` and `pos`.  Fails if some bucket has no pilot that
+ * works.
+ */
+static bool place_keys(size_t m, size_t nbuckets, const uint64_t hashes[],
+                       const size_t order[], const size_t border[],
+                       const size_t start[], uint32_t pilots[],
+                       size_t pos[], uint8_t taken[]) {
+    memset(taken, 0, m);
+
+    for (size_t bi = 0; bi < nbuckets; bi++) {
+        size_t b = border[bi];
+        size_t first = start[b];
+        size_t count = start[b + 1] - first;
+        uint32_t pilot;
+
+        if (count == 0) {
+            pilots[b] = 0;
+            continue;
+        }
+        for (pilot = 0; pilot < MAXPILOT; pilot++) {
+            size_t k;
+
+            for (k = 0; k < count; k++) {
+                size_t i = order[first + k];
+                size_t p = frozen_slot(hashes[i], pilot, m);
+
+                if (taken[p]) break;
+                taken[p] = 1;
+                pos[i] = p;
+            }
+            if (k == count) break;
+
+            // Undo this bucket's claims and try the next pilot
+            while (k-- > 0) {
+                taken[pos[order[first + k]]] = 0;
+            }
+        }
+        if (pilot == MAXPILOT) {
+            return false;
+        }
+        pilots[b] = pilot;
+    }
+    return true;
+}
+
+FMC_API bool C_String_Table_freeze(C_String_Table* t) {
+    size_t    n;
+    size_t    m;
+    size_t    nbuckets;
+    uint64_t  seed;
+    bool      placed = false;
+    size_t    j = 0;
+
+    C_String_Slot* live  = NULL;
+    C_String_Slot* slots = NULL;
+    uint64_t* hashes = NULL;
+    size_t*   order  = NULL;
+    size_t*   border = NULL;
+    size_t*   start  = NULL;
+    size_t*   pos    = NULL;
+    uint32_t* pilots = NULL;
+    uint32_t* remap  = NULL;
+    uint8_t*  taken  = NULL;
+
+    if (t == NULL) return false;
+    if (t->frozen) return true;
+
+    // Squeeze out removed keys and spare room; the keys stay put after this
+    if (t->arenalen > 0) {
+        uint8_t* arena;
+
+        if (t->dead > 0 && !arena_compact(t, 0)) {
+            return false;
+        }
+        arena = realloc(t->arena, t->arenalen);
+        if (arena != NULL) {
+            t->arena = arena;
+            t->arenacap = t->arenalen;
+        }
+    }
+
+    // A tree's lookups already write nothing and probe once per node
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        t->frozen = true;
+        return true;
+    }
+
+    n = t->nentries;
+    m = n + frozen_extra(n);
+    nbuckets = n / FROZENLOAD + 1;
+
+    live   = malloc((n + 1) * sizeof(C_String_Slot));
+    slots  = malloc((n + 1) * sizeof(C_String_Slot));
+    hashes = malloc((n + 1) * sizeof(uint64_t));
+    order  = malloc((n + 1) * sizeof(size_t));
+    pos    = malloc((n + 1) * sizeof(size_t));
+    taken  = malloc(m);
+    border = malloc(nbuckets * sizeof(size_t));
+    start  = calloc(nbuckets + 1, sizeof(size_t));
+    pilots = malloc(frozen_words(n, nbuckets) * sizeof(uint32_t));
+    if (!live || !slots || !hashes || !order || !pos || !taken
+            || !border || !start || !pilots) {
+        goto done;
+    }
+
+    for (size_t i = 0; i < t->len; i++) {
+        if (t->slots[i].value != NULL) {
+            live[j++] = t->slots[i];
+        }
+    }
+
+    // Hashed from the process's seed rather than equal to it, since
+    // C_String_Table_save() writes the seed out for anyone to read
+    seed = C_Hash_bytes(&t, sizeof(t));
+    for (int tries = 0; tries < MAXSEEDS && !placed; tries++) {
+        size_t maxsize = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            size_t kl;
+            size_t hl = get_length(t->arena + live[i].off, &kl);
+
+            hashes[i] = C_Hash_bytes_seeded(t->arena + live[i].off + hl, kl, seed);
+        }
+
+        // Counting sort: keys by bucket, then buckets by size, biggest first
+        memset(start, 0, (nbuckets + 1) * sizeof(size_t));
+        for (size_t i = 0; i < n; i++) {
+            start[frozen_bucket(hashes[i], nbuckets) + 1]++;
+        }
+        for (size_t b = 0; b < nbuckets; b++) {
+            if (start[b + 1] > maxsize) maxsize = start[b + 1];
+            start[b + 1] += start[b];
+        }
+        for (size_t b = 0; b < nbuckets; b++) {
+            border[b] = start[b];
+        }
+        for (size_t i = 0; i < n; i++) {
+            order[border[frozen_bucket(hashes[i], nbuckets)]++] = i;
+        }
+        j = 0;
+        for (size_t size = maxsize + 1; size-- > 0; ) {
+            for (size_t b = 0; b < nbuckets; b++) {
+                if (start[b + 1] - start[b] == size) {
+                    border[j++] = b;
+                }
+            }
+        }
+
+        placed = place_keys(m, nbuckets, hashes, order, border, start, pilots, pos, taken);
+        if (!placed) {
+            seed = mix(seed + 1);
+        }
+    }
+    if (!placed) {
+        goto done;
+    }
+
+    // Each key placed past `n` leaves a slot below `n` empty; pair them
+    // up, and leave the spare slots pointing anywhere valid
+    remap = pilots + nbuckets;
+    j = 0;
+    for (size_t p = n; p < m; p++) {
+        remap[p - n] = 0;
+        if (taken[p]) {
+            while (taken[j]) j++;
+            taken[j] = 1;
+            remap[p - n] = (uint32_t)j;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t p = (pos[i] < n) ? pos[i] : remap[pos[i] - n];
+
+        slots[p] = live[i];
+        slots[p].hash = (uint32_t)(hashes[i] >> 32);
+    }
+
+    free(t->slots);
+    t->slots    = slots;
+    t->len      = n;
+    t->pilots   = pilots;
+    t->nbuckets = nbuckets;
+    t->remap    = remap;
+    t->seed     = seed;
+    t->frozen   = true;
+    t->modcount++;
+    slots  = NULL;
+    pilots = NULL;
+
+done:
+    free(live);
+    free(slots);
+    free(hashes);
+    free(order);
+    free(pos);
+    free(taken);
+    free(border);
+    free(start);
+    free(pilots);
+    return t->frozen;
+}
+
+FMC_API bool C_String_Table_is_frozen(C_String_Table* t) {
+    return t != NULL && t->frozen;
+}
+
+/* ---------------------- Table Functions --------------------------------*/
+
+static inline const void* slot_value(const C_String_Table* t, const C_String_Slot* slot) {
+    return (t->blobs != NULL) ? t->blobs + (uintptr_t)slot->value : slot->value;
+}
+
+FMC_API const void* C_String_Table_get(C_String_Table* t, size_t kl, const uint8_t* kp) {
+    ssize_t index;
+
+    if (kp == NULL) {
+        return NULL;
+    }
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        art_ref leaf = find_leaf(t, kl, kp);
+        return (leaf != 0) ? leaf_value(t, leaf) : NULL;
+    }
+    index = t->frozen ? find_frozen(t, kl, kp) : find_slot(t, key_hash(kl, kp), kl, kp);
+    return (index >= 0) ? slot_value(t, t->slots + index) : NULL;
+}
+
+FMC_API bool C_String_Table_has(C_String_Table* t, size_t kl, const uint8_t* kp) {
+    if (kp == NULL) {
+        return false;
+    }
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        return find_leaf(t, kl, kp) != 0;
+    }
+    if (t->frozen) {
+        return find_frozen(t, kl, kp) >= 0;
+    }
+    return find_slot(t, key_hash(kl, kp), kl, kp) >= 0;
+}
+
+static bool tree_add(C_String_Table* t, size_t kl, const uint8_t* kp, const void* v) {
+    uint32_t off;
+
+    if (find_leaf(t, kl, kp) != 0) {
+        return false;
+    }
+    if (!arena_append(t, kl, kp, &off)) {
+        return false;
+    }
+    if (!tree_insert(t, &t->root, 0, kl, kp, leaf_ref(off))) {
+        t->dead += record_size(t, off);
+        return false;
+    }
+    set_leaf_value(t, leaf_ref(off), v);
+    t->nentries++;
+    t->modcount++;
+    return true;
+}
+
+/*
+ * Add a key that isn't in the hashed index yet.
+ */
+static bool add_slot(C_String_Table* t, uint32_t hash, size_t kl, const uint8_t* kp, const void* v) {
+    C_String_Slot slot;
+
+    // Always leave an empty slot to end probes
+    if (t->nentries + 1 > t->len * TBLLOAD) {
+        if (!rehash(t, t->len * 2)) {
+            return false;
+        }
+    }
+    if (!arena_append(t, kl, kp, &slot.off)) {
+        return false;
+    }
+    slot.hash  = hash;
+    slot.value = v;
+    insert_slot(t->slots, t->len, slot);
+    t->nentries++;
+    t->modcount++;
+    return true;
+}
+
+FMC_API bool C_String_Table_add(C_String_Table* t, size_t kl, const uint8_t* kp, const void* v) {
+    uint32_t hash;
+
+    if (kp == NULL || v == NULL || t->frozen) {
+        return false;
+    }
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        return tree_add(t, kl, kp, v);
+    }
+
+    hash = key_hash(kl, kp);
+    if (find_slot(t, hash, kl, kp) >= 0) {
+        return false;
+    }
+    return add_slot(t, hash, kl, kp, v);
+}
+
+FMC_API bool C_String_Table_put(C_String_Table* t, size_t kl, const uint8_t* kp, const void* v, const void* *oldvalp) {
+    ssize_t index;
+    uint32_t hash;
+
+    if (oldvalp) {
+        *oldvalp = NULL;
+    }
+    if (kp == NULL || t->frozen) {
+        return false;
+    }
+    if (v == NULL) {
+        C_String_Table_remove(t, kl, kp, oldvalp);
+        return true;
+    }
+
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        art_ref leaf = find_leaf(t, kl, kp);
+
+        if (leaf == 0) {
+            return tree_add(t, kl, kp, v);
+        }
+        if (oldvalp) {
+            *oldvalp = leaf_value(t, leaf);
+        }
+        set_leaf_value(t, leaf, v);
+        return true;
+    }
+
+    hash = key_hash(kl, kp);
+    index = find_slot(t, hash, kl, kp);
+    if (index < 0) {
+        return add_slot(t, hash, kl, kp, v);
+    }
+    if (oldvalp) {
+        *oldvalp = t->slots[index].value;
+    }
+    t->slots[index].value = v;
+    return true;
+}
+
+FMC_API bool C_String_Table_reserve(C_String_Table* t, size_t n) {
+    size_t newlen;
+
+    if (t == NULL || t->frozen) {
+        return false;
+    }
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        return true;
+    }
+    newlen = capacity_for(n);
+    return newlen <= t->len || rehash(t, newlen);
+}
+
+FMC_API size_t C_String_Table_add_many(C_String_Table* t, size_t n, const size_t keylens[], const uint8_t* keys[], const void* values[]) {
+    uint32_t hashes[BATCHSIZ];
+    size_t need = 0;
+    size_t count = 0;
+
+    if (t == NULL || t->frozen || n == 0) {
+        return 0;
+    }
+
+    // Resize the index and the arena once up front rather than every so
+    // often.  Some keys may already be here, so leave at most one doubling
+    // of the index to add().  If the arena can't grow, add() will say so.
+    C_String_Table_reserve(t, (n > t->nentries) ? n : t->nentries);
+    for (size_t i = 0; i < n; i++) {
+        need += record_head(t) + length_size(keylens[i]) + keylens[i];
+    }
+    arena_reserve(t, need);
+
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        for (size_t i = 0; i < n; i++) {
+            if (C_String_Table_add(t, keylens[i], keys[i], values[i])) {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // Hash a batch of keys and prefetch their home slots, then insert them
+    for (size_t first = 0; first < n; first += BATCHSIZ) {
+        size_t batch = min_size(n - first, BATCHSIZ);
+
+        for (size_t j = 0; j < batch; j++) {
+            if (keys[first + j] != NULL) {
+                hashes[j] = key_hash(keylens[first + j], keys[first + j]);
+                prefetch(t->slots + home_slot(hashes[j], t->len));
+            }
+        }
+        for (size_t j = 0; j < batch; j++) {
+            size_t i = first + j;
+
+            if (keys[i] == NULL || values[i] == NULL
+                    || find_slot(t, hashes[j], keylens[i], keys[i]) >= 0) {
+                continue;
+            }
+            if (add_slot(t, hashes[j], keylens[i], keys[i], values[i])) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+FMC_API bool C_String_Table_remove(C_String_Table* t, size_t kl, const uint8_t* kp, const void* *oldvalp) {
+    ssize_t index;
+    uint32_t off;
+
+    if (oldvalp) {
+        *oldvalp = NULL;
+    }
+    if (kp == NULL || t->frozen) {
+        return false;
+    }
+
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        art_ref leaf = tree_remove(t, &t->root, 0, kl, kp);
+
+        if (leaf == 0) {
+            return false;
+        }
+        if (oldvalp) {
+            *oldvalp = leaf_value(t, leaf);
+        }
+        off = leaf_off(leaf);
+    } else {
+        index = find_slot(t, key_hash(kl, kp), kl, kp);
+        if (index < 0) {
+            return false;
+        }
+        if (oldvalp) {
+            *oldvalp = t->slots[index].value;
+        }
+        off = t->slots[index].off;
+        remove_at(t->slots, t->len, index);
+    }
+
+    t->dead += record_size(t, off);
+    t->nentries--;
+    t->modcount++;
+
+    // With no keys left, the whole arena is free
+    if (t->nentries == 0) {
+        t->arenalen = 0;
+        t->dead = 0;
+    }
+    return true;
+}
+
+/* -------------------- Visiting Functions ------------------------- */
+
+typedef struct visit {
+    C_String_Table_Visitor f;
+    void*  data;
+    size_t count;
+
+    /* only keys starting with these bytes */
+    size_t         plen;
+    const uint8_t* prefix;
+} C_Visit;
+
+static bool visit_key(C_Visit* v, size_t kl, const uint8_t* kp, const void* value) {
+    if (kl < v->plen || memcmp(kp, v->prefix, v->plen) != 0) {
+        return true;
+    }
+    v->count++;
+    return v->f(kl, kp, value, v->data);
+}
+
+static bool visit_leaf(C_String_Table* t, art_ref* ref, void* data) {
+    size_t kl;
+    const uint8_t* kp = leaf_key(t, *ref, &kl);
+
+    return visit_key((C_Visit*)data, kl, kp, leaf_value(t, *ref));
+}
+
+/*
+ * The subtree holding every key that starts with `prefix`, or NULL if
+ * there are none.  Since each node's prefix is checked against a leaf's
+ * key, every key under the result starts with `prefix`.
+ */
+static art_ref* find_prefix(C_String_Table* t, size_t plen, const uint8_t* prefix) {
+    art_ref* ref = &t->root;
+    size_t depth = 0;
+
+    while (*ref != 0 && !is_leaf(*ref) && depth < plen) {
+        art_node* n = node_of(*ref);
+        size_t p = prefix_match(t, n, depth, plen, prefix);
+
+        if (p < n->prefix_len && depth + p < plen) {
+            return NULL;
+        }
+        depth += n->prefix_len;
+        if (depth >= plen) {
+            break;
+        }
+        ref = find_child(n, prefix[depth]);
+        if (ref == NULL) {
+            return NULL;
+        }
+        depth++;
+    }
+    return (*ref != 0) ? ref : NULL;
+}
+
+static size_t visit_keys(C_String_Table* t, size_t plen, const uint8_t* prefix, C_String_Table_Visitor f, void* data) {
+    C_Visit v = { f, data, 0, plen, prefix };
+
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        art_ref* ref = find_prefix(t, plen, prefix);
+
+        if (ref != NULL) {
+            walk_leaves(t, ref, visit_leaf, &v);
+        }
+        return v.count;
+    }
+
+    for (size_t i = 0; i < t->len; i++) {
+        const C_String_Slot* slot = t->slots + i;
+
+        if (slot->value != NULL) {
+            size_t kl;
+            const uint8_t* kp = t->arena + slot->off;
+
+            kp += get_length(kp, &kl);
+            if (!visit_key(&v, kl, kp, slot_value(t, slot))) {
+                break;
+            }
+        }
+    }
+    return v.count;
+}
+
+FMC_API size_t C_String_Table_for_each(C_String_Table* t, C_String_Table_Visitor f, void* data) {
+    if (t == NULL || f == NULL) return 0;
+
+    return visit_keys(t, 0, (const uint8_t*)"", f, data);
+}
+
+FMC_API size_t C_String_Table_prefix_scan(C_String_Table* t, size_t plen, const uint8_t* prefix, C_String_Table_Visitor f, void* data) {
+    if (t == NULL || f == NULL || (prefix == NULL && plen > 0)) return 0;
+
+    return visit_keys(t, plen, (prefix != NULL) ? prefix : (const uint8_t*)"", f, data);
+}
+
+/* -------------------- Iterator Functions ------------------------- */
+
+/*
+ * An iterator's place is a slot's index in a hashed table, or a leaf
+ * in an ordered one; SIZE_MAX means there is none.
+ */
+static size_t iter_next(C_String_Table* t, size_t pos) {
+    if (t->layout == C_STRING_TABLE_ORDERED) {
+        art_ref next;
+
+        if (pos == SIZE_MAX) {
+            next = first_leaf(t->root);
+        } else {
+            size_t kl;
+            const uint8_t* kp = leaf_key(t, (art_ref)pos, &kl);
+
+            next = tree_next(t, t->root, 0, kl, kp);
+        }
+        return (next != 0) ? (size_t)next : SIZE_MAX;
+    }
+
+    for (size_t i = (pos == SIZE_MAX) ? 0 : pos + 1; i < t->len; i++) {
+        if (t->slots[i].value != NULL) {
+            return i;
+        }
+    }
+    return SIZE_MAX;
+}
+
+FMC_API void C_String_Table_Iterator_init(C_String_Table* t, C_String_Table_Iterator* i) {
+    if (i == NULL) return;
+
+    memset(i, 0, sizeof(C_String_Table_Iterator));
+    i->curr = SIZE_MAX;
+    i->next = SIZE_MAX;
+    if (t == NULL) return;
+
+    i->table    = t;
+    i->modcount = t->modcount;
+    i->next     = iter_next(t, SIZE_MAX);
+}
+
+FMC_API void C_String_Table_new_iterator(C_String_Table* t, C_String_Table_Iterator* *iptr) {
+    C_String_Table_Iterator* result;
+
+    if (t == NULL || iptr == NULL) return;
+
+    result = (C_String_Table_Iterator*)malloc(sizeof(C_String_Table_Iterator));
+    if (result == NULL) return;
+
+    C_String_Table_Iterator_init(t, result);
+
+    *iptr = result;
+}
+
+FMC_API bool C_String_Table_Iterator_has_failed(C_String_Table_Iterator* i) {
+    return i->table != NULL && i->table->modcount != i->modcount;
+}
+
+FMC_API bool C_String_Table_Iterator_has_next(C_String_Table_Iterator* i) {
+    return i->table != NULL && i->next != SIZE_MAX
+        && !C_String_Table_Iterator_has_failed(i);
+}
+
+FMC_API void C_String_Table_Iterator_next(C_String_Table_Iterator* i) {
+    if (!C_String_Table_Iterator_has_next(i)) {
+        i->curr = SIZE_MAX;
+        i->next = SIZE_MAX;
+        return;
+    }
+    i->curr = i->next;
+    i->next = iter_next(i->table, i->curr);
+}
+
+/*
+ * Whether `i` is on a live entry of an unchanged table.
+ */
+static bool on_entry(C_String_Table_Iterator* i) {
+    return i->table != NULL && i->curr != SIZE_MAX
+        && !C_String_Table_Iterator_has_failed(i);
+}
+
+FMC_API const uint8_t* C_String_Table_Iterator_current_key(C_String_Table_Iterator* i, size_t* lenp) {
+    C_String_Table* t = i->table;
+    const uint8_t* kp = NULL;
+    size_t kl = 0;
+
+    if (on_entry(i)) {
+        if (t->layout == C_STRING_TABLE_ORDERED) {
+            kp = leaf_key(t, (art_ref)i->curr, &kl);
+        } else {
+            kp = t->arena + t->slots[i->curr].off;
+            kp += get_length(kp, &kl);
+        }
+    }
+    if (lenp) {
+        *lenp = kl;
+    }
+    return kp;
+}
+
+FMC_API const void* C_String_Table_Iterator_current_value(C_String_Table_Iterator* i) {
+    if (!on_entry(i)) {
+        return NULL;
+    }
+    if (i->table->layout == C_STRING_TABLE_ORDERED) {
+        return leaf_value(i->table, (art_ref)i->curr);
+    }
+    return slot_value(i->table, i->table->slots + i->curr);
+}
+
+FMC_API bool C_String_Table_Iterator_free(C_String_Table_Iterator* *iptr) {
+    if (!iptr || !(*iptr)) return false;
+
+    free(*iptr);
+    *iptr = NULL;
+    return true;
+}
+
+/* -------------------- Snapshot Functions ------------------------- */
+
+/*
+ * The start of a snapshot file.  Every part of the table follows at the
+ * offset given here, exactly as a frozen hashed table holds it in
+ * memory, so C_String_Table_map() points the table at the mapping and
+ * is done.  Slots' `value`s are the values' bits, or with SNAPBLOBS
+ * the offsets from the start of the file of their encoded bytes.
+ */
+typedef struct snap_header {
+    char     magic[8];
+    uint32_t version;
+    uint32_t byteorder;     /* SNAPORDER as written */
+    uint32_t flags;
+    uint32_t slotsize;      /* sizeof(C_String_Slot) as written */
+    uint64_t size;          /* of the whole file */
+    uint64_t nentries;
+    uint64_t nbuckets;
+    uint64_t seed;
+    uint64_t arena_off;
+    uint64_t arena_len;
+    uint64_t pilots_off;
+    uint64_t blobs_off;
+    uint64_t blobs_len;
+    uint64_t slots_off;
+} snap_header;
+
+static const uint8_t zeros[SNAPALIGN];
+
+static bool write_bytes(FILE* out, uint64_t* posp, const void* p, size_t len) {
+    if (len > 0 && fwrite(p, 1, len, out) != len) {
+        return false;
+    }
+    *posp += len;
+    return true;
+}
+
+static bool write_padding(FILE* out, uint64_t* posp) {
+    return write_bytes(out, posp, zeros, (SNAPALIGN - *posp % SNAPALIGN) % SNAPALIGN);
+}
+
+static bool copy_entry(size_t kl, const uint8_t* kp, const void* value, void* data) {
+    return C_String_Table_add((C_String_Table*)data, kl, kp, value);
+}
+
+/*
+ * Write `t`'s arena, pilots, values, and slots to `out` after room for
+ * the header, then the header itself.
+ */
+static bool write_snapshot(C_String_Table* t, FILE* out, C_String_Table_Encoder enc, void* data) {
+    snap_header head;
+    C_String_Slot* slots;
+    uint64_t pos = 0;
+    bool ok = false;
+
+    slots = malloc((t->len + 1) * sizeof(C_String_Slot));
+    if (slots == NULL) {
+        return false;
+    }
+    memcpy(slots, t->slots, t->len * sizeof(C_String_Slot));
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, SNAPMAGIC, sizeof(head.magic));
+    head.version   = SNAPVERSION;
+    head.byteorder = SNAPORDER;
+    head.flags     = (enc != NULL) ? SNAPBLOBS : 0;
+    head.slotsize  = sizeof(C_String_Slot);
+    head.nentries  = t->nentries;
+    head.nbuckets  = t->nbuckets;
+    head.seed      = t->seed;
+
+    if (!write_bytes(out, &pos, &head, sizeof(head))) goto done;
+
+    head.arena_off = pos;
+    head.arena_len = t->arenalen;
+    if (!write_bytes(out, &pos, t->arena, t->arenalen)) goto done;
+    if (!write_padding(out, &pos)) goto done;
+
+    head.pilots_off = pos;
+    if (!write_bytes(out, &pos, t->pilots, frozen_words(t->nentries, t->nbuckets) * sizeof(uint32_t))) goto done;
+    if (!write_padding(out, &pos)) goto done;
+
+    head.blobs_off = pos;
+    for (size_t i = 0; i < t->len; i++) {
+        const void* value = slot_value(t, t->slots + i);
+
+        if (enc != NULL) {
+            size_t len = 0;
+            const void* blob = enc(value, &len, data);
+
+            if (blob == NULL && len > 0) goto done;
+            value = (const void*)(uintptr_t)pos;
+            if (!write_bytes(out, &pos, blob, len)) goto done;
+            if (!write_padding(out, &pos)) goto done;
+        }
+        slots[i].value = value;
+    }
+    head.blobs_len = pos - head.blobs_off;
+
+    head.slots_off = pos;
+    if (!write_bytes(out, &pos, slots, t->len * sizeof(C_String_Slot))) goto done;
+    head.size = pos;
+
+    ok = fseek(out, 0, SEEK_SET) == 0 && fwrite(&head, sizeof(head), 1, out) == 1;
+
+done:
+    free(slots);
+    return ok;
+}
+
+FMC_API bool C_String_Table_save(C_String_Table* t, const char* path, C_String_Table_Encoder enc, void* data) {
+    C_String_Table* copy = NULL;
+    char* tmppath = NULL;
+    FILE* out = NULL;
+    bool ok = false;
+
+    if (t == NULL || path == NULL) {
+        return false;
+    }
+
+    // Only a frozen hash can be used in place
+    if (t->layout != C_STRING_TABLE_HASHED || !t->frozen) {
+        C_String_Table_new(&copy, t->nentries);
+        if (copy == NULL) {
+            return false;
+        }
+        C_String_Table_for_each(t, copy_entry, copy);
+        if (copy->nentries != t->nentries || !C_String_Table_freeze(copy)) {
+            goto done;
+        }
+        t = copy;
+    }
+
+    // Never rewrite a file in place: other processes may have it mapped
+    tmppath = malloc(strlen(path) + 5);
+    if (tmppath == NULL) {
+        goto done;
+    }
+    sprintf(tmppath, "%s.tmp", path);
+
+    out = fopen(tmppath, "wb");
+    if (out == NULL) {
+        goto done;
+    }
+    ok = write_snapshot(t, out, enc, data);
+    ok = (fclose(out) == 0) && ok;
+    ok = ok && rename(tmppath, path) == 0;
+    if (!ok) {
+        remove(tmppath);
+    }
+
+done:
+    free(tmppath);
+    C_String_Table_free(&copy);
+    return ok;
+}
+
+/* Whether `len` bytes at `off` lie within a file of `size` bytes */
+static inline bool snap_fits(uint64_t off, uint64_t len, uint64_t size) {
+    return off <= size && len <= size - off;
+}
+
+/*
+ * Whether the header describes a table this build can use in place.
+ * The contents of the arena and slots are trusted, as they must be
+ * for mapping to cost nothing.
+ */
+static bool snap_valid(const snap_header* head, uint64_t size) {
+    if (memcmp(head->magic, SNAPMAGIC, sizeof(head->magic)) != 0
+            || head->version != SNAPVERSION
+            || head->byteorder != SNAPORDER
+            || head->slotsize != sizeof(C_String_Slot)
+            || head->size != size) {
+        return false;
+    }
+    if (head->nentries > size / sizeof(C_String_Slot)
+            || head->nbuckets != head->nentries / FROZENLOAD + 1
+            || head->arena_len > ARENAMAXSIZ) {
+        return false;
+    }
+    return snap_fits(head->arena_off, head->arena_len, size)
+        && head->pilots_off % sizeof(uint32_t) == 0
+        && snap_fits(head->pilots_off, frozen_words(head->nentries, head->nbuckets) * sizeof(uint32_t), size)
+        && snap_fits(head->blobs_off, head->blobs_len, size)
+        && head->slots_off % SNAPALIGN == 0
+        && snap_fits(head->slots_off, head->nentries * sizeof(C_String_Slot), size);
+}
+
+FMC_API bool C_String_Table_map(C_String_Table* *tptr, const char* path) {
+    C_String_Table* self;
+    const snap_header* head;
+    uint8_t* base;
+    struct stat st;
+    int fd;
+
+    if (tptr == NULL) {
+        return false;
+    }
+    *tptr = NULL;
+    if (path == NULL) {
+        return false;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(snap_header)
+            || (uint64_t)st.st_size > SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+    base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    head = (const snap_header*)base;
+    self = snap_valid(head, (uint64_t)st.st_size) ? calloc(1, sizeof(C_String_Table)) : NULL;
+    if (self == NULL) {
+        munmap(base, (size_t)st.st_size);
+        return false;
+    }
+
+    self->layout   = C_STRING_TABLE_HASHED;
+    self->frozen   = true;
+    self->slots    = (C_String_Slot*)(base + head->slots_off);
+    self->len      = head->nentries;
+    self->nentries = head->nentries;
+    self->seed     = head->seed;
+    self->pilots   = (uint32_t*)(base + head->pilots_off);
+    self->nbuckets = head->nbuckets;
+    self->remap    = self->pilots + head->nbuckets;
+    self->arena    = base + head->arena_off;
+    self->arenalen = head->arena_len;
+    self->arenacap = head->arena_len;
+    self->map      = base;
+    self->maplen   = (size_t)st.st_size;
+    self->blobs    = (head->flags & SNAPBLOBS) ? base : NULL;
+
+    *tptr = self;
+    return true;
+}
+
+FMC_API bool C_String_Table_is_mapped(C_String_Table* t) {
+    return t != NULL && t->map != NULL;
+}
+
+/* -------------------- Other Functions ------------------------- */
+
+FMC_API void C_String_Table_stats(C_String_Table* t, C_Hash_Stats* stats) {
+    C_Hash_Stats_clear(stats);
+    if (t == NULL || stats == NULL) return;
+
+    for (size_t i = 0; i < t->len; i++) {
+        if (t->slots[i].value != NULL) {
+            stats->occupied++;
+            C_Hash_Stats_add_probe(stats, t->frozen ? 0 : probe_distance(t->slots + i, i, t->len));
+        }
+    }
+    stats->buckets = t->len;
+    stats->resizes = t->resizes;
+    stats->bytes  += sizeof(C_String_Table)
+        + t->len * sizeof(C_String_Slot) + t->arenacap
+        + ((t->pilots != NULL) ? frozen_words(t->nentries, t->nbuckets) * sizeof(uint32_t) : 0);
+
+    // A tree's buckets are its nodes' child pointers; keys' probe
+    // lengths are how many nodes lie above them
+    tree_stats(t->root, 0, stats);
+}
+
+FMC_API void C_String_Table_free(C_String_Table* *tptr) {
+    C_String_Table* self = tptr ? *tptr : NULL;
+
+    if (!self) {
+        return;
+    }
+    if (self->map != NULL) {
+        munmap(self->map, self->maplen);
+    } else {
+        tree_free(self->root);
+        free(self->slots);
+        free(self->arena);
+        free(self->pilots);
+    }
+    free(self);
+    *tptr = NULL;
+}
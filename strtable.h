@@ -24,6 +24,7 @@
 #define FMC_STRTABLE_H_INCLUDED
 
 #include "common.h"
+#include "hash.h"
 
 /** @file */
 
@@ -32,19 +33,79 @@
  * The table makes copies of all string keys, and deletes them when done.
  * The client program must free all non-constant strings used to set
  * and get entries *and* the referents of pointers placed in the table.
+ *
+ * Keys are copied end to end into one growing block, not malloc'd one
+ * by one, and each entry costs 16 bytes of index besides its key and a
+ * byte or so for the key's length.  All the keys together, counting the
+ * room removed keys held until it's reclaimed, can't pass 4 GB.
  */
 typedef struct C_String_Table C_String_Table;
 
 /**
- * An opaque type for string table iterator instances.
+ * A cursor over the entries of a table, walking them in place.
+ * It may live anywhere, e.g. on the stack, once set up by
+ * `C_String_Table_Iterator_init()`.  Its fields are private.
+ */
+typedef struct C_String_Table_Iterator {
+    C_String_Table* table;
+    size_t          curr;
+    size_t          next;
+    size_t          modcount;
+} C_String_Table_Iterator;
+
+/**
+ * How a `C_String_Table` indexes its keys.
+ */
+typedef enum C_String_Table_Layout {
+    /**
+     * An open-addressed hash index.  This is the default, and the
+     * fastest for looking up whole keys.
+     */
+    C_STRING_TABLE_HASHED = 0,
+
+    /**
+     * An adaptive radix tree, whose nodes grow and shrink with the
+     * number of distinct bytes that follow a prefix.  A lookup costs
+     * one node per distinct prefix along the key rather than a hash
+     * of the whole key, keys come out in byte order, and
+     * `C_String_Table_prefix_scan()` finds all keys with a prefix
+     * without looking at any others.
+     */
+    C_STRING_TABLE_ORDERED = 1
+} C_String_Table_Layout;
+
+/**
+ * Called by `C_String_Table_for_each()` and `C_String_Table_prefix_scan()`
+ * with each key and value in turn; returns false to stop early.
+ * `key` is only good until the function returns.
+ */
+typedef bool (*C_String_Table_Visitor)(size_t keylen, const uint8_t* key, const void* value, void* data);
+
+/**
+ * Called by `C_String_Table_save()` to turn `value` into bytes to write
+ * in its place; returns the bytes and puts their length in `*lenp`.
+ * The bytes need only last until the next call.
  */
-typedef struct C_String_Table_Iterator C_String_Table_Iterator;
+typedef const void* (*C_String_Table_Encoder)(const void* value, size_t* lenp, void* data);
 
 /**
- * Creates a new string table with at least `minsz` capacity.
+ * Creates a new string table with the default layout
+ * (`C_STRING_TABLE_HASHED`) and at least `minsz` capacity.
  */
 FMC_API void C_String_Table_new(C_String_Table* *tptr, size_t minsz);
 
+/**
+ * Creates a new string table with the given `layout` and at least
+ * `minsz` capacity.  Both layouts behave identically through this API,
+ * except for the order in which they visit keys.
+ */
+FMC_API void C_String_Table_new_with_layout(C_String_Table* *tptr, size_t minsz, C_String_Table_Layout layout);
+
+/**
+ * The layout `t` was created with.
+ */
+FMC_API C_String_Table_Layout C_String_Table_layout(C_String_Table* t);
+
 /**
  * The number of entries in `t`.
  */
@@ -65,24 +126,199 @@ FMC_API bool C_String_Table_has(C_String_Table* t, size_t keylen, const uint8_t*
 
 /**
  * Add `value` as an entry for `key`, if none exists.
- * If `key` or `value` is null, this function fails and returns false.
+ * If `key` or `value` is null, or `t` is frozen, this function fails
+ * and returns false.
  * If `key` already exists in the table, this fucntion fails and returns false.
  * Returns false only if the operation could not be completed.
  */
 FMC_API bool C_String_Table_add(C_String_Table* t, size_t keylen, const uint8_t* key, const void* value);
 
+/**
+ * Put `value` into an entry for `key`, replacing any value it had.
+ * If `value` is null, any existing entry will be removed.
+ * The previous value if any is placed in `*oldvalp` if given.
+ * Returns false if `key` is null, `t` is frozen, or the operation
+ * could not be completed for some other reason.
+ */
+FMC_API bool C_String_Table_put(C_String_Table* t, size_t keylen, const uint8_t* key, const void* value, const void* *oldvalp);
+
+/**
+ * Add `n` keys and values at once, in order, as if by
+ * `C_String_Table_add()` on each, after growing the table once to hold
+ * at least `n` entries and all the keys' bytes.  A hashed table hashes
+ * keys a batch at a time and fetches their slots before inserting them.
+ * Returns the number of pairs added; keys already present aren't.
+ */
+FMC_API size_t C_String_Table_add_many(C_String_Table* t, size_t n, const size_t keylens[], const uint8_t* keys[], const void* values[]);
+
+/**
+ * Grow `t` if need be to hold `n` entries in all without rebuilding
+ * its index.  An ordered table has no index to grow, so this does
+ * nothing.  Returns false if it couldn't, or `t` is frozen.
+ */
+FMC_API bool C_String_Table_reserve(C_String_Table* t, size_t n);
+
 /**
  * Remove the entry for `key`.
  * The previous value if any is placed in `*oldvalp` if given.
- * Returns false if the operation could not be completed for some reason.
+ * Returns false if the operation could not be completed for some reason,
+ * including that `t` is frozen.
  */
 FMC_API bool C_String_Table_remove(C_String_Table* t, size_t keylen, const uint8_t* key, const void* *oldvalp);
 
+/**
+ * Call `f` with each key and value in `t`, plus `data`, until `f`
+ * returns false: in byte order (shorter keys first) if `t` is
+ * `C_STRING_TABLE_ORDERED`, else in no particular order.
+ * `f` must not add or remove entries.
+ * Returns how many entries `f` saw.
+ */
+FMC_API size_t C_String_Table_for_each(C_String_Table* t, C_String_Table_Visitor f, void* data);
+
+/**
+ * Like `C_String_Table_for_each()`, but only for keys starting with the
+ * `plen` bytes at `prefix`.  An ordered table goes straight to those
+ * keys; a hashed one has to look at every key.
+ * Returns how many entries `f` saw.
+ */
+FMC_API size_t C_String_Table_prefix_scan(C_String_Table* t, size_t plen, const uint8_t* prefix, C_String_Table_Visitor f, void* data);
+
+/**
+ * Make `t` read-only, and rebuild it so each `C_String_Table_get()` or
+ * `C_String_Table_has()` makes exactly one probe and at most one key
+ * comparison, using a minimal perfect hash of the keys it has now.
+ * (About one key in a hundred also costs a read from a small table
+ * mapping it into a slot the hash left empty.)  An ordered table keeps
+ * its tree, and its order.
+ * A frozen table also drops any room it held for more keys.
+ * It can't be thawed; adds and removals fail from then on.
+ *
+ * Freezing takes time in proportion to the number of keys, and about
+ * 60 bytes a key of temporary memory besides the table.
+ *
+ * Lookups in a frozen table write nothing, so any number of threads may
+ * look up keys at once without a lock, once the freezing thread has
+ * published the table to them.
+ *
+ * Returns false, leaving `t` as it was, if there wasn't memory enough
+ * (or, with vanishingly small odds, no perfect hash turned up).  Freezing a frozen table
+ * does nothing and returns true.
+ */
+FMC_API bool C_String_Table_freeze(C_String_Table* t);
+
+/**
+ * Whether `t` has been frozen by `C_String_Table_freeze()`.
+ */
+FMC_API bool C_String_Table_is_frozen(C_String_Table* t);
+
+/**
+ * Write `t` to the file at `path` as a snapshot that
+ * `C_String_Table_map()` can open without reading or copying it.
+ *
+ * If `enc` is NULL the values' own bits are written, which suits values
+ * that are really integers or offsets into some other file.  Otherwise
+ * each value is written as the bytes `enc` turns it into, and the mapped
+ * table's values point to those bytes, aligned to 8.
+ *
+ * The file holds `t`'s keys behind a minimal perfect hash, as
+ * `C_String_Table_freeze()` builds it.  If `t` isn't a frozen hashed table,
+ * this builds a frozen copy to write, so freezing a large table first
+ * saves memory.  The file is written beside `path` and renamed over
+ * it, so processes with the old file mapped are undisturbed.
+ *
+ * Any table can be saved: the only limit on size is the 4 GB of key
+ * bytes any table can hold, about 200 million keys of 20 bytes.  The
+ * file takes about 16 bytes a key besides the keys and any encoded
+ * values.  Building the perfect hash, if `t` isn't frozen yet, takes
+ * time in proportion to the number of keys, and about 60 bytes a key
+ * of temporary memory on top of the copy.
+ * Returns false if the file couldn't be written or `enc` returned NULL
+ * with a nonzero length.
+ */
+FMC_API bool C_String_Table_save(C_String_Table* t, const char* path, C_String_Table_Encoder enc, void* data);
+
+/**
+ * Open the snapshot at `path` written by `C_String_Table_save()` as a
+ * frozen, hashed table in `*tptr`, by mapping the file into memory.
+ * Nothing is read until a lookup touches it, and processes mapping the
+ * same file share its pages.  Freeing the table unmaps the file.
+ *
+ * Only the file's header is checked: the rest must be trusted, as it
+ * must be produced by the same version of this library on a machine
+ * with the same byte order and word size.  Returns false, setting
+ * `*tptr` to NULL, if the file can't be mapped or its header is wrong.
+ */
+FMC_API bool C_String_Table_map(C_String_Table* *tptr, const char* path);
+
+/**
+ * Whether `t` was opened by `C_String_Table_map()`.
+ */
+FMC_API bool C_String_Table_is_mapped(C_String_Table* t);
+
+/**
+ * Fills in `*stats` with how well `t` spreads its keys, where a key's
+ * probe length is its distance in slots from its home slot, or 0 for
+ * every key once `t` is frozen.  In an ordered table, buckets are the
+ * child pointers of the tree's nodes, and a key's probe length is how
+ * many nodes lie above it.
+ */
+FMC_API void C_String_Table_stats(C_String_Table* t, C_Hash_Stats* stats);
+
 /**
  * Deletes the table and all memory it allocated.
  */
 FMC_API void C_String_Table_free(C_String_Table* *tptr);
 
+/* -------------------- Iterator Functions ------------------------- */
+
+/**
+ * Set up `i` to walk the entries of `t` without allocating memory:
+ * in byte order if `t` is `C_STRING_TABLE_ORDERED`, else in no
+ * particular order.  Adding or removing an entry fails the iterator:
+ * afterward it returns no more entries.  Replacing the value of an
+ * existing entry with `C_String_Table_put()` does not.
+ */
+FMC_API void C_String_Table_Iterator_init(C_String_Table* t, C_String_Table_Iterator* i);
+
+/**
+ * Allocate an iterator like `C_String_Table_Iterator_init()`.
+ * Free it with `C_String_Table_Iterator_free()`.
+ */
+FMC_API void C_String_Table_new_iterator(C_String_Table* t, C_String_Table_Iterator* *iptr);
+
+/**
+ * Whether a call to `C_String_Table_Iterator_next()` would find another entry.
+ */
+FMC_API bool C_String_Table_Iterator_has_next(C_String_Table_Iterator* i);
+
+/**
+ * Move to the next entry.  An iterator starts before the first entry.
+ * In an ordered table each step is one descent of the tree.
+ */
+FMC_API void C_String_Table_Iterator_next(C_String_Table_Iterator* i);
+
+/**
+ * Whether the table has been added to or removed from since `i` was
+ * set up.
+ */
+FMC_API bool C_String_Table_Iterator_has_failed(C_String_Table_Iterator* i);
+
+/**
+ * The key of the current entry, with its length in `*lenp` if given,
+ * or NULL if there is none.  The key is only good until the table
+ * next changes.
+ */
+FMC_API const uint8_t* C_String_Table_Iterator_current_key(C_String_Table_Iterator* i, size_t* lenp);
+
+/**
+ * The value of the current entry, or NULL if there is none.
+ */
+FMC_API const void* C_String_Table_Iterator_current_value(C_String_Table_Iterator* i);
+
+/**
+ * Free an iterator from `C_String_Table_new_iterator()`.
+ */
+FMC_API bool C_String_Table_Iterator_free(C_String_Table_Iterator* *iptr);
 
 #endif // FMC_STRTABLE_H_INCLUDED
 
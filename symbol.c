@@ -61,6 +61,8 @@ static C_String_Table* symbols_by_name() {
 static C_Ref_Set* symbol_ref_set() {
     if (!_symbol_ref_set) {
         C_Ref_Set_new(&_symbol_ref_set, 10);
+        // is_C_Symbol() mostly asks about things that aren't
+        C_Ref_Set_set_filter(_symbol_ref_set, true);
     }
     return _symbol_ref_set;
 }
@@ -23,35 +23,97 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include "hash.h"
+#include "pool.h"
 #include "table.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #define TABLE_MINSIZ    5
 #define TABLE_LOAD      0.75
 
+/*
+ * Open addressing parameters.  Control bytes are either EMPTY, DELETED,
+ * or hold the low 7 bits of a (mixed) hash for a FULL slot.
+ * The high bit is set only for EMPTY and DELETED.
+ */
+#define GROUP_WIDTH     16
+#define GROUP_MINSIZ    1
+#define CTRL_EMPTY      0x80
+#define CTRL_DELETED    0xFE
+#define OPEN_LOAD_NUM   7
+#define OPEN_LOAD_DEN   8
+
+/*
+ * Entries, and copies of keys and values shorter than SMALL_MAX, come
+ * from pools of blocks in multiples of SMALL_GRAIN bytes.
+ * Keys and values shorter than INLINE_MAX live in the entry itself.
+ */
+#define SMALL_GRAIN     16
+#define SMALL_MAX       128
+#define NPOOLS          (SMALL_MAX / SMALL_GRAIN)
+#define INLINE_MAX      32
+
+/*
+ * The batch functions prefetch a key's bucket PREFETCH_AHEAD keys before
+ * its entry, and its entry PREFETCH_AHEAD keys before using it.
+ * PREFETCH_RING must be a power of two over twice PREFETCH_AHEAD.
+ */
+#define PREFETCH_AHEAD  8
+#define PREFETCH_RING   32
+
+#if defined(__GNUC__)
+#define prefetch(ptr)   __builtin_prefetch(ptr)
+#else
+#define prefetch(ptr)   ((void)(ptr))
+#endif
+
+/* Entry flags: which copies came from the table's pools or sit inline */
+#define KEY_POOLED      0x01
+#define VALUE_POOLED    0x02
+#define KEY_INLINE      0x04
+#define VALUE_INLINE    0x08
+
 typedef struct _C_Table_Entry C_Table_Entry;
 
+/*
+ * The key and value are unpacked from C_Userdata so the flags fit
+ * in the same 64 bytes.  An inline key, then an inline value, follow
+ * the entry in the same block of `size` bytes.
+ */
 struct _C_Table_Entry {
     C_Table_Entry* next;
 
-    C_Userdata key;
-    C_Userdata value;
-};
+    /* full hash of the key, so growing never rereads key bytes */
+    uint64_t  hash;
 
-static uint64_t default_hash(const void* ptr, const size_t len) {
-    // Treat `ptr` as a list of bytes
-    const uint8_t* bytes = (const uint8_t*)ptr;
-    // Stolen from:
-    // https://www.geeksforgeeks.org/string-hashing-using-polynomial-rolling-hash-function/
-    int p = 31, m = 1000000007;
-    long p_pow = 1;
-    uint64_t hash_so_far = 0;
+    /* everything needed to match a key comes first */
+    void*     kptr;
+    size_t    klen;
+    tag_t     ktag;
+    tag_t     vtag;
+    uint16_t  flags;
+    uint16_t  size;
 
-    for (int i = 0; i < len; i++) {
-        hash_so_far += (bytes[i] * p_pow) % m;
-        p_pow = (p_pow * p) % m;
-    }
-    return hash_so_far;
-}
+    void*     vptr;
+    size_t    vlen;
+};
+
+/*
+ * The index over a table's entries.
+ * For C_TABLE_CHAINED `array` holds `arraylen` bucket heads.
+ * For C_TABLE_OPEN `array` holds `arraylen` slots, a multiple of
+ * GROUP_WIDTH, with a control byte for each in `ctrl`;
+ * `growth` counts the EMPTY slots we may still fill before resizing.
+ */
+typedef struct _C_Table_Index {
+    C_Table_Entry* *array;
+    uint8_t*       ctrl;
+    size_t         arraylen;
+    size_t         growth;
+} C_Table_Index;
 
 static bool default_equals(const C_Userdata* a, const C_Userdata* b) {
     if (a->len != b->len) return false;
@@ -82,18 +144,151 @@ static void default_free(C_Userdata* ud) {
 }
 
 struct C_Table {
-
-    C_Table_Entry* *array;
-    size_t         arraylen;
+    C_Table_Layout layout;
+    C_Table_Index  idx;
     size_t         nentries;
 
+    /* index being drained into `idx` during an incremental resize */
+    C_Table_Index  old;
+    size_t         migrated;
+    size_t         step;
+    size_t         resizes;
+
+    /* bumped whenever entries come or go, to fail iterators */
+    size_t         modcount;
+
+    /* small blocks, by size; and how many copies came from `cp` instead */
+    C_Pool*        pools[NPOOLS];
+    size_t         nforeign;
+
     C_Table_Hash    hash;
     C_Userdata_Equals   eq;
     C_Userdata_Copy cp;
     C_Userdata_Free rm;
 };
 
+/* ----------------------- Control Byte Groups ---------------------------*/
+
+/*
+ * Each function returns a bitmask with bit `i` set if control byte `i`
+ * of the group starting at `ctrl` satisfies the condition.
+ */
+
+#if defined(__SSE2__)
+
+static inline uint32_t group_match(const uint8_t* ctrl, uint8_t h2) {
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)h2)));
+}
+
+static inline uint32_t group_match_empty(const uint8_t* ctrl) {
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline uint32_t group_match_free(const uint8_t* ctrl) {
+    // EMPTY and DELETED are the only values with the high bit set
+    __m128i group = _mm_loadu_si128((const __m128i*)ctrl);
+    return (uint32_t)_mm_movemask_epi8(group);
+}
+
+#else
+
+static inline uint32_t group_match(const uint8_t* ctrl, uint8_t h2) {
+    uint32_t result = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        if (ctrl[i] == h2) result |= (1u << i);
+    }
+    return result;
+}
+
+static inline uint32_t group_match_empty(const uint8_t* ctrl) {
+    return group_match(ctrl, CTRL_EMPTY);
+}
+
+static inline uint32_t group_match_free(const uint8_t* ctrl) {
+    uint32_t result = 0;
+    for (int i = 0; i < GROUP_WIDTH; i++) {
+        if (ctrl[i] & 0x80) result |= (1u << i);
+    }
+    return result;
+}
+
+#endif
+
+static inline int lowest_bit(uint32_t bits) {
+#if defined(__GNUC__)
+    return __builtin_ctz(bits);
+#else
+    int i = 0;
+    while (!(bits & 1)) {
+        bits >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+/*
+ * Spread the bits of a user hash (which may be a bare pointer or a weak
+ * polynomial) across the whole word before carving it into a group
+ * number and a 7-bit control tag.
+ */
+static inline uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* --------------------------- Table Index -------------------------------*/
+
+static size_t open_capacity(size_t minsz) {
+    // Smallest power-of-two number of groups that keeps `minsz` entries
+    // under the maximum load.
+    size_t want = (minsz * OPEN_LOAD_DEN) / OPEN_LOAD_NUM;
+    size_t len = GROUP_WIDTH * GROUP_MINSIZ;
+
+    while (len < want) {
+        len *= 2;
+    }
+    return len;
+}
+
+static bool index_init(C_Table* t, C_Table_Index* idx, size_t minsz) {
+    memset(idx, 0, sizeof(C_Table_Index));
+
+    if (t->layout == C_TABLE_OPEN) {
+        idx->arraylen = open_capacity(minsz);
+        idx->ctrl     = malloc(idx->arraylen);
+        if (idx->ctrl == NULL) return false;
+        memset(idx->ctrl, CTRL_EMPTY, idx->arraylen);
+        idx->growth   = (idx->arraylen / OPEN_LOAD_DEN) * OPEN_LOAD_NUM;
+    } else {
+        idx->arraylen = (minsz > TABLE_MINSIZ) ? minsz : TABLE_MINSIZ;
+    }
+
+    idx->array = calloc(idx->arraylen, sizeof(C_Table_Entry*));
+    if (idx->array == NULL) {
+        free(idx->ctrl);
+        idx->ctrl = NULL;
+        return false;
+    }
+    return true;
+}
+
+static void index_free(C_Table_Index* idx) {
+    free(idx->array);
+    free(idx->ctrl);
+    memset(idx, 0, sizeof(C_Table_Index));
+}
+
 FMC_API void C_Table_new(C_Table* *tptr, size_t minsz) {
+    C_Table_new_with_layout(tptr, minsz, C_TABLE_CHAINED);
+}
+
+FMC_API void C_Table_new_with_layout(C_Table* *tptr, size_t minsz, C_Table_Layout layout) {
     C_Table* t;
     if (!tptr) return;
     (*tptr) = NULL;
@@ -102,14 +297,18 @@ FMC_API void C_Table_new(C_Table* *tptr, size_t minsz) {
     if (!t) return;
 
     memset(t, 0, sizeof(C_Table));
-    t->hash     = default_hash;
+    t->layout   = (layout == C_TABLE_OPEN) ? C_TABLE_OPEN : C_TABLE_CHAINED;
+    t->hash     = C_Hash_bytes;
     t->eq       = default_equals;
     t->cp       = default_copy;
     t->rm       = default_free;
-    t->arraylen = (minsz > TABLE_MINSIZ) ? minsz : TABLE_MINSIZ;
-    t->array    = calloc(t->arraylen, sizeof(C_Table_Entry*));
     t->nentries = 0;
 
+    if (!index_init(t, &(t->idx), minsz)) {
+        free(t);
+        return;
+    }
+
     (*tptr) = t;
 }
 
@@ -134,92 +333,450 @@ static bool udequals(C_Table* t, const C_Userdata* a, const C_Userdata* b) {
     return t->eq(a, b);
 }
 
-static bool udcopy(C_Table* t, C_Userdata* to, const C_Userdata* from) {
+static void* small_alloc(C_Table* t, size_t size) {
+    size_t i = (size - 1) / SMALL_GRAIN;
+
+    if (t->pools[i] == NULL) {
+        C_Pool_new(&(t->pools[i]), (i + 1) * SMALL_GRAIN);
+        if (t->pools[i] == NULL) return NULL;
+    }
+    return C_Pool_alloc(t->pools[i]);
+}
+
+static void small_free(C_Table* t, void* ptr, size_t size) {
+    C_Pool_recycle(t->pools[(size - 1) / SMALL_GRAIN], ptr);
+}
+
+/*
+ * Whether the table copies and frees data itself, and thus may put
+ * small copies in its pools.
+ */
+static inline bool builtin_storage(C_Table* t) {
+    return t->cp == default_copy && t->rm == default_free;
+}
+
+/*
+ * Whether `ud` is data the table could store in `room` bytes of an entry.
+ */
+static inline bool fits_inline(C_Table* t, const C_Userdata* ud, size_t room) {
+    return ud->len > 0 && ud->ptr != NULL
+        && ud->len < INLINE_MAX && ud->len < room
+        && builtin_storage(t);
+}
+
+/*
+ * Copy `from` into `to` for storage in an entry: into `roomlen` bytes
+ * at `room` if it fits, else into a pooled block if it's small, else
+ * with the table's copy function.  Sets `inlinebit` or `poolbit` in
+ * `*flags` for the first two.
+ */
+static bool udcopy(C_Table* t, C_Userdata* to, const C_Userdata* from,
+        uint8_t* room, size_t roomlen,
+        uint16_t *flags, uint16_t poolbit, uint16_t inlinebit) {
+    *flags &= ~(poolbit | inlinebit);
+
     if (from->len == 0 || from->ptr == NULL) {
         to->tag = from->tag;
         to->len = 0;
         to->ptr = from->ptr;
         return true;
+    } else if (fits_inline(t, from, roomlen)) {
+        // `from` may be the value already in `room`
+        memmove(room, from->ptr, from->len);
+        room[from->len] = '\0';
+
+        to->tag = from->tag;
+        to->len = from->len;
+        to->ptr = room;
+        *flags |= inlinebit;
+        return true;
+    } else if (from->len < SMALL_MAX && builtin_storage(t)) {
+        uint8_t* ptr = small_alloc(t, from->len + 1);
+
+        if (ptr == NULL) return false;
+
+        memcpy(ptr, from->ptr, from->len);
+        ptr[from->len] = '\0';
+
+        to->tag = from->tag;
+        to->len = from->len;
+        to->ptr = ptr;
+        *flags |= poolbit;
+        return true;
+    } else if (t->cp(to, from)) {
+        t->nforeign++;
+        return true;
     } else {
-        return t->cp(to, from);
+        return false;
     }
 }
 
-static void udfree(C_Table* t, C_Userdata* ud) {
-    if (ud->len == 0 || ud->ptr == NULL) {
-        ud->tag = 0;
-        ud->len = 0;
-        ud->ptr = NULL;
+static void udfree(C_Table* t, C_Userdata* ud, uint16_t flags, uint16_t poolbit, uint16_t inlinebit) {
+    if (ud->len == 0 || ud->ptr == NULL || (flags & inlinebit)) {
+        // nothing to free
+    } else if (flags & poolbit) {
+        small_free(t, ud->ptr, ud->len + 1);
     } else {
         t->rm(ud);
+        t->nforeign--;
+    }
+    ud->tag = 0;
+    ud->len = 0;
+    ud->ptr = NULL;
+}
+
+/*
+ * Take over `from`, a block the caller allocated the way `t->rm`
+ * expects, for storage in an entry.  References are stored as is.
+ */
+static void udadopt(C_Table* t, C_Userdata* to, const C_Userdata* from,
+        uint16_t *flags, uint16_t poolbit, uint16_t inlinebit) {
+    *flags &= ~(poolbit | inlinebit);
+    (*to) = (*from);
+    if (from->len > 0 && from->ptr != NULL) {
+        t->nforeign++;
+    }
+}
+
+/*
+ * Let go of `ud` without freeing it, once the caller owns it again.
+ */
+static void udforget(C_Table* t, C_Userdata* ud, uint16_t flags, uint16_t poolbit, uint16_t inlinebit) {
+    if (ud->len == 0 || ud->ptr == NULL || (flags & inlinebit)) {
+        // nothing to let go
+    } else if (flags & poolbit) {
+        small_free(t, ud->ptr, ud->len + 1);
+    } else {
+        t->nforeign--;
+    }
+}
+
+static inline void entry_key(const C_Table_Entry* e, C_Userdata* ud) {
+    ud->tag = e->ktag;
+    ud->len = e->klen;
+    ud->ptr = e->kptr;
+}
+
+static inline void entry_value(const C_Table_Entry* e, C_Userdata* ud) {
+    ud->tag = e->vtag;
+    ud->len = e->vlen;
+    ud->ptr = e->vptr;
+}
+
+static inline void entry_set_key(C_Table_Entry* e, const C_Userdata* ud) {
+    e->ktag = ud->tag;
+    e->klen = ud->len;
+    e->kptr = ud->ptr;
+}
+
+static inline void entry_set_value(C_Table_Entry* e, const C_Userdata* ud) {
+    e->vtag = ud->tag;
+    e->vlen = ud->len;
+    e->vptr = ud->ptr;
+}
+
+/* Where an inline key goes */
+static inline uint8_t* key_room(C_Table_Entry* e) {
+    return (uint8_t*)(e + 1);
+}
+
+/* Where an inline value goes, and how many bytes it may take */
+static inline uint8_t* value_room(C_Table_Entry* e, size_t* roomlen) {
+    size_t klen = (e->flags & KEY_INLINE) ? e->klen + 1 : 0;
+
+    *roomlen = e->size - sizeof(C_Table_Entry) - klen;
+    return key_room(e) + klen;
+}
+
+static inline bool entry_has_key(C_Table* t, const C_Table_Entry* e, const C_Userdata* key) {
+    C_Userdata ekey;
+
+    entry_key(e, &ekey);
+    return udequals(t, &ekey, key);
+}
+
+/*
+ * Free the entry's key and value copies, and optionally the entry.
+ */
+static void free_entry(C_Table* t, C_Table_Entry* e, bool recycle) {
+    C_Userdata ud;
+
+    entry_key(e, &ud);
+    udfree(t, &ud, e->flags, KEY_POOLED, KEY_INLINE);
+    entry_value(e, &ud);
+    udfree(t, &ud, e->flags, VALUE_POOLED, VALUE_INLINE);
+
+    if (recycle) {
+        small_free(t, e, e->size);
+    }
+}
+
+/*
+ * Free an entry whose key and value the caller still owns.
+ */
+static void forget_entry(C_Table* t, C_Table_Entry* e) {
+    C_Userdata ud;
+
+    entry_key(e, &ud);
+    udforget(t, &ud, e->flags, KEY_POOLED, KEY_INLINE);
+    entry_value(e, &ud);
+    udforget(t, &ud, e->flags, VALUE_POOLED, VALUE_INLINE);
+    small_free(t, e, e->size);
+}
+
+static void free_entries(C_Table* t, C_Table_Index* idx) {
+    // Entries and pooled copies all go when the pools do, so we need
+    // only visit entries if some copy came from somewhere else.
+    for (size_t i = 0; i < idx->arraylen && t->nforeign > 0; i++) {
+        C_Table_Entry* head = idx->array[i];
+
+        while (head != NULL) {
+            C_Table_Entry* next = (t->layout == C_TABLE_CHAINED) ? head->next : NULL;
+
+            free_entry(t, head, false);
+            head = next;
+        }
     }
+    index_free(idx);
 }
 
 FMC_API void C_Table_free(C_Table* *tptr) {
     C_Table* t;
 
-    if (!tptr) return;
+    if (!tptr || !(*tptr)) return;
     t = *tptr;
 
-    // free all entries in array
-    for (int i = 0; i < t->arraylen; i++) {
-        C_Table_Entry* head = t->array[i];
-        t->array[i] = NULL;
-        while (head != NULL) {
-            C_Table_Entry* prev = head;
-
-            head = head->next;
+    free_entries(t, &(t->old));
+    free_entries(t, &(t->idx));
+    for (int i = 0; i < NPOOLS; i++) {
+        C_Pool_free(&(t->pools[i]));
+    }
+    free(t);
+    *tptr = NULL;
+}
 
-            // free all keys and values
-            udfree(t, &(prev->key));
-            udfree(t, &(prev->value));
+/*
+ * Find the link (bucket head, `next` field, or open slot) that holds
+ * the entry for `key`, or NULL if there is none.
+ */
+static C_Table_Entry** find_link(C_Table* t, C_Table_Index* idx, const C_Userdata* key, uint64_t h) {
+    if (t->layout == C_TABLE_OPEN) {
+        uint64_t m     = mix(h);
+        uint8_t  h2    = (uint8_t)(m & 0x7F);
+        size_t   mask  = (idx->arraylen / GROUP_WIDTH) - 1;
+        size_t   group = (size_t)(m >> 7) & mask;
+
+        // Triangular probing visits every group once
+        for (size_t step = 1; step <= mask + 1; step++) {
+            const uint8_t* ctrl = idx->ctrl + group * GROUP_WIDTH;
+            uint32_t bits = group_match(ctrl, h2);
+
+            while (bits != 0) {
+                C_Table_Entry** link = &(idx->array[group * GROUP_WIDTH + lowest_bit(bits)]);
+                if ((*link)->hash == h && entry_has_key(t, *link, key)) {
+                    return link;
+                }
+                bits &= bits - 1;
+            }
+            if (group_match_empty(ctrl) != 0) {
+                break;
+            }
+            group = (group + step) & mask;
+        }
+        return NULL;
+    } else {
+        C_Table_Entry** link = &(idx->array[h % idx->arraylen]);
 
-            free(prev);
+        while (*link != NULL
+                && !((*link)->hash == h && entry_has_key(t, *link, key))) {
+            link = &((*link)->next);
         }
+        return (*link != NULL) ? link : NULL;
     }
+}
 
-    free(t->array);
-    free(t);
-    tptr = NULL;
+/*
+ * Link `entry` into `idx`, which must have room for it.
+ */
+static void insert_entry(C_Table* t, C_Table_Index* idx, C_Table_Entry* entry) {
+    uint64_t h = entry->hash;
+
+    if (t->layout == C_TABLE_OPEN) {
+        uint64_t m     = mix(h);
+        size_t   mask  = (idx->arraylen / GROUP_WIDTH) - 1;
+        size_t   group = (size_t)(m >> 7) & mask;
+
+        for (size_t step = 1; step <= mask + 1; step++) {
+            uint8_t* ctrl = idx->ctrl + group * GROUP_WIDTH;
+            uint32_t bits = group_match_free(ctrl);
+
+            if (bits != 0) {
+                size_t i = group * GROUP_WIDTH + lowest_bit(bits);
+                if (idx->ctrl[i] == CTRL_EMPTY) {
+                    idx->growth--;
+                }
+                idx->ctrl[i]  = (uint8_t)(m & 0x7F);
+                idx->array[i] = entry;
+                return;
+            }
+            group = (group + step) & mask;
+        }
+    } else {
+        size_t index = h % idx->arraylen;
+
+        entry->next = idx->array[index];
+        idx->array[index] = entry;
+    }
 }
 
-static void insert_entry(C_Table* t, C_Table_Entry* entry) {
-    size_t index = hashcode(t, &(entry->key)) % t->arraylen;
+/*
+ * Unlink the entry held by `link`, found by `find_link()`.
+ */
+static void unlink_entry(C_Table* t, C_Table_Index* idx, C_Table_Entry** link) {
+    if (t->layout == C_TABLE_OPEN) {
+        size_t i = link - idx->array;
+        const uint8_t* group = idx->ctrl + (i - (i % GROUP_WIDTH));
+
+        // If this group already stops probes, nothing can lie beyond it
+        // and the slot may become EMPTY again; otherwise leave a marker.
+        if (group_match_empty(group) != 0) {
+            idx->ctrl[i] = CTRL_EMPTY;
+            idx->growth++;
+        } else {
+            idx->ctrl[i] = CTRL_DELETED;
+        }
+        idx->array[i] = NULL;
+    } else {
+        *link = (*link)->next;
+    }
+}
 
-    entry->next = t->array[index];
-    t->array[index] = entry;
+/*
+ * Whether an incremental resize is still draining `t->old`.
+ */
+static inline bool resizing(C_Table* t) {
+    return t->old.array != NULL;
 }
 
-static void rehash(C_Table* t) {
-    C_Table_Entry* head = NULL;
-    C_Table_Entry* tail = NULL;
+/*
+ * Move up to `nbuckets` buckets (or slots) of `t->old` into `t->idx`,
+ * freeing `t->old` once it's empty.
+ */
+static void migrate(C_Table* t, size_t nbuckets) {
+    C_Table_Index* old = &(t->old);
+    size_t end;
+
+    if (!resizing(t)) return;
 
-    // First gather up all the entries in a big chain
-    for (int i = 0; i < t->arraylen; i++) {
-        C_Table_Entry* curr = t->array[i];
+    end = (nbuckets < old->arraylen - t->migrated) ? t->migrated + nbuckets : old->arraylen;
+
+    for (size_t i = t->migrated; i < end; i++) {
+        C_Table_Entry* curr = old->array[i];
 
         if (curr == NULL) continue;
 
-        if (head == NULL) {
-            head = curr;
-        }
-        if (tail != NULL) {
-            tail->next = curr;
+        old->array[i] = NULL;
+        if (old->ctrl != NULL) {
+            // Later probes of `old` may still need to pass through here
+            old->ctrl[i] = CTRL_DELETED;
         }
-        tail = curr;
-        while (tail->next != NULL) {
-            tail = tail->next;
+        while (curr != NULL) {
+            C_Table_Entry* next = (t->layout == C_TABLE_CHAINED) ? curr->next : NULL;
+
+            curr->next = NULL;
+            insert_entry(t, &(t->idx), curr);
+            curr = next;
         }
-        t->array[i] = NULL;
     }
+    t->migrated = end;
+
+    if (t->migrated >= old->arraylen) {
+        index_free(old);
+        t->migrated = 0;
+    }
+}
+
+/*
+ * How many old buckets this operation should move: `t->step`, or more
+ * if need be so the old index empties before the new one fills up and
+ * must grow again, which would finish the move all at once.  Assumes
+ * every operation from now on inserts, since only inserts use up room;
+ * moving entries never does, as far as this counts it.
+ */
+static size_t migrate_pace(C_Table* t) {
+    size_t left;
+    size_t room;
+    size_t pace;
+
+    if (!resizing(t)) return t->step;
+
+    left = t->old.arraylen - t->migrated;
+    if (t->layout == C_TABLE_OPEN) {
+        // Each old slot holds at most one entry; keep room for them all
+        // and the entry about to be added (see reserve_one())
+        room = (t->idx.growth > left + 1) ? t->idx.growth - left - 1 : 0;
+    } else {
+        size_t limit = (size_t)(TABLE_LOAD * t->idx.arraylen);
+        room = (limit > t->nentries + 1) ? limit - t->nentries - 1 : 0;
+    }
+    if (room == 0) {
+        return SIZE_MAX;
+    }
+    pace = (left + room - 1) / room;
+    return (pace > t->step) ? pace : t->step;
+}
+
+/*
+ * Move every entry into a fresh index with room for `minsz` entries.
+ * Also reclaims DELETED slots.  If `t->step` is nonzero the entries move
+ * over a few buckets at a time during later operations; otherwise they
+ * all move now.
+ */
+static bool rebuild(C_Table* t, size_t minsz) {
+    C_Table_Index newidx;
+
+    // Only one resize at a time
+    migrate(t, SIZE_MAX);
+
+    if (!index_init(t, &newidx, minsz)) {
+        return false;
+    }
+
+    t->old = t->idx;
+    t->idx = newidx;
+    t->migrated = 0;
+    t->modcount++;
+    t->resizes++;
 
-    // Then replace them using the new functions / array size
-    while (head != NULL) {
-        C_Table_Entry* prev = head;
+    if (t->step == 0) {
+        migrate(t, SIZE_MAX);
+    }
+    return true;
+}
+
+/*
+ * Recompute every entry's hash, e.g. after a new hash function,
+ * and rebuild the index around them.
+ */
+static void rehash(C_Table* t) {
+    migrate(t, SIZE_MAX);
+
+    for (size_t i = 0; i < t->idx.arraylen; i++) {
+        C_Table_Entry* curr = t->idx.array[i];
 
-        head = head->next;
-        prev->next = NULL;
-        insert_entry(t, prev);
+        while (curr != NULL) {
+            C_Userdata key;
+
+            entry_key(curr, &key);
+            curr->hash = hashcode(t, &key);
+            curr = (t->layout == C_TABLE_CHAINED) ? curr->next : NULL;
+        }
+    }
+
+    if (t->layout == C_TABLE_OPEN) {
+        rebuild(t, t->nentries);
+    } else {
+        rebuild(t, t->idx.arraylen);
     }
 }
 
@@ -229,10 +786,35 @@ FMC_API size_t C_Table_size(C_Table* t) {
     return t->nentries;
 }
 
+FMC_API C_Table_Layout C_Table_layout(C_Table* t) {
+    return t->layout;
+}
+
+FMC_API void C_Table_set_resize_step(C_Table* t, size_t nbuckets) {
+    if (t == NULL) return;
+    t->step = nbuckets;
+    if (nbuckets == 0) {
+        migrate(t, SIZE_MAX);
+    }
+}
+
+FMC_API size_t C_Table_resize_step(C_Table* t) {
+    return t->step;
+}
+
+FMC_API bool C_Table_is_resizing(C_Table* t) {
+    return t != NULL && resizing(t);
+}
+
+FMC_API void C_Table_finish_resize(C_Table* t) {
+    if (t == NULL) return;
+    migrate(t, SIZE_MAX);
+}
+
 FMC_API void C_Table_define_hash_function(C_Table* t, C_Table_Hash f) {
     if (t == NULL) return;
     if (f == NULL) {
-        t->hash = default_hash;
+        t->hash = C_Hash_bytes;
     } else {
         t->hash = f;
     }
@@ -246,7 +828,6 @@ FMC_API void C_Table_define_data_equals(C_Table* t, C_Userdata_Equals f) {
     } else {
         t->eq = f;
     }
-    rehash(t);
 }
 
 FMC_API void C_Table_define_data_copy(C_Table* t, C_Userdata_Copy f) {
@@ -256,7 +837,6 @@ FMC_API void C_Table_define_data_copy(C_Table* t, C_Userdata_Copy f) {
     } else {
         t->cp = f;
     }
-    rehash(t);
 }
 
 FMC_API void C_Table_define_data_free(C_Table* t, C_Userdata_Free f) {
@@ -266,85 +846,193 @@ FMC_API void C_Table_define_data_free(C_Table* t, C_Userdata_Free f) {
     } else {
         t->rm = f;
     }
-    rehash(t);
 }
 
 /* ---------------------- Table Entry Functions --------------------------*/
 
 
-static C_Table_Entry* find_entry(C_Table* t, const C_Userdata* key, C_Table_Entry* (*prevptr)) {
-    C_Table_Entry* result = NULL;
-    C_Table_Entry* prev = NULL;
-    uint64_t h = hashcode(t, key);
+/*
+ * Find the link for `key` in either index, noting which in `*idxp`.
+ * Also does this operation's share of any incremental resize.
+ */
+static C_Table_Entry** find_any_link(C_Table* t, const C_Userdata* key, uint64_t h, C_Table_Index* *idxp) {
+    C_Table_Entry** link;
+
+    migrate(t, migrate_pace(t));
 
-    result = t->array[h % t->arraylen];
-    while (result != NULL && !udequals(t, &(result->key), key)) {
-        prev = result;
-        result = result->next;
+    link = find_link(t, &(t->idx), key, h);
+    if (idxp) {
+        (*idxp) = &(t->idx);
     }
-    if (prevptr) {
-        (*prevptr) = prev;
+    if (link == NULL && resizing(t)) {
+        link = find_link(t, &(t->old), key, h);
+        if (idxp) {
+            (*idxp) = &(t->old);
+        }
     }
-    return result;
+    return link;
 }
 
-static bool insert_pair(C_Table* t, const C_Userdata* key, const C_Userdata* value) {
-    C_Table_Entry* entry = (C_Table_Entry*)malloc(sizeof(C_Table_Entry));
-
-    udcopy(t, &(entry->key), key);
-    udcopy(t, &(entry->value), value);
+static C_Table_Entry* find_entry(C_Table* t, const C_Userdata* key, uint64_t h) {
+    C_Table_Entry** link = find_any_link(t, key, h, NULL);
 
-    insert_entry(t, entry);
-
-    t->nentries++;
+    return (link != NULL) ? *link : NULL;
+}
 
-    if (t->nentries >= TABLE_LOAD * t->arraylen) {
-        size_t oldlen = t->arraylen;
-        size_t newlen = oldlen * 2 + 1;
-        C_Table_Entry** newarray 
-            = (C_Table_Entry **)realloc(t->array, newlen * sizeof(C_Table_Entry*));
-        if (newarray != NULL) {
-            for (int i = oldlen; i < newlen; i++) {
-                // TODO: Yes, there's a better way to do this
-                newarray[i] = NULL;
-            }
-            t->array = newarray;
-            t->arraylen = newlen;
-            rehash(t);
+/*
+ * Make sure there's room for one more entry, growing the index if needed.
+ */
+static void reserve_one(C_Table* t) {
+    C_Table_Index* idx = &(t->idx);
+
+    if (t->layout == C_TABLE_OPEN) {
+        // Entries still in the old index must fit in this one.  Each
+        // old slot holds at most one, so move them all while there's
+        // surely room for them and the entry about to be added.
+        if (resizing(t) && idx->growth <= t->old.arraylen - t->migrated + 1) {
+            migrate(t, SIZE_MAX);
         }
+        if (idx->growth == 0) {
+            // Mostly DELETED markers?  Clean up in place rather than grow.
+            size_t cap = (idx->arraylen / OPEN_LOAD_DEN) * OPEN_LOAD_NUM;
+            size_t want = (t->nentries + 1 <= cap / 2) ? t->nentries + 1 : t->nentries * 2;
+            rebuild(t, want);
+        }
+    } else if (t->nentries + 1 >= TABLE_LOAD * idx->arraylen) {
+        rebuild(t, idx->arraylen * 2 + 1);
     }
-
-    return true;
 }
 
-static bool update_entry(C_Table* t, C_Table_Entry* entry, const C_Userdata* value) {
-    C_Userdata* entval = &(entry->value);
-    C_Userdata newval;
+/*
+ * Add a new entry for `key`, which mustn't have one, and return it;
+ * or NULL if we couldn't.  If `owned` the entry adopts the data of
+ * `key` and `value` instead of copying it, but only on success.
+ */
+static C_Table_Entry* insert_pair(C_Table* t, const C_Userdata* key, const C_Userdata* value, uint64_t h, bool owned) {
+    C_Table_Entry* entry;
+    C_Userdata ud;
+    uint8_t* room;
+    size_t roomlen;
+    size_t size = sizeof(C_Table_Entry);
 
-    udcopy(t, &newval, value);
-    if (!(udequals(t, &newval, value))) {
-        udfree(t, &newval);
+    if (!owned && fits_inline(t, key, INLINE_MAX)) {
+        size += key->len + 1;
+    }
+    if (!owned && fits_inline(t, value, INLINE_MAX)) {
+        size += value->len + 1;
+    }
+    // Any slack in the block is room for a longer value later
+    size = ((size + SMALL_GRAIN - 1) / SMALL_GRAIN) * SMALL_GRAIN;
+
+    entry = (C_Table_Entry*)small_alloc(t, size);
+    if (entry == NULL) return NULL;
+
+    memset(entry, 0, sizeof(C_Table_Entry));
+    entry->hash = h;
+    entry->size = (uint16_t)size;
+    if (owned) {
+        udadopt(t, &ud, key, &(entry->flags), KEY_POOLED, KEY_INLINE);
+        entry_set_key(entry, &ud);
+        udadopt(t, &ud, value, &(entry->flags), VALUE_POOLED, VALUE_INLINE);
+        entry_set_value(entry, &ud);
+    } else {
+        if (!udcopy(t, &ud, key, key_room(entry), INLINE_MAX,
+                    &(entry->flags), KEY_POOLED, KEY_INLINE)) {
+            small_free(t, entry, size);
+            return NULL;
+        }
+        entry_set_key(entry, &ud);
+        room = value_room(entry, &roomlen);
+        if (!udcopy(t, &ud, value, room, roomlen,
+                    &(entry->flags), VALUE_POOLED, VALUE_INLINE)) {
+            free_entry(t, entry, true);
+            return NULL;
+        }
+        entry_set_value(entry, &ud);
+    }
+
+    reserve_one(t);
+    if (t->layout == C_TABLE_OPEN && t->idx.growth == 0) {
+        // Couldn't grow; no room at the inn
+        if (owned) {
+            forget_entry(t, entry);
+        } else {
+            free_entry(t, entry, true);
+        }
+        return NULL;
+    }
+
+    insert_entry(t, &(t->idx), entry);
+
+    t->nentries++;
+    t->modcount++;
+
+    return entry;
+}
+
+/*
+ * Replace the value of `entry` with a copy of `value`, or with `value`
+ * itself if `owned`.
+ */
+static bool update_entry(C_Table* t, C_Table_Entry* entry, const C_Userdata* value, bool owned) {
+    C_Userdata entval, newval;
+    uint16_t newflags = entry->flags;
+    uint8_t* room;
+    size_t roomlen;
+
+    entry_value(entry, &entval);
+    room = value_room(entry, &roomlen);
+
+    if (owned) {
+        udadopt(t, &newval, value, &newflags, VALUE_POOLED, VALUE_INLINE);
+        udfree(t, &entval, entry->flags, VALUE_POOLED, VALUE_INLINE);
+    } else if (!(entry->flags & VALUE_INLINE) || !fits_inline(t, value, roomlen)) {
+        // The new value won't overwrite the old one in place
+        if (!udcopy(t, &newval, value, room, roomlen,
+                    &newflags, VALUE_POOLED, VALUE_INLINE)) {
+            return false;
+        }
+        // Only a custom copy function can get it wrong
+        if (!builtin_storage(t) && !(udequals(t, &newval, value))) {
+            udfree(t, &newval, newflags, VALUE_POOLED, VALUE_INLINE);
+            return false;
+        }
+        udfree(t, &entval, entry->flags, VALUE_POOLED, VALUE_INLINE);
+    } else if (!udcopy(t, &newval, value, room, roomlen,
+                &newflags, VALUE_POOLED, VALUE_INLINE)) {
         return false;
     }
-    udfree(t, entval);
 
-    entry->value.tag = newval.tag;
-    entry->value.len = newval.len;
-    entry->value.ptr = newval.ptr;
+    entry_set_value(entry, &newval);
+    entry->flags = newflags;
     return true;
 }
 
 FMC_API bool C_Table_add(C_Table* t, const C_Userdata* key, const C_Userdata* value) {
     C_Table_Entry* entry;
+    uint64_t h;
 
     if (!key || !value) return false;
 
-    entry = find_entry(t, key, NULL);
+    h = hashcode(t, key);
+    entry = find_entry(t, key, h);
     if (entry != NULL) {
         return false;
     }
 
-    return insert_pair(t, key, value);
+    return insert_pair(t, key, value, h, false) != NULL;
+}
+
+FMC_API bool C_Table_add_owned(C_Table* t, const C_Userdata* key, const C_Userdata* value) {
+    uint64_t h;
+
+    if (!key || !value) return false;
+
+    h = hashcode(t, key);
+    if (find_entry(t, key, h) != NULL) {
+        return false;
+    }
+    return insert_pair(t, key, value, h, true) != NULL;
 }
 
 FMC_API bool C_Table_get(C_Table* t, const C_Userdata* key, C_Userdata* value) {
@@ -352,139 +1040,634 @@ FMC_API bool C_Table_get(C_Table* t, const C_Userdata* key, C_Userdata* value) {
 
     if (!key || !value) return false;
 
-    entry = find_entry(t, key, NULL);
+    entry = find_entry(t, key, hashcode(t, key));
     if (entry == NULL) {
         return false;
     }
-    C_Userdata_set(value, entry->value.tag, entry->value.len, entry->value.ptr);
+    entry_value(entry, value);
     return true;
 }
 
 FMC_API bool C_Table_has(C_Table* t, const C_Userdata* key) {
     if (!key) return false;
 
-    return find_entry(t, key, NULL) != NULL;
+    return find_entry(t, key, hashcode(t, key)) != NULL;
+}
+
+static bool put_pair(C_Table* t, const C_Userdata* key, const C_Userdata* value, uint64_t h, bool owned) {
+    C_Table_Entry* entry = find_entry(t, key, h);
+
+    if (entry == NULL) {
+        return insert_pair(t, key, value, h, owned) != NULL;
+    }
+    if (!update_entry(t, entry, value, owned)) {
+        return false;
+    }
+    if (owned && key->len > 0 && key->ptr != NULL) {
+        // The entry keeps its own key, so the new one goes
+        C_Userdata ud = *key;
+        t->rm(&ud);
+    }
+    return true;
 }
 
 FMC_API bool C_Table_put(C_Table* t, const C_Userdata* key, const C_Userdata* value) {
-    C_Table_Entry* entry;
+    if (!key || !value) return false;
 
+    return put_pair(t, key, value, hashcode(t, key), false);
+}
+
+FMC_API bool C_Table_put_owned(C_Table* t, const C_Userdata* key, const C_Userdata* value) {
     if (!key || !value) return false;
 
-    entry = find_entry(t, key, NULL);
-    if (entry == NULL) {
-        return insert_pair(t, key, value);
+    return put_pair(t, key, value, hashcode(t, key), true);
+}
+
+/*
+ * Copy the value of `entry` into `value` for the caller to keep:
+ * a reference as is, data into a new block from `malloc()`.
+ */
+static bool value_copy(C_Table_Entry* entry, C_Userdata* value) {
+    C_Userdata ud;
+
+    entry_value(entry, &ud);
+    if (!C_Userdata_is_reference(&ud)) {
+        void* ptr = malloc(ud.len + 1);
+
+        if (ptr == NULL) return false;
+        memcpy(ptr, ud.ptr, ud.len);
+        ((uint8_t*)ptr)[ud.len] = '\0';
+        ud.ptr = ptr;
+    }
+    (*value) = ud;
+    return true;
+}
+
+/*
+ * Unlink the entry held by `link` in `idx`, copying its value into
+ * `oldvalue` if not NULL, and free it.
+ */
+static bool remove_link(C_Table* t, C_Table_Index* idx, C_Table_Entry** link, C_Userdata* oldvalue) {
+    C_Table_Entry* entry = *link;
+
+    if (oldvalue != NULL && !value_copy(entry, oldvalue)) {
+        return false;
+    }
+
+    unlink_entry(t, idx, link);
+
+    free_entry(t, entry, true);
+
+    t->nentries--;
+    t->modcount++;
+
+    return true;
+}
+
+/*
+ * Hand `ud` from an entry to the caller: as is if it came from `t->cp`
+ * or the caller, else as a copy in a new block from `malloc()`.
+ */
+static bool udrelease(C_Userdata* ud, uint16_t flags, uint16_t poolbit, uint16_t inlinebit) {
+    if (ud->len > 0 && ud->ptr != NULL && (flags & (poolbit | inlinebit))) {
+        void* ptr = malloc(ud->len + 1);
+
+        if (ptr == NULL) return false;
+        memcpy(ptr, ud->ptr, ud->len);
+        ((uint8_t*)ptr)[ud->len] = '\0';
+        ud->ptr = ptr;
+    }
+    return true;
+}
+
+/*
+ * Unlink the entry held by `link` in `idx`, handing its key and value
+ * to the caller, and free the entry alone.
+ */
+static bool take_link(C_Table* t, C_Table_Index* idx, C_Table_Entry** link, C_Userdata* key, C_Userdata* value) {
+    C_Table_Entry* entry = *link;
+    C_Userdata k, v;
+
+    entry_key(entry, &k);
+    entry_value(entry, &v);
+    if (!udrelease(&k, entry->flags, KEY_POOLED, KEY_INLINE)) {
+        return false;
     }
+    if (!udrelease(&v, entry->flags, VALUE_POOLED, VALUE_INLINE)) {
+        if (k.ptr != entry->kptr) {
+            free(k.ptr);
+        }
+        return false;
+    }
+
+    unlink_entry(t, idx, link);
+    forget_entry(t, entry);
+
+    t->nentries--;
+    t->modcount++;
 
-    return update_entry(t, entry, value);
+    (*key)   = k;
+    (*value) = v;
+    return true;
 }
 
 FMC_API bool C_Table_remove(C_Table* t, const C_Userdata* key) {
-    C_Table_Entry* entry;
-    C_Table_Entry* prev;
+    return C_Table_remove_value(t, key, NULL);
+}
+
+FMC_API bool C_Table_remove_value(C_Table* t, const C_Userdata* key, C_Userdata* oldvalue) {
+    C_Table_Index*  idx;
+    C_Table_Entry** link;
 
     if (!key) return false;
 
-    entry = find_entry(t, key, &prev);
-    if (entry == NULL) {
+    link = find_any_link(t, key, hashcode(t, key), &idx);
+    if (link == NULL) {
+        return false;
+    }
+    return remove_link(t, idx, link, oldvalue);
+}
+
+FMC_API bool C_Table_take(C_Table* t, const C_Userdata* key, C_Userdata* oldkey, C_Userdata* oldvalue) {
+    C_Table_Index*  idx;
+    C_Table_Entry** link;
+
+    if (!key || !oldkey || !oldvalue) return false;
+
+    link = find_any_link(t, key, hashcode(t, key), &idx);
+    if (link == NULL) {
         return false;
     }
+    return take_link(t, idx, link, oldkey, oldvalue);
+}
 
-    if (prev != NULL) {
-        prev->next = entry->next;
+/* ------------------------ Slot Functions ----------------------------- */
+
+/*
+ * Find the link holding `entry` itself, comparing no keys.
+ */
+static C_Table_Entry** link_to(C_Table* t, C_Table_Index* idx, C_Table_Entry* entry) {
+    if (idx->array == NULL) return NULL;
+
+    if (t->layout == C_TABLE_OPEN) {
+        uint64_t m     = mix(entry->hash);
+        uint8_t  h2    = (uint8_t)(m & 0x7F);
+        size_t   mask  = (idx->arraylen / GROUP_WIDTH) - 1;
+        size_t   group = (size_t)(m >> 7) & mask;
+
+        for (size_t step = 1; step <= mask + 1; step++) {
+            const uint8_t* ctrl = idx->ctrl + group * GROUP_WIDTH;
+            uint32_t bits = group_match(ctrl, h2);
+
+            while (bits != 0) {
+                C_Table_Entry** link = &(idx->array[group * GROUP_WIDTH + lowest_bit(bits)]);
+                if (*link == entry) {
+                    return link;
+                }
+                bits &= bits - 1;
+            }
+            if (group_match_empty(ctrl) != 0) {
+                break;
+            }
+            group = (group + step) & mask;
+        }
+        return NULL;
     } else {
-        size_t index = hashcode(t, key) % t->arraylen;
+        C_Table_Entry** link = &(idx->array[entry->hash % idx->arraylen]);
+
+        while (*link != NULL && *link != entry) {
+            link = &((*link)->next);
+        }
+        return (*link != NULL) ? link : NULL;
+    }
+}
+
+/*
+ * The slot's entry, found again if the table has since changed.
+ */
+static C_Table_Entry* slot_entry(C_Table_Slot* slot) {
+    C_Table* t = slot->table;
 
-        t->array[index] = entry->next;
+    if (slot->modcount != t->modcount) {
+        slot->entry    = find_entry(t, &(slot->key), slot->hash);
+        slot->modcount = t->modcount;
     }
+    return (C_Table_Entry*)slot->entry;
+}
 
-    udfree(t, &(entry->key));
-    udfree(t, &(entry->value));
+FMC_API bool C_Table_find_slot(C_Table* t, const C_Userdata* key, C_Table_Slot* slot) {
+    if (!slot) return false;
 
-    t->nentries--;
+    memset(slot, 0, sizeof(C_Table_Slot));
+    if (!t || !key) return false;
 
+    slot->table    = t;
+    slot->key      = *key;
+    slot->hash     = hashcode(t, key);
+    slot->entry    = find_entry(t, key, slot->hash);
+    slot->modcount = t->modcount;
+
+    return slot->entry != NULL;
+}
+
+FMC_API bool C_Table_Slot_get(C_Table_Slot* slot, C_Userdata* value) {
+    C_Table_Entry* entry;
+
+    if (!slot || !slot->table || !value) return false;
+
+    entry = slot_entry(slot);
+    if (entry == NULL) {
+        return false;
+    }
+    entry_value(entry, value);
     return true;
 }
 
-/* -------------------- Iterator Functions ------------------------- */
+FMC_API bool C_Table_Slot_set(C_Table_Slot* slot, const C_Userdata* value) {
+    C_Table_Entry* entry;
 
-struct C_Table_Iterator {
-    C_Table_Entry** entryset;
-    int             pos;
-    int             len;
-};
+    if (!slot || !slot->table || !value) return false;
 
-FMC_API void C_Table_new_iterator(C_Table* t, C_Table_Iterator* *iptr) {
-    C_Table_Iterator* result;
-    C_Table_Entry**   resultarr;
-    int               j, jmax;
+    entry = slot_entry(slot);
+    if (entry != NULL) {
+        return update_entry(slot->table, entry, value, false);
+    }
 
-    if (t == NULL || iptr == NULL) return;
+    entry = insert_pair(slot->table, &(slot->key), value, slot->hash, false);
+    if (entry == NULL) {
+        return false;
+    }
+    slot->entry    = entry;
+    slot->modcount = slot->table->modcount;
+    return true;
+}
 
-    result = (C_Table_Iterator*)malloc(sizeof(C_Table_Iterator));
-    if (result == NULL) return;
+FMC_API bool C_Table_Slot_remove(C_Table_Slot* slot, C_Userdata* oldvalue) {
+    C_Table* t;
+    C_Table_Entry* entry;
+    C_Table_Entry** link;
+    C_Table_Index* idx;
 
-    // Add empty slots before and after entries for before iteration
-    // starts and after it stops, lest we run off the array either way.
-    jmax = t->nentries + 1;
+    if (!slot || !slot->table) return false;
 
-    resultarr = (C_Table_Entry**)calloc(jmax + 1, sizeof(C_Table_Entry*));
-    if (result == NULL) {
-        free(result);
-        return;
+    t = slot->table;
+    entry = slot_entry(slot);
+    if (entry == NULL) {
+        return false;
     }
 
-    j = 1;
-    for (int i = 0; i < t->arraylen && j < jmax; i++) {
-        C_Table_Entry* curr = t->array[i];
+    // Lookups may have moved it during an incremental resize
+    idx = &(t->idx);
+    link = link_to(t, idx, entry);
+    if (link == NULL) {
+        idx = &(t->old);
+        link = link_to(t, idx, entry);
+    }
+    if (link == NULL || !remove_link(t, idx, link, oldvalue)) {
+        return false;
+    }
+    slot->entry    = NULL;
+    slot->modcount = t->modcount;
+    return true;
+}
 
-        while (curr != NULL) {
-            resultarr[j] = curr;
-            j++;
-            curr = curr->next;
+/* ----------------------- Batch Functions ----------------------------- */
+
+/*
+ * Prefetch where `h` starts in the index: its bucket head, or its first
+ * group's control bytes and slots.
+ */
+static inline void prefetch_bucket(C_Table* t, uint64_t h) {
+    C_Table_Index* idx = &(t->idx);
+
+    if (t->layout == C_TABLE_OPEN) {
+        size_t mask  = (idx->arraylen / GROUP_WIDTH) - 1;
+        size_t group = (size_t)(mix(h) >> 7) & mask;
+
+        prefetch(idx->ctrl + group * GROUP_WIDTH);
+        prefetch(idx->array + group * GROUP_WIDTH);
+    } else {
+        prefetch(idx->array + (h % idx->arraylen));
+    }
+}
+
+/*
+ * Prefetch an entry, which may straddle two cache lines.
+ */
+static inline void prefetch_lines(const C_Table_Entry* e) {
+    prefetch(e);
+    prefetch((const uint8_t*)e + sizeof(C_Table_Entry) - 1);
+}
+
+/*
+ * Prefetch the entry most likely to hold `h`, once its bucket is cached.
+ */
+static inline void prefetch_entry(C_Table* t, uint64_t h) {
+    C_Table_Index* idx = &(t->idx);
+
+    if (t->layout == C_TABLE_OPEN) {
+        uint64_t m     = mix(h);
+        size_t   mask  = (idx->arraylen / GROUP_WIDTH) - 1;
+        size_t   group = (size_t)(m >> 7) & mask;
+        uint32_t bits  = group_match(idx->ctrl + group * GROUP_WIDTH, (uint8_t)(m & 0x7F));
+
+        if (bits != 0) {
+            prefetch_lines(idx->array[group * GROUP_WIDTH + lowest_bit(bits)]);
+        }
+    } else {
+        C_Table_Entry* e = idx->array[h % idx->arraylen];
+
+        if (e != NULL) {
+            prefetch_lines(e);
+        }
+    }
+}
+
+/*
+ * Resolves one key of a batch, at index `i`, once its entry is (probably)
+ * in cache.
+ */
+typedef bool (*Batch_Step)(C_Table* t, size_t i, uint64_t h, void* data);
+
+/*
+ * Run `step` over `n` keys with their cache misses overlapped: hash each
+ * key and prefetch its bucket, some keys later prefetch the entry the
+ * bucket points to, and some keys later still hand it to `step`.
+ * Returns how many steps returned true.
+ */
+static size_t run_batch(C_Table* t, size_t n, const C_Userdata keys[], Batch_Step step, void* data) {
+    uint64_t hashes[PREFETCH_RING];
+    size_t count = 0;
+
+    for (size_t i = 0; i < n + 2 * PREFETCH_AHEAD; i++) {
+        if (i < n) {
+            uint64_t h = hashcode(t, &(keys[i]));
+
+            hashes[i % PREFETCH_RING] = h;
+            prefetch_bucket(t, h);
+        }
+        if (i >= PREFETCH_AHEAD && i - PREFETCH_AHEAD < n) {
+            prefetch_entry(t, hashes[(i - PREFETCH_AHEAD) % PREFETCH_RING]);
+        }
+        if (i >= 2 * PREFETCH_AHEAD) {
+            size_t j = i - 2 * PREFETCH_AHEAD;
+
+            if (step(t, j, hashes[j % PREFETCH_RING], data)) {
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+typedef struct _Get_Batch {
+    const C_Userdata* keys;
+    C_Userdata*       values;
+    bool*             found;
+} Get_Batch;
+
+static bool get_step(C_Table* t, size_t i, uint64_t h, void* data) {
+    Get_Batch* b = (Get_Batch*)data;
+    C_Table_Entry* entry = find_entry(t, &(b->keys[i]), h);
+
+    if (entry != NULL) {
+        entry_value(entry, &(b->values[i]));
+    } else {
+        C_Userdata_clear(&(b->values[i]), false);
+    }
+    if (b->found != NULL) {
+        b->found[i] = (entry != NULL);
+    }
+    return entry != NULL;
+}
+
+typedef struct _Put_Batch {
+    const C_Userdata* keys;
+    const C_Userdata* values;
+} Put_Batch;
+
+static bool put_step(C_Table* t, size_t i, uint64_t h, void* data) {
+    Put_Batch* b = (Put_Batch*)data;
+
+    return put_pair(t, &(b->keys[i]), &(b->values[i]), h, false);
+}
+
+FMC_API size_t C_Table_get_many(C_Table* t, size_t n, const C_Userdata keys[], C_Userdata values[], bool found[]) {
+    Get_Batch b;
+
+    if (t == NULL || keys == NULL || values == NULL) return 0;
+
+    b.keys   = keys;
+    b.values = values;
+    b.found  = found;
+    return run_batch(t, n, keys, get_step, &b);
+}
+
+FMC_API size_t C_Table_put_many(C_Table* t, size_t n, const C_Userdata keys[], const C_Userdata values[]) {
+    Put_Batch b;
+
+    if (t == NULL || keys == NULL || values == NULL) return 0;
+
+    b.keys   = keys;
+    b.values = values;
+    return run_batch(t, n, keys, put_step, &b);
+}
+
+/* -------------------- Statistics Functions ----------------------- */
+
+/*
+ * How far the entry in slot `i` of `idx` lies from its home group,
+ * in groups.
+ */
+static size_t open_probe(C_Table_Index* idx, size_t i, uint64_t h) {
+    size_t mask  = (idx->arraylen / GROUP_WIDTH) - 1;
+    size_t group = (size_t)(mix(h) >> 7) & mask;
+    size_t probe = 0;
+
+    while (group != i / GROUP_WIDTH && probe <= mask) {
+        probe++;
+        group = (group + probe) & mask;
+    }
+    return probe;
+}
+
+static void index_stats(C_Table* t, C_Table_Index* idx, C_Hash_Stats* stats) {
+    if (idx->array == NULL) return;
+
+    stats->buckets += idx->arraylen;
+    stats->bytes   += idx->arraylen * sizeof(C_Table_Entry*);
+    if (idx->ctrl != NULL) {
+        stats->bytes += idx->arraylen;
+    }
+
+    for (size_t i = 0; i < idx->arraylen; i++) {
+        C_Table_Entry* e = idx->array[i];
+        size_t depth = 0;
+
+        if (e != NULL) {
+            stats->occupied++;
+        }
+        for (; e != NULL; depth++) {
+            size_t probe = (t->layout == C_TABLE_OPEN) ? open_probe(idx, i, e->hash) : depth;
+
+            C_Hash_Stats_add_probe(stats, probe);
+
+            // Blocks from `cp`; we can only guess their size
+            if (e->klen > 0 && !(e->flags & (KEY_POOLED | KEY_INLINE))) {
+                stats->bytes += e->klen + 1;
+            }
+            if (e->vlen > 0 && !(e->flags & (VALUE_POOLED | VALUE_INLINE))) {
+                stats->bytes += e->vlen + 1;
+            }
+            e = (t->layout == C_TABLE_CHAINED) ? e->next : NULL;
+        }
+    }
+}
+
+FMC_API void C_Table_stats(C_Table* t, C_Hash_Stats* stats) {
+    C_Hash_Stats_clear(stats);
+    if (t == NULL || stats == NULL) return;
+
+    index_stats(t, &(t->old), stats);
+    index_stats(t, &(t->idx), stats);
+
+    stats->resizes = t->resizes;
+    stats->bytes  += sizeof(C_Table);
+    for (int i = 0; i < NPOOLS; i++) {
+        if (t->pools[i] != NULL) {
+            stats->bytes += C_Pool_bytes(t->pools[i]);
+        }
+    }
+}
+
+/* -------------------- Iterator Functions ------------------------- */
+
+/*
+ * The first entry in `t->idx` at or after bucket (or slot) `*bucket`,
+ * which is updated to hold it.
+ */
+static C_Table_Entry* scan_entries(C_Table* t, size_t* bucket) {
+    C_Table_Index* idx = &(t->idx);
+    size_t b;
+
+    for (b = *bucket; b < idx->arraylen; b++) {
+        if (idx->array[b] != NULL) {
+            *bucket = b;
+            return idx->array[b];
+        }
+    }
+    *bucket = b;
+    return NULL;
+}
+
+/*
+ * The entry after `e` in bucket `*bucket` or later.
+ */
+static inline C_Table_Entry* next_entry(C_Table* t, C_Table_Entry* e, size_t* bucket) {
+    if (t->layout == C_TABLE_CHAINED && e->next != NULL) {
+        return e->next;
+    }
+    (*bucket)++;
+    return scan_entries(t, bucket);
+}
+
+FMC_API size_t C_Table_for_each(C_Table* t, C_Table_Visitor f, void* data) {
+    C_Table_Entry* e;
+    size_t bucket = 0;
+    size_t count = 0;
+    size_t modcount;
+
+    if (t == NULL || f == NULL) return 0;
+
+    migrate(t, SIZE_MAX);
+    modcount = t->modcount;
+
+    e = scan_entries(t, &bucket);
+    while (e != NULL) {
+        C_Userdata key, value;
+        // Get the next entry first in case `f` replaces this one's value
+        C_Table_Entry* next = next_entry(t, e, &bucket);
+
+        entry_key(e, &key);
+        entry_value(e, &value);
+        count++;
+        if (!f(&key, &value, data) || t->modcount != modcount) {
+            break;
         }
+        e = next;
     }
-    result->entryset = resultarr;
-    result->pos = 0;
-    result->len = jmax;
+    return count;
+}
+
+FMC_API void C_Table_Iterator_init(C_Table* t, C_Table_Iterator* i) {
+    if (i == NULL) return;
+
+    memset(i, 0, sizeof(C_Table_Iterator));
+    if (t == NULL) return;
+
+    migrate(t, SIZE_MAX);
+
+    i->table    = t;
+    i->modcount = t->modcount;
+    i->next     = scan_entries(t, &(i->bucket));
+}
+
+FMC_API void C_Table_new_iterator(C_Table* t, C_Table_Iterator* *iptr) {
+    C_Table_Iterator* result;
+
+    if (t == NULL || iptr == NULL) return;
+
+    result = (C_Table_Iterator*)malloc(sizeof(C_Table_Iterator));
+    if (result == NULL) return;
+
+    C_Table_Iterator_init(t, result);
 
     *iptr = result;
 }
 
+FMC_API bool C_Table_Iterator_has_failed(C_Table_Iterator* i) {
+    return i->table != NULL && i->table->modcount != i->modcount;
+}
+
 FMC_API bool C_Table_Iterator_has_next(C_Table_Iterator* i) {
-    return i->pos < i->len - 1;
+    return i->next != NULL && !C_Table_Iterator_has_failed(i);
 }
 
 FMC_API void C_Table_Iterator_next(C_Table_Iterator* i) {
-    i->pos++;
+    if (!C_Table_Iterator_has_next(i)) {
+        i->curr = NULL;
+        i->next = NULL;
+        return;
+    }
+    i->curr = i->next;
+    i->next = next_entry(i->table, i->curr, &(i->bucket));
 }
 
 static C_Table_Entry* get_entry(C_Table_Iterator* i) {
-    if (i->pos >= 0 && i->pos < i->len) {
-        return i->entryset[i->pos];
+    if (C_Table_Iterator_has_failed(i)) {
+        return NULL;
     }
-    return NULL;
+    return i->curr;
 }
 
 FMC_API bool C_Table_Iterator_current_key(C_Table_Iterator* i, C_Userdata *key) {
     C_Table_Entry* entry = get_entry(i);
     if (entry == NULL) return false;
-    C_Userdata_set(key, entry->key.tag, entry->key.len, entry->key.ptr);
+    entry_key(entry, key);
     return true;
 }
 
 FMC_API bool C_Table_Iterator_current_pair(C_Table_Iterator* i, C_Userdata *key, C_Userdata *value) {
     C_Table_Entry* entry = get_entry(i);
     if (entry == NULL) return false;
-    C_Userdata_set(key, entry->key.tag, entry->key.len, entry->key.ptr);
-    C_Userdata_set(value, entry->value.tag, entry->value.len, entry->value.ptr);
+    entry_key(entry, key);
+    entry_value(entry, value);
     return true;
 }
 
 FMC_API bool C_Table_Iterator_free(C_Table_Iterator* *iptr) {
-    if (!(iptr)) return false;
+    if (!iptr || !(*iptr)) return false;
 
-    free((*iptr)->entryset);
     free(*iptr);
     *iptr = NULL;
     return true;
@@ -24,6 +24,7 @@
 #define FMC_TABLE_H_INCLUDED
 
 #include "common.h"
+#include "hash.h"
 
 /** @file */
 
@@ -70,12 +71,117 @@ typedef bool (*C_Userdata_Copy)(C_Userdata* dest, const C_Userdata* src);
 
 typedef void (*C_Userdata_Free)(C_Userdata* a);
 
+/**
+ * Called by `C_Table_for_each()` with each key and value in turn;
+ * returns false to stop early.
+ */
+typedef bool (*C_Table_Visitor)(const C_Userdata* key, const C_Userdata* value, void* data);
+
+/**
+ * A cursor over the entries of a table, walking its buckets in place.
+ * It may live anywhere, e.g. on the stack, once set up by
+ * `C_Table_Iterator_init()`.  Its fields are private.
+ */
+struct C_Table_Iterator {
+    C_Table* table;
+    void*    curr;
+    void*    next;
+    size_t   bucket;
+    size_t   modcount;
+};
+
+/**
+ * The place for one key in a table, whether or not it has an entry yet,
+ * from `C_Table_find_slot()`.  It holds the key's hash and entry so that
+ * getting, setting, and removing through it needn't look again.
+ * Its fields are private.
+ */
+typedef struct C_Table_Slot {
+    C_Table*   table;
+    C_Userdata key;
+    uint64_t   hash;
+    void*      entry;
+    size_t     modcount;
+} C_Table_Slot;
+
+/**
+ * How a `C_Table` arranges its entries in memory.
+ */
+typedef enum C_Table_Layout {
+    /**
+     * Closed addressing: each bucket holds a linked list of entries.
+     * This is the default.
+     */
+    C_TABLE_CHAINED = 0,
+
+    /**
+     * Open addressing ("Swiss table"): slots come in groups of 16, each
+     * slot paired with a control byte holding 7 bits of the key's hash.
+     * A lookup compares a whole group of control bytes at once (with SSE2
+     * where available) and only dereferences entries whose bits match,
+     * so collisions rarely cost a cache miss.
+     */
+    C_TABLE_OPEN = 1
+} C_Table_Layout;
 
+
+/**
+ * Creates a new table with the default layout (`C_TABLE_CHAINED`)
+ * and room for at least `minsz` entries.
+ */
 FMC_API void C_Table_new(C_Table* *tptr, size_t minsz);
 
+/**
+ * Creates a new table with the given `layout` and room for at least
+ * `minsz` entries.  Both layouts honor the same hash, equals, copy, and
+ * free functions and behave identically through this API.
+ */
+FMC_API void C_Table_new_with_layout(C_Table* *tptr, size_t minsz, C_Table_Layout layout);
+
+/**
+ * The layout `t` was created with.
+ */
+FMC_API C_Table_Layout C_Table_layout(C_Table* t);
+
 
 FMC_API size_t C_Table_size(C_Table* t);
 
+/**
+ * Sets how many buckets (or open slots) of the old index each add, get,
+ * has, put, or remove moves to the new index while `t` grows.
+ * With the default, 0, all entries move the moment the table grows,
+ * making that one insert as slow as the table is big.  Any other value
+ * spreads the move over later operations, at the cost of searching
+ * both indexes until it's done.  An operation moves more than
+ * `nbuckets` -- usually two -- when that many couldn't empty the old
+ * index before the new one fills, so no insert ever has to finish the
+ * move all at once.
+ */
+FMC_API void C_Table_set_resize_step(C_Table* t, size_t nbuckets);
+
+/**
+ * The number of buckets each operation migrates during a resize.
+ */
+FMC_API size_t C_Table_resize_step(C_Table* t);
+
+/**
+ * Whether `t` is partway through an incremental resize.
+ */
+FMC_API bool C_Table_is_resizing(C_Table* t);
+
+/**
+ * Completes any incremental resize in progress immediately.
+ */
+FMC_API void C_Table_finish_resize(C_Table* t);
+
+/**
+ * Fills in `*stats` with how well `t` spreads its keys.  For the open
+ * layout, probe lengths count groups of slots rather than single slots.
+ * Takes time proportional to the size of `t`; nothing is tracked
+ * between calls except the count of resizes.
+ */
+FMC_API void C_Table_stats(C_Table* t, C_Hash_Stats* stats);
+
 
 FMC_API void C_Table_define_hash_function(C_Table* t, C_Table_Hash);
 
@@ -94,6 +200,8 @@ FMC_API bool C_Table_add(C_Table* t, const C_Userdata* key, const C_Userdata* va
 /**
  * Get a shallow copy of the entry for `key` into `value`.
  * Returns false if the key was not found.
+ * The copy's data belongs to the table, and changes or disappears
+ * when the entry does.
  */
 FMC_API bool C_Table_get(C_Table* t, const C_Userdata* key, C_Userdata* value);
 
@@ -109,29 +217,153 @@ FMC_API bool C_Table_has(C_Table* t, const C_Userdata* key);
  */
 FMC_API bool C_Table_put(C_Table* t, const C_Userdata* key, const C_Userdata* value);
 
+/**
+ * Like `C_Table_add()`, but `t` takes over the data of `key` and `value`
+ * rather than copying it, and frees it later with its free function
+ * (by default `free()`).  References are stored as is.
+ * If this returns false the caller still owns both.
+ */
+FMC_API bool C_Table_add_owned(C_Table* t, const C_Userdata* key, const C_Userdata* value);
+
+/**
+ * Like `C_Table_put()`, but `t` takes over the data of `key` and `value`
+ * as `C_Table_add_owned()` does.  If `key` already has an entry, the
+ * entry keeps its own key and `t` frees the data of `key` at once.
+ * If this returns false the caller still owns both.
+ */
+FMC_API bool C_Table_put_owned(C_Table* t, const C_Userdata* key, const C_Userdata* value);
+
+/**
+ * Get values for `n` keys at once, as if by `C_Table_get()` on each.
+ * For a key not found, clears its value and sets its `found` flag false;
+ * `found` may be NULL.  Looking up a batch lets the table fetch many
+ * entries from memory at once.
+ * Returns the number of keys found.
+ */
+FMC_API size_t C_Table_get_many(C_Table* t, size_t n, const C_Userdata keys[], C_Userdata values[], bool found[]);
+
+/**
+ * Put `n` keys and values at once, in order, as if by `C_Table_put()`
+ * on each.
+ * Returns the number of pairs put successfully.
+ */
+FMC_API size_t C_Table_put_many(C_Table* t, size_t n, const C_Userdata keys[], const C_Userdata values[]);
+
 /**
  * Remove the entry for `key`.
  * Returns false if the operation could not be completed for some reason.
  */
 FMC_API bool C_Table_remove(C_Table* t, const C_Userdata* key);
 
+/**
+ * Remove the entry for `key`, first putting its value into `oldvalue`
+ * if not NULL.  A reference value is returned as is; data is copied into
+ * a new block to free with `C_Userdata_clear(oldvalue, true)`.
+ * Returns false if the key was not found or the copy failed.
+ */
+FMC_API bool C_Table_remove_value(C_Table* t, const C_Userdata* key, C_Userdata* oldvalue);
+
+/**
+ * Remove the entry for `key`, handing its key and value to the caller in
+ * `oldkey` and `oldvalue` instead of freeing them.  Data the table
+ * adopted or made with its copy function comes back as is; data it kept
+ * in its own storage comes back in a new block from `malloc()`.
+ * With the default copy and free functions, free both with
+ * `C_Userdata_clear(ud, true)`.
+ * Returns false if the key was not found or a copy failed.
+ */
+FMC_API bool C_Table_take(C_Table* t, const C_Userdata* key, C_Userdata* oldkey, C_Userdata* oldvalue);
+
 /**
  * Deletes the table and all memory it allocated.
  */
 FMC_API void C_Table_free(C_Table* *tptr);
 
+/* ---------------------- Slot Functions ------------------------- */
+
+/**
+ * Find the slot for `key` in `t`, hashing and probing just once, and
+ * return whether it holds an entry.
+ * The slot keeps a shallow copy of `key`, whose data must outlive it.
+ * Using the table other than through the slot may cost the slot a new
+ * lookup, but never makes it wrong.
+ */
+FMC_API bool C_Table_find_slot(C_Table* t, const C_Userdata* key, C_Table_Slot* slot);
+
+/**
+ * Get a shallow copy of the slot's value, as `C_Table_get()` would.
+ * Returns false if the slot is empty.
+ */
+FMC_API bool C_Table_Slot_get(C_Table_Slot* slot, C_Userdata* value);
+
+/**
+ * Put a deep copy of `value` in the slot, adding an entry for its key
+ * if it has none.
+ * Returns false only if the operation could not be completed.
+ */
+FMC_API bool C_Table_Slot_set(C_Table_Slot* slot, const C_Userdata* value);
+
+/**
+ * Remove the slot's entry, as `C_Table_remove_value()` would.
+ * Returns false if the slot is empty.
+ */
+FMC_API bool C_Table_Slot_remove(C_Table_Slot* slot, C_Userdata* oldvalue);
+
 /* -------------------- Iterator Functions ------------------------- */
 
+/**
+ * Call `f` with each key and value in `t`, plus `data`, until `f`
+ * returns false.  `f` must not add or remove entries; if it does,
+ * the walk stops.
+ * Returns how many entries `f` saw.
+ */
+FMC_API size_t C_Table_for_each(C_Table* t, C_Table_Visitor f, void* data);
+
+/**
+ * Set up `i` to walk the entries of `t` without allocating memory.
+ * Finishes any incremental resize first.
+ * Adding or removing an entry, or changing the hash function, fails the
+ * iterator: afterward it returns no more entries.  Replacing the value of
+ * an existing entry does not.
+ */
+FMC_API void C_Table_Iterator_init(C_Table* t, C_Table_Iterator* i);
+
+/**
+ * Allocate an iterator like `C_Table_Iterator_init()`.
+ * Free it with `C_Table_Iterator_free()`.
+ */
 FMC_API void C_Table_new_iterator(C_Table* t, C_Table_Iterator* *iptr);
 
+/**
+ * Whether a call to `C_Table_Iterator_next()` would find another entry.
+ */
 FMC_API bool C_Table_Iterator_has_next(C_Table_Iterator* i);
 
+/**
+ * Move to the next entry.  An iterator starts before the first entry.
+ */
 FMC_API void C_Table_Iterator_next(C_Table_Iterator* i);
 
+/**
+ * Whether the table has been added to or removed from since `i` was
+ * set up.
+ */
+FMC_API bool C_Table_Iterator_has_failed(C_Table_Iterator* i);
+
+/**
+ * Get the key of the current entry, or return false if there is none.
+ */
 FMC_API bool C_Table_Iterator_current_key(C_Table_Iterator* i, C_Userdata *key);
 
+/**
+ * Get the key and value of the current entry, or return false if there
+ * is none.
+ */
 FMC_API bool C_Table_Iterator_current_pair(C_Table_Iterator* i, C_Userdata *key, C_Userdata *val);
 
+/**
+ * Free an iterator from `C_Table_new_iterator()`.
+ */
 FMC_API bool C_Table_Iterator_free(C_Table_Iterator* *iptr);
 
 /* -------------------- Userdata Functions ------------------------- */
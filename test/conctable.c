@@ -0,0 +1,233 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "minctest.h"
+#include "conctable.h"
+
+#define NTHREADS    4
+#define NKEYS       5000
+
+static C_Concurrent_Table* t = NULL;
+
+static void setup() {
+    t = NULL;
+    C_Concurrent_Table_new(&t, 3);
+    lok(t != NULL);
+}
+
+static void teardown() {
+    C_Concurrent_Table_free(&t);
+    lok(t == NULL);
+}
+
+static void conctable_smoke() {
+    setup();
+
+    lequal(0, (int)C_Concurrent_Table_size(t));
+
+    teardown();
+}
+
+static void conctable_add_get() {
+    C_Userdata key, value, actual;
+
+    setup();
+
+    C_Userdata_set_string(&key, "key");
+    C_Userdata_set_string(&value, "value");
+
+    lok(!C_Concurrent_Table_has(t, &key));
+    lok(!C_Concurrent_Table_get(t, &key, &actual));
+
+    lok(C_Concurrent_Table_add(t, &key, &value));
+    lok(!C_Concurrent_Table_add(t, &key, &value));
+    lequal(1, (int)C_Concurrent_Table_size(t));
+    lok(C_Concurrent_Table_has(t, &key));
+
+    // We get our own copy
+    C_Userdata_clear(&actual, false);
+    lok(C_Concurrent_Table_get(t, &key, &actual));
+    lequal(5, (int)actual.len);
+    lsequal("value", (char*)actual.ptr);
+    lok(actual.ptr != value.ptr);
+    C_Userdata_clear(&actual, true);
+
+    // Pointer keys and values are themselves
+    C_Userdata_set_pointer(&key, &key);
+    C_Userdata_set_pointer(&value, &value);
+    lok(C_Concurrent_Table_add(t, &key, &value));
+    lok(C_Concurrent_Table_get(t, &key, &actual));
+    lequal(0, (int)actual.len);
+    lok(actual.ptr == &value);
+
+    teardown();
+}
+
+static void conctable_put_remove() {
+    char buf[32];
+    C_Userdata key, value, actual;
+
+    setup();
+
+    for (int i = 0; i < NKEYS; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Concurrent_Table_put(t, &key, &value));
+    }
+    lequal(NKEYS, (int)C_Concurrent_Table_size(t));
+
+    for (int i = 0; i < NKEYS; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)(-i));
+        lok(C_Concurrent_Table_put(t, &key, &value));
+    }
+    lequal(NKEYS, (int)C_Concurrent_Table_size(t));
+
+    for (int i = 0; i < NKEYS; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        lok(C_Concurrent_Table_get(t, &key, &actual));
+        lequal(-i, (int)(intptr_t)actual.ptr);
+        if (i % 2 == 0) {
+            lok(C_Concurrent_Table_remove(t, &key));
+            lok(!C_Concurrent_Table_remove(t, &key));
+            lok(!C_Concurrent_Table_has(t, &key));
+        }
+    }
+    lequal(NKEYS / 2, (int)C_Concurrent_Table_size(t));
+
+    teardown();
+}
+
+/*
+ * Each writer owns the keys equal to its number mod NTHREADS: it adds
+ * them, updates them, and removes half.  Readers check that every value
+ * they see belongs to its key.  minctest isn't thread-safe, so threads
+ * count their own failures.
+ */
+typedef struct {
+    int id;
+    int failures;
+    atomic_bool* done;
+} worker;
+
+static void* writer_main(void* arg) {
+    worker* w = (worker*)arg;
+    char buf[32];
+    C_Userdata key, value;
+
+    for (int i = w->id; i < NKEYS; i += NTHREADS) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_string(&value, buf);
+        if (!C_Concurrent_Table_add(t, &key, &value)) w->failures++;
+    }
+    for (int i = w->id; i < NKEYS; i += NTHREADS) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_string(&value, buf);
+        if (!C_Concurrent_Table_put(t, &key, &value)) w->failures++;
+        if (i % 2 == 1 && !C_Concurrent_Table_remove(t, &key)) w->failures++;
+    }
+    return NULL;
+}
+
+static void* reader_main(void* arg) {
+    worker* w = (worker*)arg;
+    char buf[32];
+    C_Userdata key, value;
+
+    while (!atomic_load(w->done)) {
+        for (int i = 0; i < NKEYS; i += 7) {
+            sprintf(buf, "key #%d", i);
+            C_Userdata_set_string(&key, buf);
+            if (C_Concurrent_Table_get(t, &key, &value)) {
+                if (strcmp(buf, (char*)value.ptr) != 0) w->failures++;
+                C_Userdata_clear(&value, true);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void conctable_threads() {
+    pthread_t writers[NTHREADS], readers[NTHREADS];
+    worker wws[NTHREADS], rws[NTHREADS];
+    atomic_bool done = false;
+    char buf[32];
+    C_Userdata key, value;
+
+    setup();
+
+    for (int i = 0; i < NTHREADS; i++) {
+        rws[i].id = i;
+        rws[i].failures = 0;
+        rws[i].done = &done;
+        lequal(0, pthread_create(&readers[i], NULL, reader_main, &rws[i]));
+    }
+    for (int i = 0; i < NTHREADS; i++) {
+        wws[i].id = i;
+        wws[i].failures = 0;
+        wws[i].done = &done;
+        lequal(0, pthread_create(&writers[i], NULL, writer_main, &wws[i]));
+    }
+    for (int i = 0; i < NTHREADS; i++) {
+        pthread_join(writers[i], NULL);
+        lequal(0, wws[i].failures);
+    }
+    atomic_store(&done, true);
+    for (int i = 0; i < NTHREADS; i++) {
+        pthread_join(readers[i], NULL);
+        lequal(0, rws[i].failures);
+    }
+
+    lequal(NKEYS / 2, (int)C_Concurrent_Table_size(t));
+    for (int i = 0; i < NKEYS; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        if (i % 2 == 0) {
+            lok(C_Concurrent_Table_get(t, &key, &value));
+            lsequal(buf, (char*)value.ptr);
+            C_Userdata_clear(&value, true);
+        } else {
+            lok(!C_Concurrent_Table_has(t, &key));
+        }
+    }
+
+    teardown();
+}
+
+int main (int argc, char* argv[]) {
+    lrun("conctable_smoke", conctable_smoke);
+    lrun("conctable_add_get", conctable_add_get);
+    lrun("conctable_put_remove", conctable_put_remove);
+    lrun("conctable_threads", conctable_threads);
+    lresults();
+    return lfails != 0;
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minctest.h"
+#include "hash.h"
+
+#define BUFSIZ_   256
+
+static int popcount64(uint64_t x) {
+    int count = 0;
+    while (x) {
+        x &= x - 1;
+        count++;
+    }
+    return count;
+}
+
+static void hash_repeatable() {
+    const char* str = "The quick brown fox jumps over the lazy dog";
+
+    lok(C_Hash_seed() == C_Hash_seed());
+    lok(C_Hash_bytes(str, strlen(str)) == C_Hash_bytes(str, strlen(str)));
+    lok(C_Hash_bytes(str, strlen(str))
+            == C_Hash_bytes_seeded(str, strlen(str), C_Hash_seed()));
+}
+
+static void hash_alignment() {
+    uint8_t buf[BUFSIZ_ + 8];
+    uint8_t src[BUFSIZ_];
+
+    for (int i = 0; i < BUFSIZ_; i++) {
+        src[i] = (uint8_t)(i * 7 + 3);
+    }
+
+    // The same bytes hash the same wherever they are in memory
+    for (size_t len = 0; len < BUFSIZ_; len++) {
+        uint64_t expected = C_Hash_bytes(src, len);
+
+        for (int off = 1; off < 8; off++) {
+            memcpy(buf + off, src, len);
+            lok(expected == C_Hash_bytes(buf + off, len));
+        }
+    }
+}
+
+static void hash_lengths() {
+    uint8_t zeros[BUFSIZ_];
+    uint64_t h[BUFSIZ_];
+
+    memset(zeros, 0, sizeof(zeros));
+
+    // Runs of zeros of different lengths must not collide
+    for (size_t len = 0; len < BUFSIZ_; len++) {
+        h[len] = C_Hash_bytes(zeros, len);
+        for (size_t j = 0; j < len; j++) {
+            lok(h[j] != h[len]);
+        }
+    }
+}
+
+static void hash_seeds() {
+    const char* str = "seed";
+
+    lok(C_Hash_bytes_seeded(str, 4, 1) != C_Hash_bytes_seeded(str, 4, 2));
+    lok(C_Hash_bytes_seeded(str, 4, 1) == C_Hash_bytes_seeded(str, 4, 1));
+}
+
+static void hash_avalanche() {
+    // Flipping any one input bit should flip about half the output bits
+    for (size_t len = 1; len <= 64; len *= 2) {
+        uint8_t buf[64];
+        double total = 0.0;
+        int trials = 0;
+
+        memset(buf, 0x5A, sizeof(buf));
+        for (size_t bit = 0; bit < len * 8; bit++) {
+            uint64_t before = C_Hash_bytes(buf, len);
+            buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+            total += popcount64(before ^ C_Hash_bytes(buf, len));
+            buf[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+            trials++;
+        }
+        lok(total / trials > 28.0 && total / trials < 36.0);
+    }
+}
+
+int main (int argc, char* argv[]) {
+    lrun("hash_repeatable", hash_repeatable);
+    lrun("hash_alignment", hash_alignment);
+    lrun("hash_lengths", hash_lengths);
+    lrun("hash_seeds", hash_seeds);
+    lrun("hash_avalanche", hash_avalanche);
+    lresults();
+    return lfails != 0;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minctest.h"
+#include "pool.h"
+
+#define NOBJS   1000
+
+static C_Pool* p = NULL;
+
+static void setup(size_t objsize) {
+    p = NULL;
+    C_Pool_new(&p, objsize);
+    lok(p != NULL);
+}
+
+static void teardown() {
+    C_Pool_free(&p);
+    lok(p == NULL);
+}
+
+static void pool_smoke() {
+    setup(24);
+
+    lok(C_Pool_object_size(p) >= 24);
+    lequal(0, (int)(C_Pool_object_size(p) % 16));
+    lequal(0, (int)C_Pool_bytes(p));
+
+    teardown();
+}
+
+static void pool_alloc() {
+    uint8_t* objs[NOBJS];
+    size_t size;
+
+    setup(40);
+    size = C_Pool_object_size(p);
+
+    for (int i = 0; i < NOBJS; i++) {
+        objs[i] = C_Pool_alloc(p);
+        lok(objs[i] != NULL);
+        lequal(0, (int)((uintptr_t)objs[i] % 16));
+        memset(objs[i], i & 0xFF, size);
+    }
+    lok(C_Pool_bytes(p) >= NOBJS * size);
+
+    // No block overlaps another
+    for (int i = 0; i < NOBJS; i++) {
+        for (size_t j = 0; j < size; j++) {
+            if (objs[i][j] != (i & 0xFF)) {
+                lok(false);
+                break;
+            }
+        }
+    }
+
+    teardown();
+}
+
+static void pool_recycle() {
+    void* objs[NOBJS];
+    size_t bytes;
+
+    setup(16);
+
+    for (int i = 0; i < NOBJS; i++) {
+        objs[i] = C_Pool_alloc(p);
+    }
+    bytes = C_Pool_bytes(p);
+
+    for (int i = 0; i < NOBJS; i++) {
+        C_Pool_recycle(p, objs[i]);
+    }
+
+    // Reallocating the same number of blocks needs no new slabs
+    for (int i = 0; i < NOBJS; i++) {
+        objs[i] = C_Pool_alloc(p);
+        lok(objs[i] != NULL);
+    }
+    lequal((int)bytes, (int)C_Pool_bytes(p));
+
+    teardown();
+}
+
+static void pool_slabs() {
+    const size_t nobjs = 256 * 1024;
+
+    setup(64);
+
+    lok(C_Pool_alloc(p) != NULL);
+    lequal(1, (int)C_Pool_slabs(p));
+    lequal(16 * 64, (int)C_Pool_bytes(p));
+
+    for (size_t i = 1; i < nobjs; i++) {
+        C_Pool_alloc(p);
+    }
+    lok(C_Pool_bytes(p) >= nobjs * 64);
+
+    // 16 MiB of blocks: slabs double up to 8 MiB, then stay that size
+    lok(C_Pool_slabs(p) <= 16);
+
+    teardown();
+}
+
+int main (int argc, char* argv[]) {
+    lrun("pool_smoke", pool_smoke);
+    lrun("pool_alloc", pool_alloc);
+    lrun("pool_recycle", pool_recycle);
+    lrun("pool_slabs", pool_slabs);
+    lresults();
+    return lfails != 0;
+}
@@ -26,6 +26,10 @@
 #include "minctest.h"
 #include "refset.h"
 
+// At 0.75 load a key rarely leaves its home group of eight
+#define MAX_PROBE   4
+#define MEAN_PROBE  1
+
 static C_Ref_Set* t = NULL;
 
 static const char* EXPECT[] = {
@@ -160,11 +164,225 @@ static void refset_iterator() {
 }
 
 
+static void refset_remove_many() {
+    // Adjacent bytes: every four share a home group
+    static char keys[4000];
+    const int nkeys = sizeof(keys);
+
+    setup();
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < nkeys; i++) {
+            lok(C_Ref_Set_add(t, keys + i));
+        }
+        lequal(nkeys, (int)C_Ref_Set_size(t));
+
+        // Removing keys mustn't hide the ones that collided with them
+        for (int i = 0; i < nkeys; i += 3) {
+            lok(C_Ref_Set_remove(t, keys + i));
+        }
+        for (int i = 0; i < nkeys; i++) {
+            lequal(i % 3 != 0, C_Ref_Set_has(t, keys + i));
+        }
+
+        for (int i = 0; i < nkeys; i++) {
+            C_Ref_Set_remove(t, keys + i);
+        }
+        lequal(0, (int)C_Ref_Set_size(t));
+    }
+
+    teardown();
+}
+
+static void refset_stats() {
+    C_Hash_Stats stats;
+    size_t total = 0;
+
+    setup();
+
+    for (int i = 0; i < EXPECTSZ; i++) {
+        lok(C_Ref_Set_add(t, EXPECT[i]));
+    }
+
+    C_Ref_Set_stats(t, &stats);
+    lequal(EXPECTSZ, (int)stats.entries);
+    lequal(EXPECTSZ, (int)stats.occupied);
+    lok(stats.buckets >= stats.occupied);
+    lok(stats.resizes > 0);
+    lok(stats.bytes >= stats.buckets * sizeof(void*));
+    for (int i = 0; i < C_HASH_STATS_BINS; i++) {
+        total += stats.histogram[i];
+    }
+    lequal(EXPECTSZ, (int)total);
+
+    teardown();
+}
+
+static void refset_shrink() {
+    static char keys[10000];
+    const int nkeys = sizeof(keys);
+    C_Hash_Stats stats;
+    C_Hash_Stats peak;
+    size_t resizes;
+
+    setup();
+
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Set_add(t, keys + k));
+    }
+    C_Ref_Set_stats(t, &peak);
+
+    // A burst dies off, and the set shrinks with it
+    for (int k = 10; k < nkeys; k++) {
+        lok(C_Ref_Set_remove(t, keys + k));
+    }
+    C_Ref_Set_stats(t, &stats);
+    lequal(10, (int)stats.entries);
+    lok(stats.buckets < peak.buckets / 16);
+    lok(stats.bytes < peak.bytes / 16);
+    lok(stats.resizes > peak.resizes);
+    for (int k = 0; k < nkeys; k++) {
+        lequal(k < 10, C_Ref_Set_has(t, keys + k));
+    }
+
+    // Hovering around a size doesn't flip it back and forth
+    resizes = stats.resizes;
+    for (int round = 0; round < 100; round++) {
+        lok(C_Ref_Set_add(t, keys + 10));
+        lok(C_Ref_Set_remove(t, keys + 10));
+    }
+    C_Ref_Set_stats(t, &stats);
+    lequal((int)resizes, (int)stats.resizes);
+
+    // With shrinking off, only compact() shrinks
+    C_Ref_Set_set_shrink_load(t, 0);
+    for (int k = 10; k < nkeys; k++) {
+        lok(C_Ref_Set_add(t, keys + k));
+    }
+    for (int k = 10; k < nkeys; k++) {
+        lok(C_Ref_Set_remove(t, keys + k));
+    }
+    C_Ref_Set_stats(t, &stats);
+    lequal((int)peak.buckets, (int)stats.buckets);
+
+    lok(C_Ref_Set_compact(t));
+    C_Ref_Set_stats(t, &stats);
+    lequal(16, (int)stats.buckets);
+    lequal(10, (int)stats.entries);
+    for (int k = 0; k < nkeys; k++) {
+        lequal(k < 10, C_Ref_Set_has(t, keys + k));
+    }
+
+    teardown();
+}
+
+static void refset_filter() {
+    static char keys[20000];
+    const int nkeys = sizeof(keys) / 2;
+    const char* misses = keys + nkeys;
+    int maybes = 0;
+
+    setup();
+
+    // Without a filter anything might be there
+    lok(C_Ref_Set_may_have(t, misses));
+    lequal(false, C_Ref_Set_may_have(t, NULL));
+
+    for (int k = 0; k < nkeys / 2; k++) {
+        lok(C_Ref_Set_add(t, keys + k));
+    }
+    lok(C_Ref_Set_set_filter(t, true));
+    for (int k = nkeys / 2; k < nkeys; k++) {
+        lok(C_Ref_Set_add(t, keys + k));
+    }
+
+    // No false negatives, and few false positives
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Set_may_have(t, keys + k));
+        lok(C_Ref_Set_has(t, keys + k));
+    }
+    for (int k = 0; k < nkeys; k++) {
+        if (C_Ref_Set_may_have(t, misses + k)) maybes++;
+        lequal(false, C_Ref_Set_has(t, misses + k));
+    }
+    lok(maybes < nkeys / 10);
+
+    // Removals and churn keep the filter honest
+    for (int k = 0; k < nkeys; k += 2) {
+        lok(C_Ref_Set_remove(t, keys + k));
+    }
+    for (int round = 0; round < 10; round++) {
+        for (int k = 1; k < nkeys; k += 2) {
+            lok(C_Ref_Set_remove(t, keys + k));
+        }
+        for (int k = 1; k < nkeys; k += 2) {
+            lok(C_Ref_Set_add(t, keys + k));
+        }
+    }
+    for (int k = 0; k < nkeys; k++) {
+        lequal(k % 2 == 1, C_Ref_Set_has(t, keys + k));
+    }
+    maybes = 0;
+    for (int k = 0; k < nkeys; k++) {
+        if (C_Ref_Set_may_have(t, misses + k)) maybes++;
+    }
+    lok(maybes < nkeys / 10);
+
+    lok(C_Ref_Set_compact(t));
+    for (int k = 0; k < nkeys; k++) {
+        lequal(k % 2 == 1, C_Ref_Set_has(t, keys + k));
+    }
+
+    lok(C_Ref_Set_set_filter(t, false));
+    lok(C_Ref_Set_may_have(t, misses));
+    for (int k = 0; k < nkeys; k++) {
+        lequal(k % 2 == 1, C_Ref_Set_has(t, keys + k));
+    }
+
+    teardown();
+}
+
+static void refset_aligned_keys() {
+    // malloc() blocks and 64-byte strides leave the low bits constant
+    const int nkeys = 10000;
+    static char block[10000 * 64];
+    void* keys[10000];
+    C_Hash_Stats stats;
+
+    for (int round = 0; round < 2; round++) {
+        t = NULL;
+        C_Ref_Set_new(&t, 0);
+        lok(t != NULL);
+
+        for (int i = 0; i < nkeys; i++) {
+            keys[i] = (round == 0) ? malloc(16) : block + 64 * i;
+            lok(C_Ref_Set_add(t, keys[i]));
+        }
+
+        C_Ref_Set_stats(t, &stats);
+        lequal(nkeys, (int)stats.entries);
+        lok(stats.max_probe <= MAX_PROBE);
+        lok(stats.total_probe <= MEAN_PROBE * nkeys);
+
+        if (round == 0) {
+            for (int i = 0; i < nkeys; i++) {
+                free(keys[i]);
+            }
+        }
+        C_Ref_Set_free(&t);
+    }
+}
+
 int main (int argc, char* argv[]) {
     lrun("refset_smoke", refset_smoke);
     lrun("refset_add", refset_add);
     lrun("refset_remove", refset_remove);
     lrun("refset_iterator", refset_iterator);
+    lrun("refset_remove_many", refset_remove_many);
+    lrun("refset_aligned_keys", refset_aligned_keys);
+    lrun("refset_shrink", refset_shrink);
+    lrun("refset_filter", refset_filter);
+    lrun("refset_stats", refset_stats);
     lresults();
     return lfails != 0;
 }
@@ -26,7 +26,12 @@
 #include "minctest.h"
 #include "reftable.h"
 
+// Robin Hood at 0.9 load keeps probes within a few dozen slots
+#define MAX_PROBE   32
+#define MEAN_PROBE  3
+
 static C_Ref_Table* t = NULL;
+static C_Ref_Table_Layout layout = C_REF_TABLE_PAIRS;
 
 typedef struct _kvpair {
     const char* key; 
@@ -35,8 +40,9 @@ typedef struct _kvpair {
 
 static void setup() {
     t = NULL;
-    C_Ref_Table_new(&t, 3);
+    C_Ref_Table_new_with_layout(&t, 3, layout);
     lok(t != NULL);
+    lequal(layout, C_Ref_Table_layout(t));
 }
 
 static void teardown() {
@@ -134,11 +140,331 @@ static void reftbl_remove() {
     teardown();
 }
 
+static void reftbl_stats() {
+    static const char* keys[] = {
+        "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+        "hotel", "india", NULL
+    };
+    C_Hash_Stats stats;
+    size_t total = 0;
+    int n = 0;
+
+    setup();
+
+    C_Ref_Table_stats(t, &stats);
+    lequal(0, (int)stats.entries);
+    lequal(0, (int)stats.resizes);
+
+    for (n = 0; keys[n] != NULL; n++) {
+        lok(C_Ref_Table_put(t, keys[n], keys[n], NULL));
+    }
+
+    C_Ref_Table_stats(t, &stats);
+    lequal(n, (int)stats.entries);
+    lequal(n, (int)stats.occupied);
+    lok(stats.buckets >= stats.occupied);
+    lok(stats.resizes > 0);
+    for (int i = 0; i < C_HASH_STATS_BINS; i++) {
+        total += stats.histogram[i];
+    }
+    lequal(n, (int)total);
+
+    teardown();
+}
+
+static void reftbl_remove_many() {
+    // Adjacent bytes: every four share a home slot
+    static char keys[4000];
+    const int nkeys = sizeof(keys);
+    C_Hash_Stats stats;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        lok(C_Ref_Table_put(t, keys + i, keys + nkeys - i, NULL));
+    }
+    lequal(nkeys, (int)C_Ref_Table_size(t));
+
+    // Removing keys mustn't hide the ones that collided with them
+    for (int i = 0; i < nkeys; i += 3) {
+        lok(C_Ref_Table_remove(t, keys + i, NULL));
+    }
+    for (int i = 0; i < nkeys; i++) {
+        if (i % 3 == 0) {
+            lequal(false, C_Ref_Table_has(t, keys + i));
+        } else {
+            lok(C_Ref_Table_get(t, keys + i) == keys + nkeys - i);
+        }
+    }
+    lequal(nkeys - (nkeys + 2) / 3, (int)C_Ref_Table_size(t));
+
+    C_Ref_Table_stats(t, &stats);
+    lequal((int)C_Ref_Table_size(t), (int)stats.entries);
+
+    for (int i = 0; i < nkeys; i++) {
+        C_Ref_Table_remove(t, keys + i, NULL);
+    }
+    lequal(0, (int)C_Ref_Table_size(t));
+    C_Ref_Table_stats(t, &stats);
+    lequal(0, (int)stats.occupied);
+
+    teardown();
+}
+
+static void reftbl_aligned_keys() {
+    // malloc() blocks and 64-byte strides leave the low bits constant
+    const int nkeys = 10000;
+    static char block[10000 * 64];
+    void* keys[10000];
+    C_Hash_Stats stats;
+
+    for (int round = 0; round < 2; round++) {
+        t = NULL;
+        C_Ref_Table_new_with_layout(&t, 0, layout);
+        lok(t != NULL);
+
+        for (int i = 0; i < nkeys; i++) {
+            keys[i] = (round == 0) ? malloc(16) : block + 64 * i;
+            lok(C_Ref_Table_put(t, keys[i], keys[i], NULL));
+        }
+
+        C_Ref_Table_stats(t, &stats);
+        lequal(nkeys, (int)stats.entries);
+        lok(stats.max_probe <= MAX_PROBE);
+        lok(stats.total_probe <= MEAN_PROBE * nkeys);
+
+        if (round == 0) {
+            for (int i = 0; i < nkeys; i++) {
+                free(keys[i]);
+            }
+        }
+        C_Ref_Table_free(&t);
+    }
+}
+
+static void reftbl_iterator() {
+    static char keys[100];
+    const int nkeys = sizeof(keys);
+    int seen[sizeof(keys)];
+    C_Ref_Table_Iterator i;
+    C_Ref_Table_Iterator* ip = NULL;
+    int count = 0;
+
+    setup();
+
+    // Nothing to see in an empty table
+    C_Ref_Table_Iterator_init(t, &i);
+    lequal(false, C_Ref_Table_Iterator_has_next(&i));
+    lok(C_Ref_Table_Iterator_current_key(&i) == NULL);
+
+    memset(seen, 0, sizeof(seen));
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Table_put(t, keys + k, keys + nkeys - k, NULL));
+    }
+
+    C_Ref_Table_Iterator_init(t, &i);
+    while (C_Ref_Table_Iterator_has_next(&i)) {
+        const char* key;
+
+        C_Ref_Table_Iterator_next(&i);
+        key = C_Ref_Table_Iterator_current_key(&i);
+        lok(key >= keys && key < keys + nkeys);
+        lok(C_Ref_Table_Iterator_current_value(&i) == keys + nkeys - (key - keys));
+        seen[key - keys]++;
+        count++;
+    }
+    lequal(nkeys, count);
+    for (int k = 0; k < nkeys; k++) {
+        lequal(1, seen[k]);
+    }
+
+    // Replacing a value doesn't disturb the walk
+    C_Ref_Table_new_iterator(t, &ip);
+    lok(ip != NULL);
+    C_Ref_Table_Iterator_next(ip);
+    lok(C_Ref_Table_put(t, C_Ref_Table_Iterator_current_key(ip), "new", NULL));
+    lequal(false, C_Ref_Table_Iterator_has_failed(ip));
+    lsequal("new", (const char*)C_Ref_Table_Iterator_current_value(ip));
+
+    // Removing a key does
+    lok(C_Ref_Table_remove(t, C_Ref_Table_Iterator_current_key(ip), NULL));
+    lok(C_Ref_Table_Iterator_has_failed(ip));
+    lequal(false, C_Ref_Table_Iterator_has_next(ip));
+    lok(C_Ref_Table_Iterator_current_key(ip) == NULL);
+    lok(C_Ref_Table_Iterator_free(&ip));
+    lok(ip == NULL);
+
+    teardown();
+}
+
+static void reftbl_reserve_clear() {
+    static char keys[1000];
+    const int nkeys = sizeof(keys);
+    C_Hash_Stats stats;
+    size_t resizes;
+
+    setup();
+
+    lok(C_Ref_Table_reserve(t, nkeys));
+    C_Ref_Table_stats(t, &stats);
+    resizes = stats.resizes;
+
+    // Room enough for all of them
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Table_put(t, keys + k, keys + k, NULL));
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal((int)resizes, (int)stats.resizes);
+
+    // Reserving less than we have changes nothing
+    lok(C_Ref_Table_reserve(t, 10));
+    lequal(nkeys, (int)C_Ref_Table_size(t));
+
+    // Clearing keeps the array
+    C_Ref_Table_clear(t);
+    lequal(0, (int)C_Ref_Table_size(t));
+    for (int k = 0; k < nkeys; k++) {
+        lequal(false, C_Ref_Table_has(t, keys + k));
+    }
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Table_put(t, keys + k, keys + k, NULL));
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal((int)resizes, (int)stats.resizes);
+
+    teardown();
+}
+
+static void reftbl_shrink() {
+    static char keys[10000];
+    const int nkeys = sizeof(keys);
+    C_Hash_Stats stats;
+    C_Hash_Stats peak;
+    size_t resizes;
+
+    setup();
+
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Table_put(t, keys + k, keys + k, NULL));
+    }
+    C_Ref_Table_stats(t, &peak);
+
+    // A burst dies off, and the table shrinks with it
+    for (int k = 10; k < nkeys; k++) {
+        lok(C_Ref_Table_remove(t, keys + k, NULL));
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal(10, (int)stats.entries);
+    lok(stats.buckets < peak.buckets / 16);
+    lok(stats.bytes < peak.bytes / 16);
+    lok(stats.resizes > peak.resizes);
+    for (int k = 0; k < 10; k++) {
+        lok(C_Ref_Table_get(t, keys + k) == keys + k);
+    }
+
+    // Hovering around a size doesn't flip it back and forth
+    resizes = stats.resizes;
+    for (int round = 0; round < 100; round++) {
+        lok(C_Ref_Table_put(t, keys + 10, keys + 10, NULL));
+        lok(C_Ref_Table_remove(t, keys + 10, NULL));
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal((int)resizes, (int)stats.resizes);
+
+    // Not below the size it started with
+    for (int k = 0; k < 10; k++) {
+        lok(C_Ref_Table_remove(t, keys + k, NULL));
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal(8, (int)stats.buckets);
+
+    // With shrinking off, only compact() shrinks
+    C_Ref_Table_set_shrink_load(t, 0);
+    for (int k = 0; k < nkeys; k++) {
+        lok(C_Ref_Table_put(t, keys + k, keys + k, NULL));
+    }
+    for (int k = 10; k < nkeys; k++) {
+        lok(C_Ref_Table_remove(t, keys + k, NULL));
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal((int)peak.buckets, (int)stats.buckets);
+
+    lok(C_Ref_Table_compact(t));
+    C_Ref_Table_stats(t, &stats);
+    lequal(16, (int)stats.buckets);
+    lequal(10, (int)stats.entries);
+    for (int k = 0; k < 10; k++) {
+        lok(C_Ref_Table_get(t, keys + k) == keys + k);
+    }
+
+    teardown();
+}
+
+static void reftbl_put_many() {
+    static char keys[1000];
+    const int nkeys = sizeof(keys);
+    const void* k[sizeof(keys) + 1];
+    const void* v[sizeof(keys) + 1];
+    C_Hash_Stats stats;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        k[i] = keys + i;
+        v[i] = keys + nkeys - 1 - i;
+    }
+    // A null key fails alone
+    k[nkeys] = NULL;
+    v[nkeys] = NULL;
+
+    lequal(nkeys, (int)C_Ref_Table_put_many(t, nkeys + 1, k, v));
+    lequal(nkeys, (int)C_Ref_Table_size(t));
+    for (int i = 0; i < nkeys; i++) {
+        lok(C_Ref_Table_get(t, keys + i) == keys + nkeys - 1 - i);
+    }
+
+    // Only one resize for the lot
+    C_Ref_Table_stats(t, &stats);
+    lequal(1, (int)stats.resizes);
+
+    // Putting the same keys again replaces values
+    lequal(nkeys, (int)C_Ref_Table_put_many(t, nkeys, v, k));
+    lequal(nkeys, (int)C_Ref_Table_size(t));
+    for (int i = 0; i < nkeys; i++) {
+        lok(C_Ref_Table_get(t, keys + nkeys - 1 - i) == keys + i);
+    }
+    C_Ref_Table_stats(t, &stats);
+    lequal(1, (int)stats.resizes);
+
+    teardown();
+}
+
 int main (int argc, char* argv[]) {
+    layout = C_REF_TABLE_PAIRS;
     lrun("reftbl_smoke", reftbl_smoke);
     lrun("reftbl_put", reftbl_put);
     lrun("reftbl_put_multiple", reftbl_put_multiple);
     lrun("reftbl_remove", reftbl_remove);
+    lrun("reftbl_remove_many", reftbl_remove_many);
+    lrun("reftbl_aligned_keys", reftbl_aligned_keys);
+    lrun("reftbl_iterator", reftbl_iterator);
+    lrun("reftbl_reserve_clear", reftbl_reserve_clear);
+    lrun("reftbl_shrink", reftbl_shrink);
+    lrun("reftbl_put_many", reftbl_put_many);
+    lrun("reftbl_stats", reftbl_stats);
+
+    layout = C_REF_TABLE_SPLIT;
+    lrun("reftbl_smoke (split)", reftbl_smoke);
+    lrun("reftbl_put (split)", reftbl_put);
+    lrun("reftbl_put_multiple (split)", reftbl_put_multiple);
+    lrun("reftbl_remove (split)", reftbl_remove);
+    lrun("reftbl_remove_many (split)", reftbl_remove_many);
+    lrun("reftbl_aligned_keys (split)", reftbl_aligned_keys);
+    lrun("reftbl_iterator (split)", reftbl_iterator);
+    lrun("reftbl_reserve_clear (split)", reftbl_reserve_clear);
+    lrun("reftbl_shrink (split)", reftbl_shrink);
+    lrun("reftbl_put_many (split)", reftbl_put_many);
+    lrun("reftbl_stats (split)", reftbl_stats);
     lresults();
     return lfails != 0;
 }
@@ -23,10 +23,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "minctest.h"
 #include "strtable.h"
 
 static C_String_Table* t = NULL;
+static C_String_Table_Layout layout = C_STRING_TABLE_HASHED;
 
 typedef struct _kvpair {
     const char* key; 
@@ -35,8 +37,9 @@ typedef struct _kvpair {
 
 static void setup() {
     t = NULL;
-    C_String_Table_new(&t, 3);
+    C_String_Table_new_with_layout(&t, 3, layout);
     lok(t != NULL);
+    lequal(layout, C_String_Table_layout(t));
 }
 
 static void teardown() {
@@ -137,11 +140,796 @@ static void table_remove() {
     teardown();
 }
 
+static void table_stats() {
+    const int nkeys = 100;
+    char buf[32];
+    C_Hash_Stats stats;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        lok(C_String_Table_add(t, strlen(buf), (const uint8_t*)buf, "value"));
+    }
+
+    C_String_Table_stats(t, &stats);
+    lequal(nkeys, (int)stats.entries);
+    lok(stats.occupied > 0);
+    lok(stats.occupied <= stats.buckets);
+    if (layout == C_STRING_TABLE_HASHED) {
+        lok(stats.resizes > 0);
+    }
+    lok(stats.bytes > 0);
+
+    teardown();
+}
+
+static void table_binary_keys() {
+    static uint8_t longkey[1000];
+    const uint8_t nuls[] = { 'a', 0, 'b', 0 };
+    const void* oldvalue;
+
+    setup();
+
+    for (int i = 0; i < (int)sizeof(longkey); i++) {
+        longkey[i] = (uint8_t)(i * 7);
+    }
+
+    // Empty keys, embedded nulls, and keys too long for one length byte
+    lok(C_String_Table_add(t, 0, (const uint8_t*)"", "empty"));
+    lok(C_String_Table_add(t, 4, nuls, "nuls"));
+    lok(C_String_Table_add(t, 2, nuls, "a0"));
+    lok(C_String_Table_add(t, sizeof(longkey), longkey, "long"));
+    lok(C_String_Table_add(t, 200, longkey, "shorter"));
+    lequal(5, (int)C_String_Table_size(t));
+
+    lsequal("empty", (const char*)C_String_Table_get(t, 0, (const uint8_t*)"x"));
+    lsequal("nuls", (const char*)C_String_Table_get(t, 4, nuls));
+    lsequal("a0", (const char*)C_String_Table_get(t, 2, nuls));
+    lsequal("long", (const char*)C_String_Table_get(t, sizeof(longkey), longkey));
+    lsequal("shorter", (const char*)C_String_Table_get(t, 200, longkey));
+    lequal(false, C_String_Table_has(t, 1, nuls));
+    lequal(false, C_String_Table_has(t, 3, nuls));
+    lequal(false, C_String_Table_has(t, 199, longkey));
+
+    // Null keys and values are never allowed
+    lequal(false, C_String_Table_add(t, 0, NULL, "null"));
+    lequal(false, C_String_Table_add(t, 3, (const uint8_t*)"key", NULL));
+    lequal(false, C_String_Table_has(t, 0, NULL));
+    lok(C_String_Table_get(t, 0, NULL) == NULL);
+    lequal(false, C_String_Table_remove(t, 0, NULL, &oldvalue));
+    lok(oldvalue == NULL);
+
+    teardown();
+}
+
+static void table_churn() {
+    const int nkeys = 2000;
+    char buf[64];
+    C_Hash_Stats stats;
+    size_t bytes;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "a key long enough to fill an arena #%d", i);
+        lok(C_String_Table_add(t, strlen(buf), (const uint8_t*)buf, t));
+    }
+    C_String_Table_stats(t, &stats);
+    bytes = stats.bytes;
+
+    // Removed keys' room is reused, not added to
+    for (int round = 0; round < 20; round++) {
+        for (int i = round; i < nkeys; i += 4) {
+            sprintf(buf, "a key long enough to fill an arena #%d", i);
+            lok(C_String_Table_remove(t, strlen(buf), (const uint8_t*)buf, NULL));
+        }
+        for (int i = round; i < nkeys; i += 4) {
+            sprintf(buf, "a key long enough to fill an arena #%d", i);
+            lok(C_String_Table_add(t, strlen(buf), (const uint8_t*)buf, "again"));
+        }
+    }
+    C_String_Table_stats(t, &stats);
+    lok(stats.bytes < 2 * bytes);
+    lequal(nkeys, (int)stats.entries);
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "a key long enough to fill an arena #%d", i);
+        lok(C_String_Table_has(t, strlen(buf), (const uint8_t*)buf));
+    }
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "a key long enough to fill an arena #%d", i);
+        lok(C_String_Table_remove(t, strlen(buf), (const uint8_t*)buf, NULL));
+    }
+    lequal(0, (int)C_String_Table_size(t));
+
+    teardown();
+}
+
+static void table_freeze() {
+    const int nkeys = 5000;
+    char buf[32];
+    C_Hash_Stats stats;
+
+    setup();
+
+    lequal(false, C_String_Table_is_frozen(t));
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        lok(C_String_Table_add(t, strlen(buf), (const uint8_t*)buf, t));
+    }
+    // Removed keys don't come back
+    for (int i = 0; i < nkeys; i += 5) {
+        sprintf(buf, "key #%d", i);
+        lok(C_String_Table_remove(t, strlen(buf), (const uint8_t*)buf, NULL));
+    }
+
+    lok(C_String_Table_freeze(t));
+    lok(C_String_Table_is_frozen(t));
+    lok(C_String_Table_freeze(t));
+    lequal(nkeys - nkeys / 5, (int)C_String_Table_size(t));
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        if (i % 5 == 0) {
+            lequal(false, C_String_Table_has(t, strlen(buf), (const uint8_t*)buf));
+        } else {
+            lok(C_String_Table_get(t, strlen(buf), (const uint8_t*)buf) == t);
+        }
+        sprintf(buf, "not key #%d", i);
+        lok(C_String_Table_get(t, strlen(buf), (const uint8_t*)buf) == NULL);
+    }
+
+    // No more changes
+    lequal(false, C_String_Table_add(t, 3, (const uint8_t*)"new", t));
+    lequal(false, C_String_Table_remove(t, 7, (const uint8_t*)"key #1", NULL));
+    lequal(nkeys - nkeys / 5, (int)C_String_Table_size(t));
+
+    // One slot per key, and every key in its slot
+    C_String_Table_stats(t, &stats);
+    lequal(nkeys - nkeys / 5, (int)stats.entries);
+    if (layout == C_STRING_TABLE_HASHED) {
+        lequal(nkeys - nkeys / 5, (int)stats.buckets);
+        lequal(0, (int)stats.max_probe);
+    }
+
+    teardown();
+
+    // An empty table freezes too
+    setup();
+    lok(C_String_Table_freeze(t));
+    lequal(false, C_String_Table_has(t, 3, (const uint8_t*)"key"));
+    lok(C_String_Table_get(t, 0, (const uint8_t*)"") == NULL);
+    teardown();
+}
+
+/*
+ * Keys over a small alphabet, so they share prefixes of every length,
+ * some longer than a tree node stores.
+ */
+static int make_key(char* buf, unsigned seed) {
+    static const char* stems[] = { "", "a", "ab", "abcdefghijklmnopqrstuvwxyz", "b" };
+    int len = sprintf(buf, "%s", stems[seed % 5]);
+
+    seed /= 5;
+    while (seed > 0) {
+        buf[len++] = "abc"[seed % 3];
+        seed /= 3;
+    }
+    buf[len] = '\0';
+    return len;
+}
+
+static int compare_keys(const void* a, const void* b) {
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+typedef struct _visited {
+    int   count;
+    bool  sorted;
+    char  last[64];
+    const char* prefix;
+} visited;
+
+static bool visit(size_t keylen, const uint8_t* key, const void* value, void* data) {
+    visited* v = (visited*)data;
+    char buf[64];
+
+    memcpy(buf, key, keylen);
+    buf[keylen] = '\0';
+    lsequal(buf, (const char*)value);
+    if (v->count > 0 && strcmp(v->last, buf) >= 0) {
+        v->sorted = false;
+    }
+    if (v->prefix != NULL) {
+        lequal(0, strncmp(buf, v->prefix, strlen(v->prefix)));
+    }
+    strcpy(v->last, buf);
+    v->count++;
+    return true;
+}
+
+static bool stop_at_three(size_t keylen, const uint8_t* key, const void* value, void* data) {
+    return ++(*(int*)data) < 3;
+}
+
+/*
+ * Far more keys than a bucket may try pilots (1 << 16 in strtable.c),
+ * so the last buckets only find slots because the hash leaves spares.
+ */
+static void table_freeze_large() {
+    const int nkeys = 300000;
+    char buf[32];
+    int missing = 0;
+
+    setup();
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "word:%d", i);
+        C_String_Table_add(t, strlen(buf), (const uint8_t*)buf, (void*)(uintptr_t)(i + 1));
+    }
+    lequal(nkeys, (int)C_String_Table_size(t));
+    lok(C_String_Table_freeze(t));
+    lequal(nkeys, (int)C_String_Table_size(t));
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "word:%d", i);
+        if (C_String_Table_get(t, strlen(buf), (const uint8_t*)buf) != (void*)(uintptr_t)(i + 1)) {
+            missing++;
+        }
+        sprintf(buf, "none:%d", i);
+        if (C_String_Table_has(t, strlen(buf), (const uint8_t*)buf)) {
+            missing++;
+        }
+    }
+    lequal(0, missing);
+
+    teardown();
+}
+
+/*
+ * Saving an unfrozen table freezes a copy; that too must work for
+ * far more keys than a bucket may try pilots.
+ */
+static void table_save_large() {
+    char path[] = "/tmp/strtbl-test-XXXXXX";
+    const int nkeys = 300000;
+    C_String_Table* m = NULL;
+    char buf[32];
+    int missing = 0;
+    int fd;
+
+    fd = mkstemp(path);
+    lok(fd >= 0);
+    close(fd);
+
+    setup();
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "word:%d", i);
+        C_String_Table_add(t, strlen(buf), (const uint8_t*)buf, (void*)(uintptr_t)(i + 1));
+    }
+    lok(C_String_Table_save(t, path, NULL, NULL));
+    lok(!C_String_Table_is_frozen(t));
+    lok(C_String_Table_map(&m, path));
+    lequal(nkeys, (int)C_String_Table_size(m));
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "word:%d", i);
+        if (C_String_Table_get(m, strlen(buf), (const uint8_t*)buf) != (void*)(uintptr_t)(i + 1)) {
+            missing++;
+        }
+    }
+    lequal(0, missing);
+
+    C_String_Table_free(&m);
+    remove(path);
+    teardown();
+}
+
+static void table_for_each() {
+    static char keys[2000][64];
+    const char* present[2000];
+    const int nkeys = 2000;
+    int npresent = 0;
+    char prefix[64];
+    visited v;
+    int count = 0;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        int len = make_key(keys[i], i * 7919 % 100003);
+        lok(C_String_Table_add(t, len, (const uint8_t*)keys[i], keys[i])
+            || C_String_Table_has(t, len, (const uint8_t*)keys[i]));
+    }
+    for (int i = 0; i < nkeys; i += 3) {
+        C_String_Table_remove(t, strlen(keys[i]), (const uint8_t*)keys[i], NULL);
+    }
+    for (int i = 0; i < nkeys; i++) {
+        const void* value = C_String_Table_get(t, strlen(keys[i]), (const uint8_t*)keys[i]);
+
+        if (value != NULL) {
+            lsequal(keys[i], (const char*)value);
+            present[npresent++] = value;
+        }
+    }
+    lequal(npresent, (int)C_String_Table_size(t));
+
+    memset(&v, 0, sizeof(v));
+    v.sorted = true;
+    lequal(npresent, (int)C_String_Table_for_each(t, visit, &v));
+    lequal(npresent, v.count);
+    if (layout == C_STRING_TABLE_ORDERED) {
+        lok(v.sorted);
+    }
+
+    // Every prefix finds exactly the keys that start with it
+    qsort(present, npresent, sizeof(const char*), compare_keys);
+    for (int i = 0; i < npresent; i += 7) {
+        for (size_t plen = 0; plen <= strlen(present[i]); plen += 3) {
+            int expected = 0;
+
+            for (int j = 0; j < npresent; j++) {
+                if (strncmp(present[j], present[i], plen) == 0) expected++;
+            }
+            memcpy(prefix, present[i], plen);
+            prefix[plen] = '\0';
+            memset(&v, 0, sizeof(v));
+            v.sorted = true;
+            v.prefix = prefix;
+            lequal(expected, (int)C_String_Table_prefix_scan(t, plen, (const uint8_t*)prefix, visit, &v));
+            if (layout == C_STRING_TABLE_ORDERED) {
+                lok(v.sorted);
+            }
+        }
+    }
+
+    // Prefixes of nothing
+    lequal(0, (int)C_String_Table_prefix_scan(t, 3, (const uint8_t*)"zzz", visit, &v));
+    lequal(0, (int)C_String_Table_prefix_scan(t, 30, (const uint8_t*)"abcdefghijklmnopqrstuvwxyzzzzz", visit, &v));
+
+    // Stopping early
+    lequal(3, (int)C_String_Table_for_each(t, stop_at_three, &count));
+
+    teardown();
+}
+
+/*
+ * Key number `k` as one to three bytes of any value, so tree nodes see
+ * every byte and grow and shrink through every size.
+ */
+#define NRANDOM (256 + 65536 + 4096)
+
+static int random_key(uint8_t* buf, int k) {
+    if (k < 256) {
+        buf[0] = (uint8_t)k;
+        return 1;
+    }
+    k -= 256;
+    if (k < 65536) {
+        buf[0] = (uint8_t)(k >> 8);
+        buf[1] = (uint8_t)k;
+        return 2;
+    }
+    k -= 65536;
+    buf[0] = (uint8_t)(k >> 4);
+    buf[1] = (uint8_t)(k & 15);
+    buf[2] = (uint8_t)(k * 31);
+    return 3;
+}
+
+static bool count_sorted(size_t keylen, const uint8_t* key, const void* value, void* data) {
+    visited* v = (visited*)data;
+    size_t lastlen = strlen(v->last + 1);
+
+    // Keys here have no zero bytes after the first; compare as bytes
+    if (v->count > 0) {
+        int cmp = memcmp(v->last, key, (lastlen + 1 < keylen) ? lastlen + 1 : keylen);
+        if (cmp > 0 || (cmp == 0 && lastlen + 1 >= keylen)) {
+            v->sorted = false;
+        }
+    }
+    memset(v->last, 0, sizeof(v->last));
+    memcpy(v->last, key, keylen);
+    v->count++;
+    return true;
+}
+
+static void table_random() {
+    static bool present[NRANDOM];
+    uint32_t state = 12345;
+    uint8_t buf[4];
+    int npresent = 0;
+    visited v;
+
+    setup();
+    memset(present, 0, sizeof(present));
+
+    for (int op = 0; op < 200000; op++) {
+        int k, len;
+
+        state = state * 1103515245 + 12345;
+        k = (int)((state >> 8) % NRANDOM);
+        len = random_key(buf, k);
+
+        // Grow for a while, then mostly shrink
+        if ((op < 120000) ? (state & 3) != 0 : (state & 3) == 0) {
+            lequal(!present[k], C_String_Table_add(t, len, buf, t));
+            if (!present[k]) npresent++;
+            present[k] = true;
+        } else {
+            lequal(present[k], C_String_Table_remove(t, len, buf, NULL));
+            if (present[k]) npresent--;
+            present[k] = false;
+        }
+    }
+
+    lequal(npresent, (int)C_String_Table_size(t));
+    for (int k = 0; k < NRANDOM; k++) {
+        int len = random_key(buf, k);
+        if (C_String_Table_has(t, len, buf) != present[k]) {
+            lequal(present[k], C_String_Table_has(t, len, buf));
+        }
+    }
+
+    memset(&v, 0, sizeof(v));
+    v.sorted = true;
+    lequal(npresent, (int)C_String_Table_for_each(t, count_sorted, &v));
+    if (layout == C_STRING_TABLE_ORDERED) {
+        lok(v.sorted);
+    }
+
+    for (int k = 0; k < NRANDOM; k++) {
+        int len = random_key(buf, k);
+        lequal(present[k], C_String_Table_remove(t, len, buf, NULL));
+    }
+    lequal(0, (int)C_String_Table_size(t));
+
+    teardown();
+}
+
+static const void* encode_string(const void* value, size_t* lenp, void* data) {
+    (*(int*)data)++;
+    *lenp = strlen((const char*)value) + 1;
+    return value;
+}
+
+static bool value_matches_key(size_t keylen, const uint8_t* key, const void* value, void* data) {
+    // "keyN" maps to "valueN"
+    lok(strncmp((const char*)value + 5, (const char*)key + 3, keylen - 3) == 0);
+    return true;
+}
+
+static void table_save_map() {
+    char path[] = "/tmp/strtbl-test-XXXXXX";
+    static char values[100][16];
+    C_String_Table* m = NULL;
+    char key[32];
+    int encoded = 0;
+    int fd;
+    FILE* f;
+
+    fd = mkstemp(path);
+    lok(fd >= 0);
+    close(fd);
+
+    setup();
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        snprintf(values[i], sizeof(values[i]), "value%d", i);
+        lok(C_String_Table_add(t, strlen(key), (const uint8_t*)key, values[i]));
+    }
+    lok(C_String_Table_remove(t, 4, (const uint8_t*)"key7", NULL));
+
+    // Values as their own bits
+    lok(C_String_Table_save(t, path, NULL, NULL));
+    lok(!C_String_Table_is_frozen(t));
+    lok(C_String_Table_map(&m, path));
+    lok(m != NULL);
+    lok(C_String_Table_is_mapped(m));
+    lok(!C_String_Table_is_mapped(t));
+    lok(C_String_Table_is_frozen(m));
+    lequal(99, (int)C_String_Table_size(m));
+    for (int i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%d", i);
+        lok(C_String_Table_get(m, strlen(key), (const uint8_t*)key) == ((i == 7) ? NULL : values[i]));
+    }
+    lok(!C_String_Table_has(m, 6, (const uint8_t*)"key100"));
+    lok(!C_String_Table_add(m, 3, (const uint8_t*)"new", t));
+    lok(!C_String_Table_remove(m, 4, (const uint8_t*)"key1", NULL));
+    C_String_Table_free(&m);
+    lok(m == NULL);
+
+    // Values as encoded bytes
+    lok(C_String_Table_save(t, path, encode_string, &encoded));
+    lequal(99, encoded);
+    lok(C_String_Table_map(&m, path));
+    for (int i = 0; i < 100; i++) {
+        const char* value;
+
+        snprintf(key, sizeof(key), "key%d", i);
+        value = C_String_Table_get(m, strlen(key), (const uint8_t*)key);
+        if (i == 7) {
+            lok(value == NULL);
+        } else {
+            lok(value != values[i]);
+            lsequal(values[i], value);
+            lequal(0, (int)((uintptr_t)value % 8));
+        }
+    }
+    lequal(99, (int)C_String_Table_for_each(m, value_matches_key, NULL));
+    {
+        C_String_Table_Iterator i;
+        const uint8_t* kp;
+        size_t kl;
+        int count = 0;
+
+        C_String_Table_Iterator_init(m, &i);
+        while (C_String_Table_Iterator_has_next(&i)) {
+            C_String_Table_Iterator_next(&i);
+            kp = C_String_Table_Iterator_current_key(&i, &kl);
+            value_matches_key(kl, kp, C_String_Table_Iterator_current_value(&i), NULL);
+            count++;
+        }
+        lequal(99, count);
+    }
+
+    // A mapped table saves like any other
+    lok(C_String_Table_save(m, path, encode_string, &encoded));
+    C_String_Table_free(&m);
+    lok(C_String_Table_map(&m, path));
+    lsequal("value42", C_String_Table_get(m, 5, (const uint8_t*)"key42"));
+    C_String_Table_free(&m);
+
+    // Not a snapshot
+    f = fopen(path, "r+b");
+    lok(f != NULL);
+    fputc('X', f);
+    fclose(f);
+    lok(!C_String_Table_map(&m, path));
+    lok(m == NULL);
+    lok(!C_String_Table_map(&m, "/nonexistent/strtbl-test"));
+
+    // Empty tables too
+    teardown();
+    setup();
+    lok(C_String_Table_save(t, path, NULL, NULL));
+    lok(C_String_Table_map(&m, path));
+    lequal(0, (int)C_String_Table_size(m));
+    lok(!C_String_Table_has(m, 3, (const uint8_t*)"key"));
+    C_String_Table_free(&m);
+
+    remove(path);
+    teardown();
+}
+
+static void table_put() {
+    const void* old = NULL;
+
+    setup();
+
+    // Putting a new key adds it
+    lok(C_String_Table_put(t, 3, (const uint8_t*)"key", "one", &old));
+    lok(old == NULL);
+    lsequal("one", C_String_Table_get(t, 3, (const uint8_t*)"key"));
+    lequal(1, (int)C_String_Table_size(t));
+
+    // Putting it again replaces the value
+    lok(C_String_Table_put(t, 3, (const uint8_t*)"key", "two", &old));
+    lsequal("one", old);
+    lsequal("two", C_String_Table_get(t, 3, (const uint8_t*)"key"));
+    lequal(1, (int)C_String_Table_size(t));
+
+    // Putting NULL removes it
+    lok(C_String_Table_put(t, 3, (const uint8_t*)"key", NULL, &old));
+    lsequal("two", old);
+    lok(!C_String_Table_has(t, 3, (const uint8_t*)"key"));
+    lequal(0, (int)C_String_Table_size(t));
+    lok(C_String_Table_put(t, 3, (const uint8_t*)"key", NULL, &old));
+    lok(old == NULL);
+
+    lok(!C_String_Table_put(t, 3, NULL, "three", NULL));
+
+    // Nothing changes once frozen
+    lok(C_String_Table_put(t, 3, (const uint8_t*)"key", "three", NULL));
+    lok(C_String_Table_freeze(t));
+    lok(!C_String_Table_put(t, 3, (const uint8_t*)"key", "four", &old));
+    lok(old == NULL);
+    lsequal("three", C_String_Table_get(t, 3, (const uint8_t*)"key"));
+
+    teardown();
+}
+
+static void table_add_many() {
+    static char keys[1000][16];
+    const int nkeys = 1000;
+    size_t klen[1000 + 2];
+    const uint8_t* k[1000 + 2];
+    const void* v[1000 + 2];
+    C_Hash_Stats stats;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "key%d", i);
+        klen[i] = strlen(keys[i]);
+        k[i] = (const uint8_t*)keys[i];
+        v[i] = keys[nkeys - 1 - i];
+    }
+    // A null key and a repeated key fail alone
+    klen[nkeys] = 3;
+    k[nkeys] = NULL;
+    v[nkeys] = "null";
+    klen[nkeys + 1] = klen[0];
+    k[nkeys + 1] = k[0];
+    v[nkeys + 1] = "again";
+
+    lequal(nkeys, (int)C_String_Table_add_many(t, nkeys + 2, klen, k, v));
+    lequal(nkeys, (int)C_String_Table_size(t));
+    for (int i = 0; i < nkeys; i++) {
+        lok(C_String_Table_get(t, klen[i], k[i]) == keys[nkeys - 1 - i]);
+    }
+
+    // Only one resize for the lot
+    C_String_Table_stats(t, &stats);
+    if (layout == C_STRING_TABLE_HASHED) {
+        lequal(1, (int)stats.resizes);
+    }
+
+    // Adding the same keys again adds nothing
+    lequal(0, (int)C_String_Table_add_many(t, nkeys, klen, k, v));
+    lequal(nkeys, (int)C_String_Table_size(t));
+
+    // Room reserved is room used without resizing
+    teardown();
+    setup();
+    lok(C_String_Table_reserve(t, nkeys));
+    C_String_Table_stats(t, &stats);
+    for (int i = 0; i < nkeys; i++) {
+        lok(C_String_Table_add(t, klen[i], k[i], v[i]));
+    }
+    {
+        size_t resizes = stats.resizes;
+
+        C_String_Table_stats(t, &stats);
+        lequal((int)resizes, (int)stats.resizes);
+    }
+
+    lok(C_String_Table_freeze(t));
+    lok(!C_String_Table_reserve(t, 2 * nkeys));
+    lequal(0, (int)C_String_Table_add_many(t, nkeys, klen, k, v));
+
+    teardown();
+}
+
+static void table_iterator() {
+    static bool seen[NRANDOM];
+    C_String_Table_Iterator i;
+    C_String_Table_Iterator* ip = NULL;
+    const uint8_t* key;
+    uint8_t buf[4];
+    uint8_t last[4];
+    size_t lastlen = 0;
+    size_t kl;
+    int count = 0;
+
+    setup();
+
+    // Nothing to see in an empty table
+    C_String_Table_Iterator_init(t, &i);
+    lequal(false, C_String_Table_Iterator_has_next(&i));
+    lok(C_String_Table_Iterator_current_key(&i, &kl) == NULL);
+    lequal(0, (int)kl);
+
+    // Keys of every byte value and several lengths
+    memset(seen, 0, sizeof(seen));
+    for (int k = 0; k < NRANDOM; k += 3) {
+        int len = random_key(buf, k);
+        lok(C_String_Table_add(t, len, buf, seen + k));
+    }
+
+    C_String_Table_Iterator_init(t, &i);
+    while (C_String_Table_Iterator_has_next(&i)) {
+        const bool* value;
+
+        C_String_Table_Iterator_next(&i);
+        key = C_String_Table_Iterator_current_key(&i, &kl);
+        value = C_String_Table_Iterator_current_value(&i);
+        lok(key != NULL);
+        lok(C_String_Table_get(t, kl, key) == value);
+        if (layout == C_STRING_TABLE_ORDERED && count > 0) {
+            size_t n = (kl < lastlen) ? kl : lastlen;
+            int cmp = memcmp(last, key, n);
+
+            if (!(cmp < 0 || (cmp == 0 && lastlen < kl))) {
+                lok(false);
+            }
+        }
+        memcpy(last, key, kl);
+        lastlen = kl;
+        seen[value - seen] = true;
+        count++;
+    }
+    lequal(false, C_String_Table_Iterator_has_failed(&i));
+    lequal((int)C_String_Table_size(t), count);
+    for (int k = 0; k < NRANDOM; k++) {
+        if (seen[k] != (k % 3 == 0)) {
+            lequal(k % 3 == 0, seen[k]);
+        }
+    }
+
+    // Past the end there's nothing
+    C_String_Table_Iterator_next(&i);
+    lok(C_String_Table_Iterator_current_key(&i, NULL) == NULL);
+    lok(C_String_Table_Iterator_current_value(&i) == NULL);
+
+    // Replacing a value doesn't disturb the walk
+    C_String_Table_new_iterator(t, &ip);
+    lok(ip != NULL);
+    C_String_Table_Iterator_next(ip);
+    key = C_String_Table_Iterator_current_key(ip, &kl);
+    lok(C_String_Table_put(t, kl, key, "new", NULL));
+    lequal(false, C_String_Table_Iterator_has_failed(ip));
+    lsequal("new", (const char*)C_String_Table_Iterator_current_value(ip));
+
+    // Removing a key does
+    memcpy(buf, key, kl);
+    lok(C_String_Table_remove(t, kl, buf, NULL));
+    lequal(true, C_String_Table_Iterator_has_failed(ip));
+    lequal(false, C_String_Table_Iterator_has_next(ip));
+    lok(C_String_Table_Iterator_current_value(ip) == NULL);
+
+    lok(C_String_Table_Iterator_free(&ip));
+    lok(ip == NULL);
+
+    // A frozen table walks the same entries
+    lok(C_String_Table_freeze(t));
+    count = 0;
+    C_String_Table_Iterator_init(t, &i);
+    while (C_String_Table_Iterator_has_next(&i)) {
+        C_String_Table_Iterator_next(&i);
+        count++;
+    }
+    lequal((int)C_String_Table_size(t), count);
+
+    teardown();
+}
+
 int main (int argc, char* argv[]) {
+    layout = C_STRING_TABLE_HASHED;
     lrun("table_smoke", table_smoke);
     lrun("table_add", table_add);
     lrun("table_add_multiple", table_add_multiple);
     lrun("table_remove", table_remove);
+    lrun("table_binary_keys", table_binary_keys);
+    lrun("table_churn", table_churn);
+    lrun("table_freeze", table_freeze);
+    lrun("table_freeze_large", table_freeze_large);
+    lrun("table_for_each", table_for_each);
+    lrun("table_random", table_random);
+    lrun("table_save_map", table_save_map);
+    lrun("table_save_large", table_save_large);
+    lrun("table_put", table_put);
+    lrun("table_add_many", table_add_many);
+    lrun("table_iterator", table_iterator);
+    lrun("table_stats", table_stats);
+
+    layout = C_STRING_TABLE_ORDERED;
+    lrun("table_smoke (ordered)", table_smoke);
+    lrun("table_add (ordered)", table_add);
+    lrun("table_add_multiple (ordered)", table_add_multiple);
+    lrun("table_remove (ordered)", table_remove);
+    lrun("table_binary_keys (ordered)", table_binary_keys);
+    lrun("table_churn (ordered)", table_churn);
+    lrun("table_freeze (ordered)", table_freeze);
+    lrun("table_freeze_large (ordered)", table_freeze_large);
+    lrun("table_for_each (ordered)", table_for_each);
+    lrun("table_random (ordered)", table_random);
+    lrun("table_save_map (ordered)", table_save_map);
+    lrun("table_save_large (ordered)", table_save_large);
+    lrun("table_put (ordered)", table_put);
+    lrun("table_add_many (ordered)", table_add_many);
+    lrun("table_iterator (ordered)", table_iterator);
+    lrun("table_stats (ordered)", table_stats);
     lresults();
     return lfails != 0;
 }
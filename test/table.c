@@ -31,6 +31,8 @@
 
 static C_Table* t = NULL;
 
+static C_Table_Layout layout = C_TABLE_CHAINED;
+
 typedef struct _kvpair {
     const char* key; 
     const char* value;
@@ -108,8 +110,9 @@ static const char* tostr(C_Userdata ud) {
 
 static void setup() {
     t = NULL;
-    C_Table_new(&t, 3);
+    C_Table_new_with_layout(&t, 3, layout);
     lok(t != NULL);
+    lequal(layout, C_Table_layout(t));
 }
 
 static void teardown() {
@@ -410,8 +413,679 @@ static void table_iterator() {
     teardown();
 }
 
+static void table_many() {
+    const int nkeys = 10000;
+    char buf[STRBUFSIZ];
+    C_Userdata key, value, actual;
+
+    setup();
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Table_add(t, &key, &value));
+    }
+    lequal(nkeys, (int)C_Table_size(t));
+
+    // Remove the odd keys
+    for (int i = 1; i < nkeys; i += 2) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        lok(C_Table_remove(t, &key));
+    }
+    lequal(nkeys / 2, (int)C_Table_size(t));
+
+    // Even keys still there, odd keys gone
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_clear(&actual, false);
+        if (i % 2 == 0) {
+            lok(C_Table_get(t, &key, &actual));
+            lok(actual.ptr == (void*)(intptr_t)i);
+        } else {
+            lequal(false, C_Table_get(t, &key, &actual));
+        }
+    }
+
+    // Put the odd keys back
+    for (int i = 1; i < nkeys; i += 2) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Table_put(t, &key, &value));
+    }
+    lequal(nkeys, (int)C_Table_size(t));
+
+    teardown();
+}
+
+static int hash_calls = 0;
+
+static uint64_t counting_hash(const void* ptr, size_t len) {
+    const uint8_t* bytes = (const uint8_t*)ptr;
+    uint64_t result = 5381;
+
+    hash_calls++;
+    for (size_t i = 0; i < len; i++) {
+        result = result * 33 + bytes[i];
+    }
+    return result;
+}
+
+static void table_hash_cached() {
+    const int nkeys = 1000;
+    char buf[STRBUFSIZ];
+    C_Userdata key, value, actual;
+
+    setup();
+
+    for (int i = 0; i < nkeys / 2; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Table_add(t, &key, &value));
+    }
+
+    // Switching hash functions must rehash each existing key exactly once
+    hash_calls = 0;
+    C_Table_define_hash_function(t, counting_hash);
+    lequal(nkeys / 2, hash_calls);
+
+    // ... and growing the table must not rehash any of them
+    hash_calls = 0;
+    for (int i = nkeys / 2; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Table_add(t, &key, &value));
+    }
+    lequal(nkeys / 2, hash_calls);
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_clear(&actual, false);
+        lok(C_Table_get(t, &key, &actual));
+        lok(actual.ptr == (void*)(intptr_t)i);
+    }
+
+    teardown();
+}
+
+static void table_incremental_resize() {
+    const int nkeys = 5000;
+    char buf[STRBUFSIZ];
+    C_Userdata key, value, actual;
+    bool resized = false;
+
+    setup();
+
+    C_Table_set_resize_step(t, 2);
+    lequal(2, (int)C_Table_resize_step(t));
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Table_add(t, &key, &value));
+
+        if (C_Table_is_resizing(t)) {
+            resized = true;
+
+            // Every key so far must be visible mid-resize
+            for (int j = 0; j <= i; j += 97) {
+                sprintf(buf, "key #%d", j);
+                C_Userdata_set_string(&key, buf);
+                lok(C_Table_has(t, &key));
+            }
+        }
+    }
+    lok(resized);
+    lequal(nkeys, (int)C_Table_size(t));
+
+    // Remove some entries, which may still be in the old index
+    for (int i = 0; i < nkeys; i += 3) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        lok(C_Table_remove(t, &key));
+    }
+
+    C_Table_finish_resize(t);
+    lequal(false, C_Table_is_resizing(t));
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_clear(&actual, false);
+        if (i % 3 == 0) {
+            lequal(false, C_Table_get(t, &key, &actual));
+        } else {
+            lok(C_Table_get(t, &key, &actual));
+            lok(actual.ptr == (void*)(intptr_t)i);
+        }
+    }
+
+    teardown();
+}
+
+static int copies = 0;
+static int frees  = 0;
+
+static bool counting_copy(C_Userdata* to, const C_Userdata* from) {
+    void* ptr = malloc(from->len + 1);
+
+    if (!ptr) return false;
+    memcpy(ptr, from->ptr, from->len);
+    ((char*)ptr)[from->len] = '\0';
+    C_Userdata_set(to, from->tag, from->len, ptr);
+    copies++;
+    return true;
+}
+
+static void counting_free(C_Userdata* ud) {
+    free(ud->ptr);
+    frees++;
+}
+
+static void table_custom_copy() {
+    const int nkeys = 100;
+    char buf[STRBUFSIZ];
+    C_Userdata key, value, actual;
+
+    setup();
+
+    C_Table_define_data_copy(t, counting_copy);
+    C_Table_define_data_free(t, counting_free);
+    copies = 0;
+    frees = 0;
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_string(&value, buf);
+        lok(C_Table_add(t, &key, &value));
+    }
+    lequal(2 * nkeys, copies);
+    lequal(0, frees);
+
+    C_Userdata_set_string(&key, "key #0");
+    C_Userdata_clear(&actual, false);
+    lok(C_Table_get(t, &key, &actual));
+    lsequal("key #0", (char*)actual.ptr);
+
+    lok(C_Table_remove(t, &key));
+    lequal(2, frees);
+
+    // Freeing the table frees every remaining copy
+    C_Table_free(&t);
+    lequal(2 * nkeys, frees);
+    lok(t == NULL);
+
+    teardown();
+}
+
+static void table_data_sizes() {
+    // Lengths either side of each storage class: inline, pooled, copied
+    const int lens[] = { 1, 7, 23, 31, 32, 33, 95, 127, 128, 129, 300 };
+    const int nlens = sizeof(lens) / sizeof(lens[0]);
+    char kbuf[STRBUFSIZ];
+    char vbuf[STRBUFSIZ];
+    C_Userdata key, value, actual;
+
+    setup();
+
+    for (int i = 0; i < nlens; i++) {
+        memset(kbuf, 'k', lens[i]);
+        kbuf[lens[i]] = '\0';
+        memset(vbuf, 'v', lens[i]);
+        vbuf[lens[i]] = '\0';
+
+        C_Userdata_set_string(&key, kbuf);
+        C_Userdata_set_string(&value, vbuf);
+        lok(C_Table_add(t, &key, &value));
+    }
+
+    for (int i = 0; i < nlens; i++) {
+        memset(kbuf, 'k', lens[i]);
+        kbuf[lens[i]] = '\0';
+        memset(vbuf, 'v', lens[i]);
+        vbuf[lens[i]] = '\0';
+
+        C_Userdata_set_string(&key, kbuf);
+        C_Userdata_clear(&actual, false);
+        lok(C_Table_get(t, &key, &actual));
+        lequal(lens[i], (int)actual.len);
+        lsequal(vbuf, (char*)actual.ptr);
+
+        // Grow and shrink each value through every storage class
+        for (int j = nlens - 1; j >= 0; j--) {
+            memset(vbuf, 'a' + j, lens[j]);
+            vbuf[lens[j]] = '\0';
+            C_Userdata_set_string(&value, vbuf);
+            lok(C_Table_put(t, &key, &value));
+
+            C_Userdata_clear(&actual, false);
+            lok(C_Table_get(t, &key, &actual));
+            lequal(lens[j], (int)actual.len);
+            lsequal(vbuf, (char*)actual.ptr);
+
+            // Putting back the stored value itself changes nothing
+            lok(C_Table_put(t, &key, &actual));
+            C_Userdata_clear(&actual, false);
+            lok(C_Table_get(t, &key, &actual));
+            lsequal(vbuf, (char*)actual.ptr);
+        }
+    }
+
+    for (int i = 0; i < nlens; i++) {
+        memset(kbuf, 'k', lens[i]);
+        kbuf[lens[i]] = '\0';
+        C_Userdata_set_string(&key, kbuf);
+        lok(C_Table_remove(t, &key));
+        lok(!C_Table_has(t, &key));
+    }
+    lequal(0, (int)C_Table_size(t));
+
+    teardown();
+}
+
+static void table_iterator_in_place() {
+    const int nkeys = 3000;
+    char buf[STRBUFSIZ];
+    char* seen = calloc(nkeys, 1);
+    C_Userdata key, value;
+    C_Table_Iterator i;
+    int count = 0;
+
+    setup();
+
+    // Leave a resize in progress for the iterator to finish
+    C_Table_set_resize_step(t, 1);
+    for (int k = 0; k < nkeys; k++) {
+        sprintf(buf, "key #%d", k);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)k);
+        lok(C_Table_add(t, &key, &value));
+    }
+
+    C_Table_Iterator_init(t, &i);
+    lok(!C_Table_is_resizing(t));
+    lok(!C_Table_Iterator_current_key(&i, &key));
+
+    while (C_Table_Iterator_has_next(&i)) {
+        int k;
+
+        C_Table_Iterator_next(&i);
+        lok(C_Table_Iterator_current_pair(&i, &key, &value));
+        k = (int)(intptr_t)value.ptr;
+        lok(k >= 0 && k < nkeys);
+        if (k < 0 || k >= nkeys) break;
+
+        sprintf(buf, "key #%d", k);
+        lsequal(buf, (char*)key.ptr);
+        lequal(0, (int)seen[k]);
+        seen[k] = 1;
+        count++;
+
+        // Replacing a value doesn't disturb the iterator
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)k);
+        lok(C_Table_put(t, &key, &value));
+    }
+    lequal(nkeys, count);
+    lok(!C_Table_Iterator_has_failed(&i));
+
+    C_Table_Iterator_next(&i);
+    lok(!C_Table_Iterator_current_key(&i, &key));
+
+    free(seen);
+    teardown();
+}
+
+static void table_iterator_fail_fast() {
+    C_Userdata key, value;
+    C_Table_Iterator i;
+
+    setup();
+
+    C_Userdata_set_string(&key, "one");
+    C_Userdata_set_string(&value, "1");
+    lok(C_Table_add(t, &key, &value));
+    C_Userdata_set_string(&key, "two");
+    C_Userdata_set_string(&value, "2");
+    lok(C_Table_add(t, &key, &value));
+
+    C_Table_Iterator_init(t, &i);
+    lok(C_Table_Iterator_has_next(&i));
+    C_Table_Iterator_next(&i);
+    lok(C_Table_Iterator_current_key(&i, &key));
+
+    // A new entry fails the iterator
+    C_Userdata_set_string(&key, "three");
+    C_Userdata_set_string(&value, "3");
+    lok(C_Table_add(t, &key, &value));
+
+    lok(C_Table_Iterator_has_failed(&i));
+    lok(!C_Table_Iterator_has_next(&i));
+    lok(!C_Table_Iterator_current_pair(&i, &key, &value));
+
+    // So does removing one
+    C_Table_Iterator_init(t, &i);
+    lok(C_Table_Iterator_has_next(&i));
+    C_Table_Iterator_next(&i);
+    lok(C_Table_Iterator_current_key(&i, &key));
+    lok(C_Table_remove(t, &key));
+    lok(C_Table_Iterator_has_failed(&i));
+    lok(!C_Table_Iterator_current_key(&i, &key));
+
+    teardown();
+}
+
+static bool count_visitor(const C_Userdata* key, const C_Userdata* value, void* data) {
+    int* count = (int*)data;
+
+    (*count)++;
+    return strcmp((const char*)key->ptr, (const char*)value->ptr) == 0;
+}
+
+static void table_for_each() {
+    char buf[STRBUFSIZ];
+    C_Userdata key, value;
+    int count = 0;
+
+    setup();
+
+    lequal(0, (int)C_Table_for_each(t, count_visitor, &count));
+    lequal(0, count);
+
+    for (int k = 0; k < 100; k++) {
+        sprintf(buf, "%d", k);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_string(&value, buf);
+        lok(C_Table_add(t, &key, &value));
+    }
+    lequal(100, (int)C_Table_for_each(t, count_visitor, &count));
+    lequal(100, count);
+
+    // The visitor stops at the first mismatch, so never reaches both
+    C_Userdata_set_string(&key, "50");
+    C_Userdata_set_string(&value, "fifty");
+    lok(C_Table_put(t, &key, &value));
+    C_Userdata_set_string(&key, "51");
+    C_Userdata_set_string(&value, "fifty-one");
+    lok(C_Table_put(t, &key, &value));
+    count = 0;
+    lok(C_Table_for_each(t, count_visitor, &count) < 100);
+    lequal(100, (int)C_Table_size(t));
+
+    teardown();
+}
+
+static void table_batches() {
+    const int nkeys = 1000;
+    char (*bufs)[16] = calloc(2 * nkeys, 16);
+    C_Userdata* keys = calloc(2 * nkeys, sizeof(C_Userdata));
+    C_Userdata* values = calloc(2 * nkeys, sizeof(C_Userdata));
+    bool* found = calloc(2 * nkeys, sizeof(bool));
+
+    setup();
+
+    for (int k = 0; k < 2 * nkeys; k++) {
+        sprintf(bufs[k], "key #%d", k);
+        C_Userdata_set_string(&(keys[k]), bufs[k]);
+        C_Userdata_set_pointer(&(values[k]), (void*)(intptr_t)k);
+    }
+
+    // Put the first half, twice over to cover updates
+    lequal(nkeys, (int)C_Table_put_many(t, nkeys, keys, values));
+    lequal(nkeys, (int)C_Table_put_many(t, nkeys, keys, values));
+    lequal(nkeys, (int)C_Table_size(t));
+
+    // Get both halves; only the first is there
+    memset(values, 0xFF, 2 * nkeys * sizeof(C_Userdata));
+    lequal(nkeys, (int)C_Table_get_many(t, 2 * nkeys, keys, values, found));
+    for (int k = 0; k < 2 * nkeys; k++) {
+        if (k < nkeys) {
+            lok(found[k]);
+            lequal(k, (int)(intptr_t)values[k].ptr);
+        } else {
+            lok(!found[k]);
+            lok(values[k].ptr == NULL);
+        }
+    }
+
+    // Batches of odd sizes, and no `found`
+    lequal(7, (int)C_Table_get_many(t, 7, keys + 3, values, NULL));
+    lequal(0, (int)C_Table_get_many(t, 0, keys, values, NULL));
+
+    free(found);
+    free(values);
+    free(keys);
+    free(bufs);
+    teardown();
+}
+
+static void table_slots() {
+    const char* words[] = { "the", "cat", "the", "hat", "the", "end", "cat", NULL };
+    C_Table_Slot slot;
+    C_Userdata key, value, actual;
+
+    setup();
+
+    // Count words with one lookup each
+    for (int i = 0; words[i] != NULL; i++) {
+        C_Userdata_set_string(&key, words[i]);
+        if (C_Table_find_slot(t, &key, &slot)) {
+            lok(C_Table_Slot_get(&slot, &actual));
+            C_Userdata_set_pointer(&value, (void*)((intptr_t)actual.ptr + 1));
+        } else {
+            lok(!C_Table_Slot_get(&slot, &actual));
+            C_Userdata_set_pointer(&value, (void*)(intptr_t)1);
+        }
+        lok(C_Table_Slot_set(&slot, &value));
+    }
+    lequal(4, (int)C_Table_size(t));
+
+    C_Userdata_set_string(&key, "the");
+    lok(C_Table_get(t, &key, &actual));
+    lequal(3, (int)(intptr_t)actual.ptr);
+
+    // A slot survives other changes to the table
+    lok(C_Table_find_slot(t, &key, &slot));
+    C_Userdata_set_string(&key, "dog");
+    C_Userdata_set_pointer(&value, NULL);
+    lok(C_Table_add(t, &key, &value));
+    lok(C_Table_Slot_get(&slot, &actual));
+    lequal(3, (int)(intptr_t)actual.ptr);
+
+    lok(C_Table_Slot_remove(&slot, &actual));
+    lequal(3, (int)(intptr_t)actual.ptr);
+    lok(!C_Table_Slot_remove(&slot, &actual));
+    lok(!C_Table_Slot_get(&slot, &actual));
+    C_Userdata_set_string(&key, "the");
+    lok(!C_Table_has(t, &key));
+
+    // ... and can fill in the entry it just removed
+    C_Userdata_set_string(&value, "again");
+    lok(C_Table_Slot_set(&slot, &value));
+    lok(C_Table_get(t, &key, &actual));
+    lsequal("again", (char*)actual.ptr);
+
+    teardown();
+}
+
+static void table_remove_value() {
+    C_Userdata key, value, actual;
+
+    setup();
+
+    C_Userdata_set_string(&key, "key");
+    C_Userdata_set_string(&value, "value");
+    lok(C_Table_add(t, &key, &value));
+
+    C_Userdata_clear(&actual, false);
+    lok(C_Table_remove_value(t, &key, &actual));
+    lsequal("value", (char*)actual.ptr);
+    lok(actual.ptr != value.ptr);
+    C_Userdata_clear(&actual, true);
+
+    lok(!C_Table_remove_value(t, &key, &actual));
+    lequal(0, (int)C_Table_size(t));
+
+    C_Userdata_set_pointer(&value, &key);
+    lok(C_Table_add(t, &key, &value));
+    lok(C_Table_remove_value(t, &key, &actual));
+    lok(actual.ptr == &key);
+    lequal(0, (int)actual.len);
+
+    teardown();
+}
+
+static C_Userdata owned_string(const char* cstr) {
+    C_Userdata ud;
+    C_Userdata_set(&ud, DEFAULT_TAG, strlen(cstr), strdup(cstr));
+    return ud;
+}
+
+static void table_owned() {
+    C_Userdata key, value, newkey, newvalue, actual, oldkey, oldvalue;
+    char buf[STRBUFSIZ];
+
+    setup();
+
+    // The table keeps the very buffers it was given
+    key = owned_string("key");
+    value = owned_string("value");
+    lok(C_Table_add_owned(t, &key, &value));
+    lequal(1, (int)C_Table_size(t));
+    lok(C_Table_get(t, &key, &actual));
+    lok(actual.ptr == value.ptr);
+
+    // Adding again fails, and the caller still owns the new buffers
+    newkey = owned_string("key");
+    newvalue = owned_string("other");
+    lequal(false, C_Table_add_owned(t, &newkey, &newvalue));
+
+    // Putting keeps the entry's key, frees the new one, and adopts the value
+    lok(C_Table_put_owned(t, &newkey, &newvalue));
+    lequal(1, (int)C_Table_size(t));
+    lok(C_Table_get(t, &key, &actual));
+    lok(actual.ptr == newvalue.ptr);
+
+    // Taking hands back the buffers without copying them
+    lok(C_Table_take(t, &key, &oldkey, &oldvalue));
+    lequal(0, (int)C_Table_size(t));
+    lok(oldkey.ptr == key.ptr);
+    lok(oldvalue.ptr == newvalue.ptr);
+    lequal(false, C_Table_take(t, &key, &oldkey, &oldvalue));
+    C_Userdata_clear(&oldkey, true);
+    C_Userdata_clear(&oldvalue, true);
+
+    // Data the table stored itself comes back as a fresh copy
+    C_Userdata_set_string(&key, "short");
+    C_Userdata_set_string(&value, "tiny");
+    lok(C_Table_put(t, &key, &value));
+    lok(C_Table_take(t, &key, &oldkey, &oldvalue));
+    lsequal("short", (const char*)oldkey.ptr);
+    lsequal("tiny", (const char*)oldvalue.ptr);
+    lok(oldkey.ptr != key.ptr);
+    C_Userdata_clear(&oldkey, true);
+    C_Userdata_clear(&oldvalue, true);
+
+    // References pass through untouched
+    C_Userdata_set_pointer(&value, buf);
+    key = owned_string("ref");
+    lok(C_Table_put_owned(t, &key, &value));
+    lok(C_Table_take(t, &key, &oldkey, &oldvalue));
+    lok(oldvalue.ptr == buf);
+    lequal(0, (int)oldvalue.len);
+    C_Userdata_clear(&oldkey, true);
+
+    // Whatever is left goes with the table
+    key = owned_string("left");
+    value = owned_string("behind");
+    lok(C_Table_put_owned(t, &key, &value));
+
+    teardown();
+}
+
+static uint64_t constant_hash(const void* ptr, size_t len) {
+    return 42;
+}
+
+static size_t histogram_total(const C_Hash_Stats* stats) {
+    size_t total = 0;
+    for (int i = 0; i < C_HASH_STATS_BINS; i++) {
+        total += stats->histogram[i];
+    }
+    return total;
+}
+
+static void table_stats() {
+    const int nkeys = 1000;
+    char buf[STRBUFSIZ];
+    C_Userdata key, value;
+    C_Hash_Stats stats;
+
+    setup();
+
+    C_Table_stats(t, &stats);
+    lequal(0, (int)stats.entries);
+    lequal(0, (int)stats.occupied);
+    lequal(0, (int)stats.resizes);
+    lok(stats.buckets > 0);
+    lok(stats.bytes >= sizeof(void*) * stats.buckets);
+
+    for (int i = 0; i < nkeys; i++) {
+        sprintf(buf, "key #%d", i);
+        C_Userdata_set_string(&key, buf);
+        C_Userdata_set_pointer(&value, (void*)(intptr_t)i);
+        lok(C_Table_add(t, &key, &value));
+    }
+
+    C_Table_stats(t, &stats);
+    lequal(nkeys, (int)stats.entries);
+    lequal(nkeys, (int)histogram_total(&stats));
+    lok(stats.occupied <= stats.buckets);
+    lok(stats.occupied <= stats.entries);
+    lok(stats.resizes > 0);
+    lok(stats.max_probe < C_HASH_STATS_BINS);
+    // A good hash keeps the mean probe short
+    lok(stats.total_probe < 2 * stats.entries);
+
+    // Growing doubles an open index, so it stays over 7/16 full
+    if (layout == C_TABLE_OPEN) {
+        C_Table* u = NULL;
+        C_Hash_Stats ustats;
+
+        lok(stats.entries * 16 >= stats.buckets * 7);
+
+        // Exactly the room asked for, if that's a full power of two
+        C_Table_new_with_layout(&u, 14, layout);
+        C_Table_stats(u, &ustats);
+        lequal(16, (int)ustats.buckets);
+        C_Table_free(&u);
+    }
+
+    // A degenerate hash piles every key into one place
+    C_Table_define_hash_function(t, constant_hash);
+    C_Table_stats(t, &stats);
+    lequal(nkeys, (int)stats.entries);
+    if (layout == C_TABLE_OPEN) {
+        lok(stats.occupied <= stats.buckets);
+        lok(stats.max_probe >= nkeys / 16 / 2);
+    } else {
+        lequal(1, (int)stats.occupied);
+        lequal(nkeys - 1, (int)stats.max_probe);
+        lequal(nkeys - C_HASH_STATS_BINS + 1, (int)stats.histogram[C_HASH_STATS_BINS - 1]);
+    }
+
+    teardown();
+}
 
 int main (int argc, char* argv[]) {
+    layout = C_TABLE_CHAINED;
     lrun("table_smoke", table_smoke);
     lrun("table_get", table_get);
     lrun("table_has", table_has);
@@ -422,6 +1096,44 @@ int main (int argc, char* argv[]) {
     lrun("table_with_pointer_key", table_with_pointer_key);
     lrun("table_with_pointer_value", table_with_pointer_value);
     lrun("table_iterator", table_iterator);
+    lrun("table_iterator_in_place", table_iterator_in_place);
+    lrun("table_iterator_fail_fast", table_iterator_fail_fast);
+    lrun("table_for_each", table_for_each);
+    lrun("table_batches", table_batches);
+    lrun("table_slots", table_slots);
+    lrun("table_remove_value", table_remove_value);
+    lrun("table_owned", table_owned);
+    lrun("table_many", table_many);
+    lrun("table_hash_cached", table_hash_cached);
+    lrun("table_incremental_resize", table_incremental_resize);
+    lrun("table_custom_copy", table_custom_copy);
+    lrun("table_data_sizes", table_data_sizes);
+    lrun("table_stats", table_stats);
+
+    layout = C_TABLE_OPEN;
+    lrun("table_smoke (open)", table_smoke);
+    lrun("table_get (open)", table_get);
+    lrun("table_has (open)", table_has);
+    lrun("table_add (open)", table_add);
+    lrun("table_add_multiple (open)", table_add_multiple);
+    lrun("table_put (open)", table_put);
+    lrun("table_remove (open)", table_remove);
+    lrun("table_with_pointer_key (open)", table_with_pointer_key);
+    lrun("table_with_pointer_value (open)", table_with_pointer_value);
+    lrun("table_iterator (open)", table_iterator);
+    lrun("table_iterator_in_place (open)", table_iterator_in_place);
+    lrun("table_iterator_fail_fast (open)", table_iterator_fail_fast);
+    lrun("table_for_each (open)", table_for_each);
+    lrun("table_batches (open)", table_batches);
+    lrun("table_slots (open)", table_slots);
+    lrun("table_remove_value (open)", table_remove_value);
+    lrun("table_owned (open)", table_owned);
+    lrun("table_many (open)", table_many);
+    lrun("table_hash_cached (open)", table_hash_cached);
+    lrun("table_incremental_resize (open)", table_incremental_resize);
+    lrun("table_custom_copy (open)", table_custom_copy);
+    lrun("table_data_sizes (open)", table_data_sizes);
+    lrun("table_stats (open)", table_stats);
     lresults();
     return lfails != 0;
 }
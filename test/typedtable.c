@@ -0,0 +1,186 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "minctest.h"
+#include "typedtable.h"
+
+typedef struct _point {
+    int x;
+    int y;
+} point;
+
+#define point_hash(p)       C_Hash_u64(((uint64_t)(uint32_t)(p).x << 32) | (uint32_t)(p).y)
+#define point_equals(a, b)  ((a).x == (b).x && (a).y == (b).y)
+
+C_TABLE_DEFINE(U64_Table, uint64_t, const void*, C_Hash_u64, C_TABLE_EQ_SCALAR)
+
+C_TABLE_DEFINE(Point_Table, point, double, point_hash, point_equals)
+
+static U64_Table* t = NULL;
+
+static void setup() {
+    t = NULL;
+    U64_Table_new(&t, 3);
+    lok(t != NULL);
+}
+
+static void teardown() {
+    U64_Table_free(&t);
+    lok(t == NULL);
+}
+
+static void typed_smoke() {
+    setup();
+
+    lequal(0, (int)U64_Table_size(t));
+
+    teardown();
+}
+
+static void typed_add_get() {
+    const void* value = NULL;
+
+    setup();
+
+    lequal(false, U64_Table_has(t, 1));
+    lequal(false, U64_Table_get(t, 1, &value));
+
+    lok(U64_Table_add(t, 1, "one"));
+    lok(U64_Table_has(t, 1));
+    lok(U64_Table_get(t, 1, &value));
+    lsequal("one", (const char*)value);
+
+    // No second entry for the same key
+    lequal(false, U64_Table_add(t, 1, "uno"));
+    lok(U64_Table_get(t, 1, &value));
+    lsequal("one", (const char*)value);
+    lequal(1, (int)U64_Table_size(t));
+
+    teardown();
+}
+
+static void typed_put_remove() {
+    const void* value = NULL;
+
+    setup();
+
+    lok(U64_Table_put(t, 7, "seven"));
+    lok(U64_Table_put(t, 7, "sept"));
+    lequal(1, (int)U64_Table_size(t));
+    lok(U64_Table_get(t, 7, &value));
+    lsequal("sept", (const char*)value);
+
+    lok(U64_Table_remove_value(t, 7, &value));
+    lsequal("sept", (const char*)value);
+    lequal(0, (int)U64_Table_size(t));
+    lequal(false, U64_Table_has(t, 7));
+    lequal(false, U64_Table_remove(t, 7));
+
+    teardown();
+}
+
+static void typed_many() {
+    const int nkeys = 10000;
+    const void* value = NULL;
+
+    setup();
+
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < nkeys; i++) {
+            lok(U64_Table_add(t, (uint64_t)i, (const void*)(intptr_t)(i + 1)));
+        }
+        lequal(nkeys, (int)U64_Table_size(t));
+
+        // Leave a trail of DELETED slots for lookups to pass through
+        for (int i = 1; i < nkeys; i += 2) {
+            lok(U64_Table_remove(t, (uint64_t)i));
+        }
+        lequal(nkeys / 2, (int)U64_Table_size(t));
+
+        for (int i = 0; i < nkeys; i++) {
+            if (i % 2 == 0) {
+                lok(U64_Table_get(t, (uint64_t)i, &value));
+                lok(value == (const void*)(intptr_t)(i + 1));
+            } else {
+                lequal(false, U64_Table_has(t, (uint64_t)i));
+            }
+        }
+
+        for (int i = 0; i < nkeys; i += 2) {
+            lok(U64_Table_remove(t, (uint64_t)i));
+        }
+        lequal(0, (int)U64_Table_size(t));
+    }
+
+    teardown();
+}
+
+static bool sum_visitor(point key, double* value, void* data) {
+    double* sum = (double*)data;
+
+    (*sum) += *value;
+    (*value) = 0;
+    return true;
+}
+
+static void typed_struct_keys() {
+    Point_Table* pt = NULL;
+    double value = 0;
+    double sum = 0;
+
+    Point_Table_new(&pt, 0);
+    lok(pt != NULL);
+
+    for (int x = 0; x < 10; x++) {
+        for (int y = 0; y < 10; y++) {
+            point p = { x, y };
+            lok(Point_Table_add(pt, p, x + y / 10.0));
+        }
+    }
+    lequal(100, (int)Point_Table_size(pt));
+
+    lok(Point_Table_get(pt, ((point){ 3, 4 }), &value));
+    lok(value == 3.4);
+    lequal(false, Point_Table_has(pt, ((point){ 4, 10 })));
+
+    // The visitor may change values in place
+    lequal(100, (int)Point_Table_for_each(pt, sum_visitor, &sum));
+    lok(sum > 0);
+    lok(Point_Table_get(pt, ((point){ 3, 4 }), &value));
+    lok(value == 0);
+
+    Point_Table_free(&pt);
+    lok(pt == NULL);
+}
+
+int main (int argc, char* argv[]) {
+    lrun("typed_smoke", typed_smoke);
+    lrun("typed_add_get", typed_add_get);
+    lrun("typed_put_remove", typed_put_remove);
+    lrun("typed_many", typed_many);
+    lrun("typed_struct_keys", typed_struct_keys);
+    lresults();
+    return lfails != 0;
+}
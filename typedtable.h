@@ -0,0 +1,288 @@
+/*
+ * Copyright 2023 Frank Mitchell
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef FMC_TYPEDTABLE_H_INCLUDED
+#define FMC_TYPEDTABLE_H_INCLUDED
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+
+/** @file
+ * A macro that writes a hash table specialized for one key type and one
+ * value type.  Where `C_Table` calls its hash, equals, copy, and free
+ * functions through pointers on every probe and passes `C_Userdata`
+ * everywhere, a typed table stores keys and values by value in its own
+ * slots, and the compiler can inline the hash and equals functions.
+ * Use it for hot maps from integers, pointers, or small structs.
+ *
+ * `C_TABLE_DEFINE(Name, K, V, hash, equals)` defines the type `Name`
+ * and `static inline` functions in the manner of `C_Table`:
+ *
+ *     void   Name_new(Name* *tptr, size_t minsz);
+ *     void   Name_free(Name* *tptr);
+ *     size_t Name_size(Name* t);
+ *     bool   Name_add(Name* t, K key, V value);
+ *     bool   Name_get(Name* t, K key, V* value);
+ *     bool   Name_has(Name* t, K key);
+ *     bool   Name_put(Name* t, K key, V value);
+ *     bool   Name_remove(Name* t, K key);
+ *     bool   Name_remove_value(Name* t, K key, V* oldvalue);
+ *     size_t Name_for_each(Name* t, bool (*f)(K key, V* value, void* data), void* data);
+ *
+ * `hash` takes a `K` and returns a `uint64_t`; the table takes its low
+ * seven bits and the bits above those, so every bit should be well
+ * mixed, as by `C_Hash_u64()`.  `equals` takes two `K`s and returns
+ * whether they're the same key.  Both may be functions or macros.
+ * Keys and values are copied with plain assignment, and never freed.
+ *
+ * Put the macro at file scope, once per translation unit that uses it.
+ */
+
+/**
+ * A fast, well mixed 64-bit hash of an integer key, for typed tables.
+ * Unlike `C_Hash_bytes()` it's not seeded: don't use it on keys an
+ * attacker chooses.
+ */
+static inline uint64_t C_Hash_u64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+/**
+ * `C_Hash_u64()` of a pointer key.
+ */
+static inline uint64_t C_Hash_ptr(const void* p) {
+    return C_Hash_u64((uint64_t)(uintptr_t)p);
+}
+
+/**
+ * Equality for keys that C can compare with `==`.
+ */
+#define C_TABLE_EQ_SCALAR(a, b)     ((a) == (b))
+
+/*
+ * Each slot has a control byte: EMPTY, DELETED, or the low seven bits
+ * of its key's hash.  Lookups compare control bytes first, so they call
+ * `equals` only on likely matches; they stop at the first EMPTY.
+ */
+#define C_TYPED_EMPTY       0x80
+#define C_TYPED_DELETED     0xFE
+#define C_TYPED_MINSIZ      16
+#define C_TYPED_LOAD_NUM    7
+#define C_TYPED_LOAD_DEN    8
+
+#define C_TABLE_DEFINE(Name, K, V, hash, equals) \
+\
+typedef struct Name##_Slot { \
+    K key; \
+    V value; \
+} Name##_Slot; \
+\
+typedef struct Name { \
+    Name##_Slot* slots; \
+    uint8_t*     ctrl; \
+    size_t       len; \
+    size_t       nentries; \
+    size_t       growth; \
+} Name; \
+\
+/* Give `t` `len` empty slots, a power of two. */ \
+static inline bool Name##_alloc(Name* t, size_t len) { \
+    t->ctrl  = (uint8_t*)malloc(len); \
+    t->slots = (Name##_Slot*)malloc(len * sizeof(Name##_Slot)); \
+    if (t->ctrl == NULL || t->slots == NULL) { \
+        free(t->ctrl); \
+        free(t->slots); \
+        return false; \
+    } \
+    memset(t->ctrl, C_TYPED_EMPTY, len); \
+    t->len = len; \
+    t->growth = (len / C_TYPED_LOAD_DEN) * C_TYPED_LOAD_NUM; \
+    return true; \
+} \
+\
+static inline void Name##_new(Name* *tptr, size_t minsz) { \
+    size_t want = (minsz * C_TYPED_LOAD_DEN) / C_TYPED_LOAD_NUM + 1; \
+    size_t len = C_TYPED_MINSIZ; \
+    Name* t; \
+\
+    if (!tptr) return; \
+    (*tptr) = NULL; \
+\
+    t = (Name*)malloc(sizeof(Name)); \
+    if (!t) return; \
+\
+    memset(t, 0, sizeof(Name)); \
+    while (len < want) len *= 2; \
+    if (!Name##_alloc(t, len)) { \
+        free(t); \
+        return; \
+    } \
+    (*tptr) = t; \
+} \
+\
+static inline void Name##_free(Name* *tptr) { \
+    if (!tptr || !(*tptr)) return; \
+\
+    free((*tptr)->ctrl); \
+    free((*tptr)->slots); \
+    free(*tptr); \
+    (*tptr) = NULL; \
+} \
+\
+static inline size_t Name##_size(Name* t) { \
+    return t->nentries; \
+} \
+\
+/* The slot holding `key`, or `t->len` if none does. */ \
+static inline size_t Name##_find(Name* t, K key, uint64_t h) { \
+    size_t  mask = t->len - 1; \
+    size_t  i    = (size_t)(h >> 7) & mask; \
+    uint8_t h2   = (uint8_t)(h & 0x7F); \
+\
+    for (;;) { \
+        uint8_t c = t->ctrl[i]; \
+\
+        if (c == h2 && equals(t->slots[i].key, key)) { \
+            return i; \
+        } else if (c == C_TYPED_EMPTY) { \
+            return t->len; \
+        } \
+        i = (i + 1) & mask; \
+    } \
+} \
+\
+/* Put `key`, which has no slot, in the first free one. */ \
+static inline void Name##_place(Name* t, K key, V value, uint64_t h) { \
+    size_t mask = t->len - 1; \
+    size_t i    = (size_t)(h >> 7) & mask; \
+\
+    while (!(t->ctrl[i] & 0x80)) { \
+        i = (i + 1) & mask; \
+    } \
+    if (t->ctrl[i] == C_TYPED_EMPTY) { \
+        t->growth--; \
+    } \
+    t->ctrl[i] = (uint8_t)(h & 0x7F); \
+    t->slots[i].key   = key; \
+    t->slots[i].value = value; \
+} \
+\
+/* Make room for one more key, growing or sweeping out DELETED slots. */ \
+static inline bool Name##_reserve_one(Name* t) { \
+    Name old = *t; \
+    size_t cap = (t->len / C_TYPED_LOAD_DEN) * C_TYPED_LOAD_NUM; \
+\
+    if (t->growth > 0) return true; \
+\
+    if (!Name##_alloc(t, (t->nentries + 1 <= cap / 2) ? t->len : t->len * 2)) { \
+        *t = old; \
+        return false; \
+    } \
+    for (size_t i = 0; i < old.len; i++) { \
+        if (!(old.ctrl[i] & 0x80)) { \
+            Name##_place(t, old.slots[i].key, old.slots[i].value, hash(old.slots[i].key)); \
+        } \
+    } \
+    free(old.ctrl); \
+    free(old.slots); \
+    return true; \
+} \
+\
+static inline bool Name##_add(Name* t, K key, V value) { \
+    uint64_t h = hash(key); \
+\
+    if (Name##_find(t, key, h) < t->len || !Name##_reserve_one(t)) { \
+        return false; \
+    } \
+    Name##_place(t, key, value, h); \
+    t->nentries++; \
+    return true; \
+} \
+\
+static inline bool Name##_get(Name* t, K key, V* value) { \
+    size_t i = Name##_find(t, key, hash(key)); \
+\
+    if (i >= t->len) return false; \
+    if (value) (*value) = t->slots[i].value; \
+    return true; \
+} \
+\
+static inline bool Name##_has(Name* t, K key) { \
+    return Name##_find(t, key, hash(key)) < t->len; \
+} \
+\
+static inline bool Name##_put(Name* t, K key, V value) { \
+    uint64_t h = hash(key); \
+    size_t i = Name##_find(t, key, h); \
+\
+    if (i < t->len) { \
+        t->slots[i].value = value; \
+        return true; \
+    } \
+    if (!Name##_reserve_one(t)) { \
+        return false; \
+    } \
+    Name##_place(t, key, value, h); \
+    t->nentries++; \
+    return true; \
+} \
+\
+static inline bool Name##_remove_value(Name* t, K key, V* oldvalue) { \
+    size_t i = Name##_find(t, key, hash(key)); \
+\
+    if (i >= t->len) return false; \
+    if (oldvalue) (*oldvalue) = t->slots[i].value; \
+\
+    /* No probe passes through here to reach an EMPTY slot next door */ \
+    if (t->ctrl[(i + 1) & (t->len - 1)] == C_TYPED_EMPTY) { \
+        t->ctrl[i] = C_TYPED_EMPTY; \
+        t->growth++; \
+    } else { \
+        t->ctrl[i] = C_TYPED_DELETED; \
+    } \
+    t->nentries--; \
+    return true; \
+} \
+\
+static inline bool Name##_remove(Name* t, K key) { \
+    return Name##_remove_value(t, key, NULL); \
+} \
+\
+static inline size_t Name##_for_each(Name* t, bool (*f)(K key, V* value, void* data), void* data) { \
+    size_t count = 0; \
+\
+    for (size_t i = 0; i < t->len; i++) { \
+        if (!(t->ctrl[i] & 0x80)) { \
+            count++; \
+            if (!f(t->slots[i].key, &(t->slots[i].value), data)) break; \
+        } \
+    } \
+    return count; \
+}
+
+#endif // FMC_TYPEDTABLE_H_INCLUDED